@@ -0,0 +1,86 @@
+// Any Eigen heap allocation while disallowed triggers an assertion
+#define EIGEN_RUNTIME_NO_MALLOC
+
+#include <atomic>
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <cilantro/registration/icp_common_instances.hpp>
+#include <cilantro/utilities/point_cloud.hpp>
+#include <cilantro/utilities/timer.hpp>
+
+// Count all non-Eigen heap allocations (STL containers etc.)
+static std::atomic<size_t> num_allocations(0);
+
+void* operator new(size_t size) {
+    num_allocations++;
+    void * ptr = std::malloc(size);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void * ptr) noexcept {
+    std::free(ptr);
+}
+
+template <class ICPT>
+void benchmark(ICPT &icp, const std::string &name, size_t num_runs) {
+    // Warm-up: builds the search trees and sizes all buffers
+    icp.estimate();
+
+    cilantro::Timer timer;
+    size_t iterations = 0;
+    const size_t allocations_start = num_allocations;
+    Eigen::internal::set_is_malloc_allowed(false);
+    timer.start();
+    for (size_t r = 0; r < num_runs; r++) {
+        icp.estimate();
+        iterations += icp.getNumberOfPerformedIterations();
+    }
+    timer.stop();
+    Eigen::internal::set_is_malloc_allowed(true);
+    const size_t allocations = num_allocations - allocations_start;
+
+    std::cout << name << ": " << iterations << " iterations, " << allocations << " heap allocations ("
+              << (double)allocations/iterations << " per iteration), "
+              << timer.getElapsedTime()/iterations << "ms per iteration" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        std::cout << "Please provide path to PLY file." << std::endl;
+        return 0;
+    }
+
+    cilantro::PointCloud3f dst(argv[1]);
+
+    if (!dst.hasNormals()) {
+        std::cout << "Input cloud is empty or does not have normals!" << std::endl;
+        return 0;
+    }
+
+    // Small problem, as in frame-to-frame tracking
+    dst.gridDownsample(0.02f);
+
+    cilantro::RigidTransform3f tf_ref;
+    tf_ref.linear() = Eigen::Matrix3f(Eigen::AngleAxisf(0.05f, Eigen::Vector3f::UnitY()));
+    tf_ref.translation() = Eigen::Vector3f(0.02f, -0.01f, 0.01f);
+    cilantro::PointCloud3f src(dst.transformed(tf_ref));
+
+    std::cout << "Number of points: " << dst.size() << std::endl;
+
+    const size_t num_runs = 1000;
+    const cilantro::CorrespondenceSearchDirection dirs[] = {cilantro::CorrespondenceSearchDirection::FIRST_TO_SECOND,
+                                                            cilantro::CorrespondenceSearchDirection::SECOND_TO_FIRST,
+                                                            cilantro::CorrespondenceSearchDirection::BOTH};
+    const std::string dir_names[] = {"FIRST_TO_SECOND", "SECOND_TO_FIRST", "BOTH"};
+
+    for (size_t d = 0; d < 3; d++) {
+        cilantro::SimpleCombinedMetricRigidICP3f icp(dst.points, dst.normals, src.points);
+        icp.correspondenceSearchEngine().setMaxDistance(0.1f*0.1f).setSearchDirection(dirs[d]);
+        icp.setMaxNumberOfIterations(10).setConvergenceTolerance(0.0f);
+        benchmark(icp, "KD-tree search, " + dir_names[d], num_runs);
+    }
+
+    return 0;
+}
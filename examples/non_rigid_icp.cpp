@@ -1,4 +1,5 @@
 #include <cilantro/registration/icp_common_instances.hpp>
+#include <cilantro/registration/deformation_graph.hpp>
 #include <cilantro/utilities/point_cloud.hpp>
 #include <cilantro/visualization.hpp>
 #include <cilantro/utilities/timer.hpp>
@@ -45,22 +46,16 @@ int main(int argc, char ** argv) {
 
     float max_correspondence_dist_sq = 0.02f*0.02f;
 
-    // Get a sparse set of control nodes by downsampling
-    cilantro::VectorSet<float,3> control_points = cilantro::PointsGridDownsampler3f(src.points, control_res).getDownsampledPoints();
-    cilantro::KDTree<float,3> control_tree(control_points);
-
-    // Find which control nodes affect each point in src
-    cilantro::NeighborhoodSet<float> src_to_control_nn = control_tree.search(src.points, cilantro::KNNNeighborhoodSpecification<>(4));
-
-    // Get regularization neighborhoods for control nodes
-    cilantro::NeighborhoodSet<float> regularization_nn = control_tree.search(control_points, cilantro::KNNNeighborhoodSpecification<>(8));
+    // Get a sparse set of control nodes by downsampling, the control nodes that affect each point in src (4 nearest),
+    // and regularization neighborhoods for control nodes (8 nearest)
+    cilantro::DeformationGraph3f graph(src.points, control_res, 1, 2.0f, 4, 8);
 
     // Perform ICP registration
     cilantro::Timer timer;
     timer.start();
 
-//    cilantro::SimpleCombinedMetricSparseAffineWarpFieldICP3f icp(dst.points, dst.normals, src.points, src_to_control_nn, control_points.cols(), regularization_nn);
-    cilantro::SimpleCombinedMetricSparseRigidWarpFieldICP3f icp(dst.points, dst.normals, src.points, src_to_control_nn, control_points.cols(), regularization_nn);
+//    cilantro::SimpleCombinedMetricSparseAffineWarpFieldICP3f icp(dst.points, dst.normals, src.points, graph.getSkinningNeighborhoods(), graph.getNumberOfNodes(), graph.getRegularizationNeighborhoods());
+    cilantro::SimpleCombinedMetricSparseRigidWarpFieldICP3f icp(dst.points, dst.normals, src.points, graph.getSkinningNeighborhoods(), graph.getNumberOfNodes(), graph.getRegularizationNeighborhoods());
 
     // Parameter setting
     icp.correspondenceSearchEngine().setMaxDistance(max_correspondence_dist_sq);
@@ -0,0 +1,68 @@
+#include <cilantro/core/organized_normal_estimation.hpp>
+#include <cilantro/utilities/point_cloud.hpp>
+#include <cilantro/visualization.hpp>
+#include <cilantro/utilities/timer.hpp>
+
+int main(int argc, char ** argv) {
+    // Intrinsics
+    const size_t w = 640, h = 480;
+    Eigen::Matrix3f K;
+    K << 525, 0, 319.5, 0, 525, 239.5, 0, 0, 1;
+
+    // Synthetic depth image: a fronto-parallel plane at 1m (left half) in front of a tilted plane at about 3m, with
+    // a band of invalid pixels between them (occlusion shadow), as seen by real RGB-D sensors
+    const size_t edge = w/2, shadow_width = 3;
+    std::vector<float> depth(w*h);
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = 0; x < w; x++) {
+            if (x < edge - shadow_width) {
+                depth[y*w + x] = 1.0f;
+            } else if (x < edge) {
+                depth[y*w + x] = 0.0f;
+            } else {
+                depth[y*w + x] = 3.0f/(1.0f - 0.3f*(x - K(0,2))/K(0,0));
+            }
+        }
+    }
+
+    // Keep invalid pixels, so that points stay in pixel order
+    cilantro::PointCloud3f cloud;
+    cilantro::DepthValueConverter<float,float> dc(1.0f);
+    cilantro::depthImageToPoints(depth.data(), dc, w, h, K, cloud.points, true);
+
+    cilantro::Timer timer;
+    timer.start();
+    cilantro::OrganizedNormalEstimationf ne(cloud.points, w, h);
+    ne.setWindowRadius(4).setMaxDepthChangeFactor(0.02f);
+    cloud.normals = ne.getNormals();
+    timer.stop();
+
+    std::cout << "Estimation time: " << timer.getElapsedTime() << "ms" << std::endl;
+
+    // Windows do not mix the two surfaces across the shadow
+    const Eigen::Vector3f fg_normal(0.0f, 0.0f, -1.0f);
+    const Eigen::Vector3f bg_normal(Eigen::Vector3f(0.3f, 0.0f, -1.0f).normalized());
+    float max_error = 0.0f;
+    for (size_t y = 0; y < h; y++) {
+        for (size_t x = edge - shadow_width - 8; x < edge + 8; x++) {
+            const size_t i = y*w + x;
+            if (!cloud.normals.col(i).allFinite()) continue;
+            const Eigen::Vector3f &gt = (x < edge) ? fg_normal : bg_normal;
+            max_error = std::max(max_error, std::acos(std::min(1.0f, cloud.normals.col(i).dot(gt))));
+        }
+    }
+    std::cout << "Maximum normal error next to the occlusion shadow: " << max_error << " rad" << std::endl;
+
+    cloud.removeInvalidData();
+
+    cilantro::Visualizer viz("OrganizedNormalEstimation example", "disp");
+
+    viz.addObject<cilantro::PointCloudRenderable>("cloud", cloud, cilantro::RenderingProperties().setDrawNormals(true));
+
+    std::cout << "Press 'n' to toggle rendering of normals" << std::endl;
+    while (!viz.wasStopped()){
+        viz.spinOnce();
+    }
+
+    return 0;
+}
@@ -34,7 +34,7 @@ int main(int argc, char **argv) {
 
             cilantro::PlaneRANSACEstimator3f pe(cloud.points);
             pe.setMaxInlierResidual(0.01f).setTargetInlierCount((size_t)(0.15*cloud.size()))
-                .setMaxNumberOfIterations(250).setReEstimationStep(true);
+                .setMaxNumberOfIterations(250).setReEstimationStep(true).setAdaptiveTermination(true);
 
             Eigen::Hyperplane<float,3> plane = pe.estimate().getModel();
             const auto& inliers = pe.getModelInliers();
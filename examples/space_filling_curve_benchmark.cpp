@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <cilantro/utilities/point_cloud.hpp>
+#include <cilantro/utilities/timer.hpp>
+
+// KD-tree construction, normal estimation and nearest neighbor search on a cloud stored in the given order
+void benchmark(const cilantro::PointCloud3f &cloud, const cilantro::PointCloud3f &query, const std::string &name) {
+    cilantro::Timer timer;
+
+    timer.start();
+    cilantro::KDTree3f tree(cloud.points);
+    timer.stop();
+    const double tree_time = timer.getElapsedTime();
+
+    timer.start();
+    cilantro::VectorSet3f normals(cilantro::NormalEstimation3f(tree).getNormalsKNN(10));
+    timer.stop();
+    const double normals_time = timer.getElapsedTime();
+
+    // Nearest neighbors of a slightly transformed copy, as in ICP correspondence search
+    timer.start();
+    cilantro::NeighborhoodSet<float> nn;
+    tree.search(query.points, cilantro::KNNNeighborhoodSpecification<>(1), nn);
+    timer.stop();
+    const double corr_time = timer.getElapsedTime();
+
+    std::cout << name << ": kd-tree " << tree_time << "ms, normals " << normals_time << "ms, correspondences "
+              << corr_time << "ms" << std::endl;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        std::cout << "Please provide path to PLY file." << std::endl;
+        return 0;
+    }
+
+    cilantro::PointCloud3f cloud(argv[1]);
+    cloud.removeInvalidPoints();
+
+    if (cloud.isEmpty()) {
+        std::cout << "Input cloud is empty!" << std::endl;
+        return 0;
+    }
+
+    cilantro::RigidTransform3f tf;
+    tf.linear() = Eigen::Matrix3f(Eigen::AngleAxisf(0.02f, Eigen::Vector3f::UnitY()));
+    tf.translation() = Eigen::Vector3f(0.005f, -0.002f, 0.002f);
+
+    // Scanner order
+    benchmark(cloud, cloud.transformed(tf), "Input order");
+
+    // Arbitrary order (e.g. after merging or filtering)
+    std::vector<size_t> perm(cloud.size());
+    for (size_t i = 0; i < perm.size(); i++) perm[i] = i;
+    std::shuffle(perm.begin(), perm.end(), std::default_random_engine(0));
+    cilantro::PointCloud3f shuffled;
+    cilantro::reorderVectorSet<float,3>(cloud.points, perm, shuffled.points);
+    benchmark(shuffled, shuffled.transformed(tf), "Random order");
+
+    cilantro::Timer timer;
+    cilantro::PointCloud3f morton(shuffled);
+    timer.start();
+    morton.reorderAlongSpaceFillingCurve(cilantro::SpaceFillingCurve::MORTON);
+    timer.stop();
+    std::cout << "Morton reordering: " << timer.getElapsedTime() << "ms" << std::endl;
+    benchmark(morton, morton.transformed(tf), "Morton order");
+
+    cilantro::PointCloud3f hilbert(shuffled);
+    timer.start();
+    hilbert.reorderAlongSpaceFillingCurve(cilantro::SpaceFillingCurve::HILBERT);
+    timer.stop();
+    std::cout << "Hilbert reordering: " << timer.getElapsedTime() << "ms" << std::endl;
+    benchmark(hilbert, hilbert.transformed(tf), "Hilbert order");
+
+    return 0;
+}
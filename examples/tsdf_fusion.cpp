@@ -0,0 +1,109 @@
+#include <cilantro/utilities/point_cloud.hpp>
+#include <cilantro/visualization.hpp>
+#include <cilantro/registration/icp_common_instances.hpp>
+#include <cilantro/reconstruction/tsdf_volume.hpp>
+
+void capture_callback(bool &capture) {
+    capture = true;
+}
+
+void clear_callback(cilantro::TSDFVolumef &volume) {
+    volume.clear();
+}
+
+int main(int argc, char ** argv) {
+    // Intrinsics
+    Eigen::Matrix3f K;
+    K << 525, 0, 319.5, 0, 525, 239.5, 0, 0, 1;
+
+    std::string uri = "openni2:[img1=rgb,img2=depth_reg,coloursync=true,closerange=true,holefilter=true]//";
+
+    std::unique_ptr<pangolin::VideoInterface> dok = pangolin::OpenVideo(uri);
+    size_t w = 640, h = 480;
+    unsigned char* img = new unsigned char[dok->SizeBytes()];
+
+    pangolin::Image<unsigned char> rgb_img(img, w, h, 3*w*sizeof(unsigned char));
+    pangolin::Image<unsigned short> depth_img((unsigned short *)(img+3*w*h), w, h, w*sizeof(unsigned short));
+
+    std::string win_name = "TSDF fusion demo";
+    pangolin::CreateWindowAndBind(win_name, 2*w, h);
+    pangolin::Display("multi").SetBounds(0.0, 1.0, 0.0, 1.0).SetLayout(pangolin::LayoutEqual)
+            .AddDisplay(pangolin::Display("disp1")).AddDisplay(pangolin::Display("disp2"));
+
+    cilantro::Visualizer pcdv(win_name, "disp1");
+    cilantro::ImageViewer rgbv(win_name, "disp2");
+
+    // Parameters
+    float max_depth = 1.8f;
+    float voxel_size = 0.005f;
+
+    cilantro::TSDFVolumef volume(voxel_size);
+    volume.setMaxRayLength(max_depth + volume.getTruncationDistance());
+
+    cilantro::PointCloud3f model, frame;
+    cilantro::RigidTransform3f cam_pose(cilantro::RigidTransform3f::Identity());
+    bool capture = false;
+
+    pcdv.registerKeyboardCallback('a', std::bind(capture_callback, std::ref(capture)));
+    pcdv.registerKeyboardCallback('d', std::bind(clear_callback, std::ref(volume)));
+
+    cilantro::TruncatedDepthValueConverter<unsigned short,float> dc(1000.0f, max_depth);
+
+    if (argc < 2) std::cout << "Note: no output PLY file path provided" << std::endl;
+    std::cout << "Highlight the left viewport and:" << std::endl;
+    std::cout << "\tPress 'a' to fuse new view (keep pressed for continuous fusion)" << std::endl;
+    std::cout << "\tPress 'd' to reinitialize process" << std::endl;
+    std::cout << "\tPress 'l' to toggle lighting" << std::endl;
+
+    size_t num_fused = 0;
+
+    // Main loop
+    while (!pangolin::ShouldQuit()) {
+        dok->GrabNext(img, true);
+        frame.fromRGBDImages(rgb_img.ptr, depth_img.ptr, dc, w, h, K, false, true);
+
+        // Localize against the model surface rendered from the last pose
+        if (volume.getNumberOfBlocks() > 0) {
+            volume.raycast(cam_pose, K, w, h, model.points, model.normals);
+            cilantro::SimpleCombinedMetricRigidProjectiveICP3f icp(model.points, model.normals, frame.points, frame.normals);
+            icp.correspondenceSearchEngine().setProjectionExtrinsicMatrix(cam_pose).setMaxDistance(0.1f*0.1f)
+                    .setProjectionImageWidth(w).setProjectionImageHeight(h).setProjectionIntrinsicMatrix(K);
+            icp.setInitialTransform(cam_pose).setConvergenceTolerance(5e-4f);
+            icp.setMaxNumberOfIterations(6).setMaxNumberOfOptimizationStepIterations(1);
+            cam_pose = icp.estimate().getTransform();
+        } else {
+            cam_pose.setIdentity();
+            num_fused = 0;
+        }
+
+        // Map
+        if (capture) {
+            capture = false;
+            volume.integrate(rgb_img.ptr, depth_img.ptr, dc, w, h, K, cam_pose);
+            num_fused++;
+        }
+
+        // Visualization
+        rgbv.setImage(rgb_img.ptr, w, h, "RGB24");
+        pcdv.addObject<cilantro::PointCloudRenderable>("model", model, cilantro::RenderingProperties().setPointColor(0.8f, 0.8f, 0.8f));
+        pcdv.addObject<cilantro::CameraFrustumRenderable>("cam", w, h, K, cam_pose.matrix(), 0.1f, cilantro::RenderingProperties().setLineWidth(2.0f).setLineColor(1.0f,1.0f,0.0f));
+
+        pcdv.clearRenderArea();
+        rgbv.render();
+        pcdv.render();
+        pangolin::FinishFrame();
+    }
+
+    std::cout << "Fused " << num_fused << " frames" << std::endl;
+
+    if (argc > 1) {
+        cilantro::PointCloud3f cloud;
+        volume.extractPointsNormalsColors(cloud.points, cloud.normals, cloud.colors, 3.0f);
+        std::cout << "Saving model to \'" << argv[1] << "\'" << std::endl;
+        cloud.toPLYFile(argv[1], true);
+    }
+
+    delete[] img;
+
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include <cilantro/core.hpp>
 #include <cilantro/correspondence_search.hpp>
 #include <cilantro/model_estimation.hpp>
+#include <cilantro/reconstruction.hpp>
 #include <cilantro/registration.hpp>
 #include <cilantro/spatial.hpp>
 #include <cilantro/utilities.hpp>
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <set>
+#include <atomic>
 #include <cilantro/core/kd_tree.hpp>
+#include <cilantro/core/concurrent_disjoint_sets.hpp>
 #include <cilantro/core/common_pair_evaluators.hpp>
 #include <cilantro/clustering/clustering_base.hpp>
 
@@ -16,101 +17,221 @@ namespace cilantro {
         inline bool operator()(const T& obj1, const T& obj2) const { return obj1.size() > obj2.size(); }
     };
 
-    // Given neighbors and seeds
-    template <typename ScalarT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
-    void extractConnectedComponents(const NeighborhoodSet<ScalarT> &neighbors,
-                                    const std::vector<size_t> &seeds_ind,
-                                    std::vector<std::vector<size_t>> &segment_to_point_map,
-                                    const PointSimilarityEvaluator &evaluator = PointSimilarityEvaluator(),
-                                    size_t min_segment_size = 1,
-                                    size_t max_segment_size = std::numeric_limits<size_t>::max())
-    {
-        const size_t unassigned = std::numeric_limits<size_t>::max();
-        std::vector<size_t> current_label(neighbors.size(), unassigned);
-
-        std::vector<size_t> frontier_set;
-        frontier_set.reserve(neighbors.size());
-
-        std::vector<std::set<size_t>> seeds_to_merge_with(seeds_ind.size());
-        std::vector<char> seed_active(seeds_ind.size(), 0);
-
-#pragma omp parallel for shared (seeds_ind, current_label, seed_active, seeds_to_merge_with) private (frontier_set)
-        for (size_t i = 0; i < seeds_ind.size(); i++) {
-            if (current_label[seeds_ind[i]] != unassigned) continue;
+    namespace internal {
+        // Works on any indexable set of neighborhoods (NeighborhoodSet or FlatNeighborhoodSet)
+        template <class NeighborhoodSetT>
+        struct PrecomputedNeighborhoodProvider {
+            const NeighborhoodSetT &neighbors;
 
-            seeds_to_merge_with[i].insert(i);
+            inline PrecomputedNeighborhoodProvider(const NeighborhoodSetT &nh) : neighbors(nh) {}
 
-            frontier_set.clear();
-            frontier_set.emplace_back(seeds_ind[i]);
+            // First neighbor is the query point itself
+            template <class FuncT>
+            inline void forEachNeighbor(size_t i, const FuncT &func) {
+                const auto& nn(neighbors[i]);
+                for (size_t j = 1; j < nn.size(); j++) {
+                    func(nn[j].index, nn[j].value);
+                }
+            }
+        };
 
-            current_label[seeds_ind[i]] = i;
-            seed_active[i] = 1;
+        // Searches neighborhoods on demand; every thread works on its own copy
+        template <typename ScalarT, class SearchTreeT, class NeighborhoodSpecT>
+        struct SearchTreeNeighborhoodProvider {
+            const SearchTreeT &tree;
+            const NeighborhoodSpecT &spec;
+            Neighborhood<ScalarT> nn;
 
-            while (!frontier_set.empty()) {
-                const size_t curr_seed = frontier_set.back();
-                frontier_set.pop_back();
+            inline SearchTreeNeighborhoodProvider(const SearchTreeT &t, const NeighborhoodSpecT &nh) : tree(t), spec(nh) {}
 
-                const Neighborhood<ScalarT>& nn(neighbors[curr_seed]);
+            template <class FuncT>
+            inline void forEachNeighbor(size_t i, const FuncT &func) {
+                tree.search(tree.getPointsMatrixMap().col(i), spec, nn);
                 for (size_t j = 1; j < nn.size(); j++) {
-                    const size_t curr_lbl = current_label[nn[j].index];
-                    if (curr_lbl == i || evaluator(curr_seed, nn[j].index, nn[j].value)) {
-                        if (curr_lbl == unassigned) {
-                            frontier_set.emplace_back(nn[j].index);
-                            current_label[nn[j].index] = i;
-                        } else {
-                            if (curr_lbl != i) seeds_to_merge_with[i].insert(curr_lbl);
-                        }
-                    }
+                    func(nn[j].index, nn[j].value);
                 }
             }
-        }
+        };
+
+        template <class PointSimilarityEvaluator>
+        struct ConnectedComponentEdgeVisitor {
+            const PointSimilarityEvaluator &evaluator;
+            ConcurrentDisjointSets &sets;
+            std::vector<std::atomic<char>> &visited;
+            std::vector<size_t> &frontier;
+            size_t curr;
+
+            template <typename ValueT>
+            inline void operator()(size_t nb, ValueT value) const {
+                if (!evaluator(curr, nb, value)) return;
+                sets.unite(curr, nb);
+                if (visited[nb].exchange(1, std::memory_order_relaxed) == 0) frontier.emplace_back(nb);
+            }
+        };
+
+        // Groups points by component label (smaller than num_labels, or std::numeric_limits<size_t>::max() for no
+        // component) into the segments within the size limits, sorted by decreasing size (ties by smallest point index),
+        // each listing its points in increasing index order; point_to_segment is overwritten with the segment labels
+        // (number of segments for unlabeled points)
+        inline void componentLabelsToSegments(size_t num_labels,
+                                              size_t min_segment_size,
+                                              size_t max_segment_size,
+                                              std::vector<size_t> &point_to_segment,
+                                              std::vector<size_t> &segment_offsets,
+                                              std::vector<size_t> &segment_point_indices)
+        {
+            const size_t unassigned = std::numeric_limits<size_t>::max();
+            std::vector<size_t> label_size(num_labels, 0);
+            std::vector<size_t> label_first(num_labels, unassigned);
+            for (size_t i = 0; i < point_to_segment.size(); i++) {
+                const size_t label = point_to_segment[i];
+                if (label == unassigned) continue;
+                if (label_size[label]++ == 0) label_first[label] = i;
+            }
+
+            std::vector<size_t> segment_labels;
+            for (size_t l = 0; l < num_labels; l++) {
+                if (label_size[l] > 0 && label_size[l] >= min_segment_size && label_size[l] <= max_segment_size) segment_labels.emplace_back(l);
+            }
+            std::sort(segment_labels.begin(), segment_labels.end(), [&label_size,&label_first](size_t l1, size_t l2) {
+                return label_size[l1] > label_size[l2] || (label_size[l1] == label_size[l2] && label_first[l1] < label_first[l2]);
+            });
+
+            // Reuse label_size as label to segment map (unassigned for filtered out labels)
+            segment_offsets.resize(segment_labels.size() + 1);
+            segment_offsets[0] = 0;
+            for (size_t s = 0; s < segment_labels.size(); s++) {
+                segment_offsets[s + 1] = segment_offsets[s] + label_size[segment_labels[s]];
+            }
+            std::vector<size_t> segment_pos(segment_offsets.begin(), segment_offsets.end() - 1);
+            std::fill(label_size.begin(), label_size.end(), unassigned);
+            for (size_t s = 0; s < segment_labels.size(); s++) {
+                label_size[segment_labels[s]] = s;
+            }
 
-        for (size_t i = 0; i < seeds_to_merge_with.size(); i++) {
-            for (auto it = seeds_to_merge_with[i].begin(); it != seeds_to_merge_with[i].end(); ++it) {
-                seeds_to_merge_with[*it].insert(i);
+            const size_t no_segment = segment_labels.size();
+            segment_point_indices.resize(segment_offsets.back());
+            for (size_t i = 0; i < point_to_segment.size(); i++) {
+                const size_t segment = (point_to_segment[i] != unassigned) ? label_size[point_to_segment[i]] : unassigned;
+                if (segment == unassigned) {
+                    point_to_segment[i] = no_segment;
+                } else {
+                    point_to_segment[i] = segment;
+                    segment_point_indices[segment_pos[segment]++] = i;
+                }
             }
         }
 
-        std::vector<size_t> seed_repr(seeds_ind.size(), unassigned);
-        size_t seed_cluster_num = 0;
-        for (size_t i = 0; i < seeds_to_merge_with.size(); i++) {
-            if (seed_active[i] == 0 || seed_repr[i] != unassigned) continue;
-
-            frontier_set.clear();
-            frontier_set.emplace_back(i);
-            seed_repr[i] = seed_cluster_num;
-
-            while (!frontier_set.empty()) {
-                const size_t curr_seed = frontier_set.back();
-                frontier_set.pop_back();
-                for (auto it = seeds_to_merge_with[curr_seed].begin(); it != seeds_to_merge_with[curr_seed].end(); ++it) {
-                    if (seed_active[i] == 1 && seed_repr[*it] == unassigned) {
-                        frontier_set.emplace_back(*it);
-                        seed_repr[*it] = seed_cluster_num;
+        // Parallel depth-first traversals from the seeds (spatially coherent neighborhood queries); every traversed
+        // similar edge is merged in a lock-free union-find, so traversals meeting each other need no synchronization.
+        // Results are independent of the number of threads and the traversal order: segments are sorted by decreasing
+        // size (ties by smallest point index) and list their points in increasing index order.
+        template <class NeighborhoodProviderT, class PointSimilarityEvaluator>
+        void extractConnectedComponentLabels(size_t num_points,
+                                             const NeighborhoodProviderT &provider,
+                                             const std::vector<size_t> &seeds_ind,
+                                             const PointSimilarityEvaluator &evaluator,
+                                             size_t min_segment_size,
+                                             size_t max_segment_size,
+                                             std::vector<size_t> &point_to_segment,
+                                             std::vector<size_t> &segment_offsets,
+                                             std::vector<size_t> &segment_point_indices)
+        {
+            ConcurrentDisjointSets sets(num_points);
+            std::vector<std::atomic<char>> visited(num_points);
+
+#pragma omp parallel
+            {
+                NeighborhoodProviderT provider_private(provider);
+                std::vector<size_t> frontier;
+#pragma omp for schedule(dynamic, 256)
+                for (size_t i = 0; i < seeds_ind.size(); i++) {
+                    if (visited[seeds_ind[i]].exchange(1, std::memory_order_relaxed) != 0) continue;
+                    frontier.emplace_back(seeds_ind[i]);
+                    while (!frontier.empty()) {
+                        const size_t curr = frontier.back();
+                        frontier.pop_back();
+                        const ConnectedComponentEdgeVisitor<PointSimilarityEvaluator> visitor = {evaluator, sets, visited, frontier, curr};
+                        provider_private.forEachNeighbor(curr, visitor);
                     }
                 }
             }
 
-            seed_cluster_num++;
+            const size_t unassigned = std::numeric_limits<size_t>::max();
+            point_to_segment.resize(num_points);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_points; i++) {
+                point_to_segment[i] = (visited[i].load(std::memory_order_relaxed) != 0) ? sets.find(i) : unassigned;
+            }
+            componentLabelsToSegments(num_points, min_segment_size, max_segment_size, point_to_segment, segment_offsets, segment_point_indices);
         }
 
-        std::vector<std::vector<size_t>> segment_to_point_map_tmp(seed_cluster_num);
-        for (size_t i = 0; i < current_label.size(); i++) {
-            if (current_label[i] == unassigned) continue;
-            const auto ind = seed_repr[current_label[i]];
-            if (segment_to_point_map_tmp[ind].size() <= max_segment_size) {
-                segment_to_point_map_tmp[ind].emplace_back(i);
+        inline void segmentOffsetsToClusterToPointIndicesMap(const std::vector<size_t> &segment_offsets,
+                                                             const std::vector<size_t> &segment_point_indices,
+                                                             std::vector<std::vector<size_t>> &segment_to_point_map)
+        {
+            segment_to_point_map.resize(segment_offsets.size() - 1);
+#pragma omp parallel for
+            for (size_t s = 0; s < segment_to_point_map.size(); s++) {
+                segment_to_point_map[s].assign(segment_point_indices.begin() + segment_offsets[s], segment_point_indices.begin() + segment_offsets[s + 1]);
             }
         }
 
-        segment_to_point_map.clear();
-        for (size_t i = 0; i < segment_to_point_map_tmp.size(); i++) {
-            if (segment_to_point_map_tmp[i].size() >= min_segment_size && segment_to_point_map_tmp[i].size() <= max_segment_size) {
-                segment_to_point_map.emplace_back(std::move(segment_to_point_map_tmp[i]));
-            }
+        template <class NeighborhoodSetT, class PointSimilarityEvaluator>
+        void extractConnectedComponentsFromNeighborhoods(const NeighborhoodSetT &neighbors,
+                                                         const std::vector<size_t> &seeds_ind,
+                                                         std::vector<std::vector<size_t>> &segment_to_point_map,
+                                                         const PointSimilarityEvaluator &evaluator,
+                                                         size_t min_segment_size,
+                                                         size_t max_segment_size)
+        {
+            std::vector<size_t> point_to_segment, segment_offsets, segment_point_indices;
+            extractConnectedComponentLabels(neighbors.size(), PrecomputedNeighborhoodProvider<NeighborhoodSetT>(neighbors), seeds_ind, evaluator, min_segment_size, max_segment_size, point_to_segment, segment_offsets, segment_point_indices);
+            segmentOffsetsToClusterToPointIndicesMap(segment_offsets, segment_point_indices, segment_to_point_map);
         }
+    }
+
+    // Given neighbors (NeighborhoodSet or FlatNeighborhoodSet) and seeds; flat output: segment labels per point (number
+    // of segments for unlabeled points) and the points of segment i in
+    // segment_point_indices[segment_offsets[i]] to segment_point_indices[segment_offsets[i+1]-1]
+    template <class NeighborhoodSetT, class PointSimilarityEvaluator>
+    inline void extractConnectedComponentLabels(const NeighborhoodSetT &neighbors,
+                                                const std::vector<size_t> &seeds_ind,
+                                                std::vector<size_t> &point_to_segment,
+                                                std::vector<size_t> &segment_offsets,
+                                                std::vector<size_t> &segment_point_indices,
+                                                const PointSimilarityEvaluator &evaluator,
+                                                size_t min_segment_size = 1,
+                                                size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        internal::extractConnectedComponentLabels(neighbors.size(), internal::PrecomputedNeighborhoodProvider<NeighborhoodSetT>(neighbors), seeds_ind, evaluator, min_segment_size, max_segment_size, point_to_segment, segment_offsets, segment_point_indices);
+    }
 
-        std::sort(segment_to_point_map.begin(), segment_to_point_map.end(), SizeGreaterComparator<std::vector<size_t>>());
+    // Given search tree and seeds; flat output as above
+    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor, class NeighborhoodSpecT, class PointSimilarityEvaluator>
+    inline void extractConnectedComponentLabels(const KDTree<ScalarT,EigenDim,DistAdaptor> &tree,
+                                                const NeighborhoodSpecT &nh,
+                                                const std::vector<size_t> &seeds_ind,
+                                                std::vector<size_t> &point_to_segment,
+                                                std::vector<size_t> &segment_offsets,
+                                                std::vector<size_t> &segment_point_indices,
+                                                const PointSimilarityEvaluator &evaluator,
+                                                size_t min_segment_size = 1,
+                                                size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        internal::extractConnectedComponentLabels(tree.getPointsMatrixMap().cols(), internal::SearchTreeNeighborhoodProvider<ScalarT,KDTree<ScalarT,EigenDim,DistAdaptor>,NeighborhoodSpecT>(tree, nh), seeds_ind, evaluator, min_segment_size, max_segment_size, point_to_segment, segment_offsets, segment_point_indices);
+    }
+
+    // Given neighbors and seeds
+    template <typename ScalarT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
+    inline void extractConnectedComponents(const NeighborhoodSet<ScalarT> &neighbors,
+                                           const std::vector<size_t> &seeds_ind,
+                                           std::vector<std::vector<size_t>> &segment_to_point_map,
+                                           const PointSimilarityEvaluator &evaluator = PointSimilarityEvaluator(),
+                                           size_t min_segment_size = 1,
+                                           size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        internal::extractConnectedComponentsFromNeighborhoods(neighbors, seeds_ind, segment_to_point_map, evaluator, min_segment_size, max_segment_size);
     }
 
     // Given neighbors and seeds
@@ -153,6 +274,56 @@ namespace cilantro {
         return segment_to_point_map;
     }
 
+    // Given flat (CSR) neighbors and seeds
+    template <typename ScalarT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
+    inline void extractConnectedComponents(const FlatNeighborhoodSet<ScalarT> &neighbors,
+                                           const std::vector<size_t> &seeds_ind,
+                                           std::vector<std::vector<size_t>> &segment_to_point_map,
+                                           const PointSimilarityEvaluator &evaluator = PointSimilarityEvaluator(),
+                                           size_t min_segment_size = 1,
+                                           size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        internal::extractConnectedComponentsFromNeighborhoods(neighbors, seeds_ind, segment_to_point_map, evaluator, min_segment_size, max_segment_size);
+    }
+
+    // Given flat (CSR) neighbors and seeds
+    template <typename ScalarT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
+    inline std::vector<std::vector<size_t>> extractConnectedComponents(const FlatNeighborhoodSet<ScalarT> &neighbors,
+                                                                       const std::vector<size_t> &seeds_ind,
+                                                                       const PointSimilarityEvaluator &evaluator = PointSimilarityEvaluator(),
+                                                                       size_t min_segment_size = 1,
+                                                                       size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        std::vector<std::vector<size_t>> segment_to_point_map;
+        internal::extractConnectedComponentsFromNeighborhoods(neighbors, seeds_ind, segment_to_point_map, evaluator, min_segment_size, max_segment_size);
+        return segment_to_point_map;
+    }
+
+    // Given flat (CSR) neighbors, all seeds
+    template <typename ScalarT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
+    void extractConnectedComponents(const FlatNeighborhoodSet<ScalarT> &neighbors,
+                                    std::vector<std::vector<size_t>> &segment_to_point_map,
+                                    const PointSimilarityEvaluator &evaluator = PointSimilarityEvaluator(),
+                                    size_t min_segment_size = 1,
+                                    size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        std::vector<size_t> seeds_ind(neighbors.size());
+        for (size_t i = 0; i < seeds_ind.size(); i++) seeds_ind[i] = i;
+        internal::extractConnectedComponentsFromNeighborhoods(neighbors, seeds_ind, segment_to_point_map, evaluator, min_segment_size, max_segment_size);
+    }
+
+    // Given flat (CSR) neighbors, all seeds
+    template <typename ScalarT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
+    std::vector<std::vector<size_t>> extractConnectedComponents(const FlatNeighborhoodSet<ScalarT> &neighbors,
+                                                                const PointSimilarityEvaluator &evaluator = PointSimilarityEvaluator(),
+                                                                size_t min_segment_size = 1,
+                                                                size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        std::vector<std::vector<size_t>> segment_to_point_map;
+        extractConnectedComponents<ScalarT,PointSimilarityEvaluator>(neighbors, segment_to_point_map, evaluator, min_segment_size, max_segment_size);
+        return segment_to_point_map;
+    }
+
     // Given search tree and seeds
     template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor, class NeighborhoodSpecT, class PointSimilarityEvaluator = AlwaysTrueEvaluator<ScalarT>>
     void extractConnectedComponents(const KDTree<ScalarT,EigenDim,DistAdaptor> &tree,
@@ -163,96 +334,9 @@ namespace cilantro {
                                     size_t min_segment_size = 1,
                                     size_t max_segment_size = std::numeric_limits<size_t>::max())
     {
-        const ConstVectorSetMatrixMap<ScalarT,EigenDim>& points(tree.getPointsMatrixMap());
-
-        const size_t unassigned = std::numeric_limits<size_t>::max();
-        std::vector<size_t> current_label(points.cols(), unassigned);
-
-        std::vector<size_t> frontier_set;
-        frontier_set.reserve(points.cols());
-
-        std::vector<std::set<size_t>> seeds_to_merge_with(seeds_ind.size());
-        std::vector<char> seed_active(seeds_ind.size(), 0);
-
-        Neighborhood<ScalarT> nn;
-
-#pragma omp parallel for shared (seeds_ind, current_label, seed_active, seeds_to_merge_with) private (nn, frontier_set)
-        for (size_t i = 0; i < seeds_ind.size(); i++) {
-            if (current_label[seeds_ind[i]] != unassigned) continue;
-
-            seeds_to_merge_with[i].insert(i);
-
-            frontier_set.clear();
-            frontier_set.emplace_back(seeds_ind[i]);
-
-            current_label[seeds_ind[i]] = i;
-            seed_active[i] = 1;
-
-            while (!frontier_set.empty()) {
-                const size_t curr_seed = frontier_set.back();
-                frontier_set.pop_back();
-
-                tree.search(points.col(curr_seed), nh, nn);
-                for (size_t j = 1; j < nn.size(); j++) {
-                    const size_t curr_lbl = current_label[nn[j].index];
-                    if (curr_lbl == i || evaluator(curr_seed, nn[j].index, nn[j].value)) {
-                        if (curr_lbl == unassigned) {
-                            frontier_set.emplace_back(nn[j].index);
-                            current_label[nn[j].index] = i;
-                        } else {
-                            if (curr_lbl != i) seeds_to_merge_with[i].insert(curr_lbl);
-                        }
-                    }
-                }
-            }
-        }
-
-        for (size_t i = 0; i < seeds_to_merge_with.size(); i++) {
-            for (auto it = seeds_to_merge_with[i].begin(); it != seeds_to_merge_with[i].end(); ++it) {
-                seeds_to_merge_with[*it].insert(i);
-            }
-        }
-
-        std::vector<size_t> seed_repr(seeds_ind.size(), unassigned);
-        size_t seed_cluster_num = 0;
-        for (size_t i = 0; i < seeds_to_merge_with.size(); i++) {
-            if (seed_active[i] == 0 || seed_repr[i] != unassigned) continue;
-
-            frontier_set.clear();
-            frontier_set.emplace_back(i);
-            seed_repr[i] = seed_cluster_num;
-
-            while (!frontier_set.empty()) {
-                const size_t curr_seed = frontier_set.back();
-                frontier_set.pop_back();
-                for (auto it = seeds_to_merge_with[curr_seed].begin(); it != seeds_to_merge_with[curr_seed].end(); ++it) {
-                    if (seed_active[i] == 1 && seed_repr[*it] == unassigned) {
-                        frontier_set.emplace_back(*it);
-                        seed_repr[*it] = seed_cluster_num;
-                    }
-                }
-            }
-
-            seed_cluster_num++;
-        }
-
-        std::vector<std::vector<size_t>> segment_to_point_map_tmp(seed_cluster_num);
-        for (size_t i = 0; i < current_label.size(); i++) {
-            if (current_label[i] == unassigned) continue;
-            const auto ind = seed_repr[current_label[i]];
-            if (segment_to_point_map_tmp[ind].size() <= max_segment_size) {
-                segment_to_point_map_tmp[ind].emplace_back(i);
-            }
-        }
-
-        segment_to_point_map.clear();
-        for (size_t i = 0; i < segment_to_point_map_tmp.size(); i++) {
-            if (segment_to_point_map_tmp[i].size() >= min_segment_size && segment_to_point_map_tmp[i].size() <= max_segment_size) {
-                segment_to_point_map.emplace_back(std::move(segment_to_point_map_tmp[i]));
-            }
-        }
-
-        std::sort(segment_to_point_map.begin(), segment_to_point_map.end(), SizeGreaterComparator<std::vector<size_t>>());
+        std::vector<size_t> point_to_segment, segment_offsets, segment_point_indices;
+        extractConnectedComponentLabels<ScalarT,EigenDim,DistAdaptor,NeighborhoodSpecT,PointSimilarityEvaluator>(tree, nh, seeds_ind, point_to_segment, segment_offsets, segment_point_indices, evaluator, min_segment_size, max_segment_size);
+        internal::segmentOffsetsToClusterToPointIndicesMap(segment_offsets, segment_point_indices, segment_to_point_map);
     }
 
     // Given search tree and seeds
@@ -380,8 +464,9 @@ namespace cilantro {
                                                      size_t min_segment_size = 1,
                                                      size_t max_segment_size = std::numeric_limits<size_t>::max())
         {
-            extractConnectedComponents<ScalarT,EigenDim,DistAdaptor,NeighborhoodSpecT,PointSimilarityEvaluator>(*kd_tree_ptr_, nh, seeds_ind, this->cluster_to_point_indices_map_, evaluator, min_segment_size, max_segment_size);
-            this->point_to_cluster_index_map_ = cilantro::getPointToClusterIndexMap(this->cluster_to_point_indices_map_, points_.cols());
+            std::vector<size_t> segment_offsets, segment_point_indices;
+            extractConnectedComponentLabels<ScalarT,EigenDim,DistAdaptor,NeighborhoodSpecT,PointSimilarityEvaluator>(*kd_tree_ptr_, nh, seeds_ind, this->point_to_cluster_index_map_, segment_offsets, segment_point_indices, evaluator, min_segment_size, max_segment_size);
+            internal::segmentOffsetsToClusterToPointIndicesMap(segment_offsets, segment_point_indices, this->cluster_to_point_indices_map_);
             return *this;
         }
 
@@ -391,9 +476,9 @@ namespace cilantro {
                                                      size_t min_segment_size = 1,
                                                      size_t max_segment_size = std::numeric_limits<size_t>::max())
         {
-            extractConnectedComponents<ScalarT,EigenDim,DistAdaptor,NeighborhoodSpecT,PointSimilarityEvaluator>(*kd_tree_ptr_, nh, this->cluster_to_point_indices_map_, evaluator, min_segment_size, max_segment_size);
-            this->point_to_cluster_index_map_ = cilantro::getPointToClusterIndexMap(this->cluster_to_point_indices_map_, points_.cols());
-            return *this;
+            std::vector<size_t> seeds_ind(points_.cols());
+            for (size_t i = 0; i < seeds_ind.size(); i++) seeds_ind[i] = i;
+            return segment<NeighborhoodSpecT,PointSimilarityEvaluator>(nh, seeds_ind, evaluator, min_segment_size, max_segment_size);
         }
 
     protected:
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cilantro/core/grid_accumulator.hpp>
+#include <cilantro/core/common_accumulators.hpp>
+#include <cilantro/clustering/connected_component_extraction.hpp>
+
+namespace cilantro {
+    namespace internal {
+        // True if any point of cell_ind is closer than sqrt(tolerance_sq) to any point of other_ind; only points
+        // within reach of the other cell's box (other_corner, other_corner + cell_size) are tested against its points
+        template <typename ScalarT, ptrdiff_t EigenDim>
+        bool gridCellsConnected(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                                const std::vector<size_t> &cell_ind,
+                                const std::vector<size_t> &other_ind,
+                                const Vector<ScalarT,EigenDim> &other_corner,
+                                const Vector<ScalarT,EigenDim> &cell_size,
+                                ScalarT tolerance_sq)
+        {
+            for (size_t i = 0; i < cell_ind.size(); i++) {
+                ScalarT box_dist_sq = (ScalarT)0.0;
+                for (size_t d = 0; d < points.rows(); d++) {
+                    const ScalarT below = other_corner[d] - points(d,cell_ind[i]);
+                    const ScalarT above = points(d,cell_ind[i]) - other_corner[d] - cell_size[d];
+                    const ScalarT diff = std::max(std::max(below, above), (ScalarT)0.0);
+                    box_dist_sq += diff*diff;
+                }
+                if (box_dist_sq >= tolerance_sq) continue;
+
+                for (size_t j = 0; j < other_ind.size(); j++) {
+                    if ((points.col(cell_ind[i]) - points.col(other_ind[j])).squaredNorm() < tolerance_sq) return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    // Euclidean cluster extraction: connected components of the graph that links points closer than tolerance (same
+    // result as extractConnectedComponentLabels() with a RadiusNeighborhoodSpecification of tolerance^2 and L2
+    // distance), without per-point radius queries.
+    // Points are binned (GridAccumulator) into cells with a diagonal of tolerance, so every cell is connected as a
+    // whole; a cell is only linked to the occupied cells within reach (half stencil), if any of its points within
+    // tolerance of the other cell's box is closer than tolerance to one of its points. Cells are merged in parallel in
+    // a lock-free union-find. Output format and segment ordering are as in extractConnectedComponentLabels().
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    void extractEuclideanClusterLabels(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                                       ScalarT tolerance,
+                                       std::vector<size_t> &point_to_segment,
+                                       std::vector<size_t> &segment_offsets,
+                                       std::vector<size_t> &segment_point_indices,
+                                       size_t min_segment_size = 1,
+                                       size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        typedef GridAccumulator<ScalarT,EigenDim,IndexAccumulatorProxy<size_t>,ptrdiff_t,GridBinningMethod::RADIX_SORT> Grid;
+        typedef typename Grid::GridPoint GridPoint;
+
+        const size_t dim = points.rows();
+        const size_t unassigned = std::numeric_limits<size_t>::max();
+        point_to_segment.assign(points.cols(), unassigned);
+        if (points.cols() == 0 || dim == 0) {
+            internal::componentLabelsToSegments(0, min_segment_size, max_segment_size, point_to_segment, segment_offsets, segment_point_indices);
+            return;
+        }
+
+        // Cell diagonal slightly shorter than tolerance, so that rounding cannot disconnect a cell
+        const ScalarT cell_size = tolerance/std::sqrt((ScalarT)dim)*((ScalarT)1.0 - (ScalarT)16.0*std::numeric_limits<ScalarT>::epsilon());
+        const Grid grid(points, cell_size, IndexAccumulatorProxy<size_t>());
+        const typename Grid::GridBinMap &cells = grid.getOccupiedBinMap();
+        const Vector<ScalarT,EigenDim> &bin_size = grid.getBinSize();
+        const ScalarT tolerance_sq = tolerance*tolerance;
+
+        // Lexicographically positive offsets of the cells that can hold points closer than tolerance
+        const ptrdiff_t reach = (ptrdiff_t)std::ceil(std::sqrt((ScalarT)dim));
+        std::vector<GridPoint,Eigen::aligned_allocator<GridPoint>> stencil;
+        GridPoint offset(GridPoint::Constant(dim, 1, -reach));
+        while (true) {
+            size_t first_nonzero = 0;
+            while (first_nonzero < dim && offset[first_nonzero] == 0) first_nonzero++;
+            ScalarT gap_sq = (ScalarT)0.0;
+            for (size_t d = 0; d < dim; d++) {
+                const ScalarT gap = std::max<ptrdiff_t>(std::abs(offset[d]) - 1, 0)*bin_size[d];
+                gap_sq += gap*gap;
+            }
+            if (first_nonzero < dim && offset[first_nonzero] > 0 && gap_sq < tolerance_sq) stencil.emplace_back(offset);
+
+            size_t d = dim;
+            while (d > 0 && offset[d - 1] == reach) offset[--d] = -reach;
+            if (d == 0) break;
+            offset[d - 1]++;
+        }
+
+        ConcurrentDisjointSets sets(cells.size());
+#pragma omp parallel for schedule(dynamic, 256)
+        for (size_t c = 0; c < cells.size(); c++) {
+            const auto &cell = *(cells.begin() + c);
+            for (size_t s = 0; s < stencil.size(); s++) {
+                const GridPoint other_coords(cell.first + stencil[s]);
+                const auto other = cells.find(other_coords);
+                if (other == cells.end()) continue;
+                const size_t n = other - cells.begin();
+                if (sets.inSameSet(c, n)) continue;
+                if (internal::gridCellsConnected<ScalarT,EigenDim>(points, cell.second.indices, other->second.indices, grid.getBinCornerCoordinates(other_coords), bin_size, tolerance_sq)) {
+                    sets.unite(c, n);
+                }
+            }
+        }
+
+#pragma omp parallel for
+        for (size_t c = 0; c < cells.size(); c++) {
+            const size_t root = sets.find(c);
+            const std::vector<size_t> &ind = (cells.begin() + c)->second.indices;
+            for (size_t i = 0; i < ind.size(); i++) {
+                point_to_segment[ind[i]] = root;
+            }
+        }
+        internal::componentLabelsToSegments(cells.size(), min_segment_size, max_segment_size, point_to_segment, segment_offsets, segment_point_indices);
+    }
+
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    inline std::vector<std::vector<size_t>> extractEuclideanClusters(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                                                                     ScalarT tolerance,
+                                                                     size_t min_segment_size = 1,
+                                                                     size_t max_segment_size = std::numeric_limits<size_t>::max())
+    {
+        std::vector<size_t> point_to_segment, segment_offsets, segment_point_indices;
+        extractEuclideanClusterLabels<ScalarT,EigenDim>(points, tolerance, point_to_segment, segment_offsets, segment_point_indices, min_segment_size, max_segment_size);
+        std::vector<std::vector<size_t>> segment_to_point_map;
+        internal::segmentOffsetsToClusterToPointIndicesMap(segment_offsets, segment_point_indices, segment_to_point_map);
+        return segment_to_point_map;
+    }
+
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    class GridEuclideanClusterExtraction : public ClusteringBase<GridEuclideanClusterExtraction<ScalarT,EigenDim>> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef ScalarT Scalar;
+
+        enum { Dimension = EigenDim };
+
+        GridEuclideanClusterExtraction(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points)
+                : points_(points)
+        {}
+
+        ~GridEuclideanClusterExtraction() {}
+
+        inline GridEuclideanClusterExtraction& segment(ScalarT tolerance,
+                                                       size_t min_segment_size = 1,
+                                                       size_t max_segment_size = std::numeric_limits<size_t>::max())
+        {
+            std::vector<size_t> segment_offsets, segment_point_indices;
+            extractEuclideanClusterLabels<ScalarT,EigenDim>(points_, tolerance, this->point_to_cluster_index_map_, segment_offsets, segment_point_indices, min_segment_size, max_segment_size);
+            internal::segmentOffsetsToClusterToPointIndicesMap(segment_offsets, segment_point_indices, this->cluster_to_point_indices_map_);
+            return *this;
+        }
+
+    protected:
+        ConstVectorSetMatrixMap<ScalarT,EigenDim> points_;
+    };
+
+    typedef GridEuclideanClusterExtraction<float,2> GridEuclideanClusterExtraction2f;
+    typedef GridEuclideanClusterExtraction<double,2> GridEuclideanClusterExtraction2d;
+    typedef GridEuclideanClusterExtraction<float,3> GridEuclideanClusterExtraction3f;
+    typedef GridEuclideanClusterExtraction<double,3> GridEuclideanClusterExtraction3d;
+    typedef GridEuclideanClusterExtraction<float,Eigen::Dynamic> GridEuclideanClusterExtractionXf;
+    typedef GridEuclideanClusterExtraction<double,Eigen::Dynamic> GridEuclideanClusterExtractionXd;
+}
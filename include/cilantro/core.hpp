@@ -2,17 +2,24 @@
 
 #include <cilantro/core/common_accumulators.hpp>
 #include <cilantro/core/common_pair_evaluators.hpp>
+#include <cilantro/core/concurrent_disjoint_sets.hpp>
 #include <cilantro/core/correspondence.hpp>
 #include <cilantro/core/covariance.hpp>
 #include <cilantro/core/data_containers.hpp>
+#include <cilantro/core/dynamic_kd_tree.hpp>
 #include <cilantro/core/grid_accumulator.hpp>
 #include <cilantro/core/grid_downsampler.hpp>
 #include <cilantro/core/image_point_cloud_conversions.hpp>
 #include <cilantro/core/kd_tree.hpp>
 #include <cilantro/core/nearest_neighbors.hpp>
+#include <cilantro/core/normal_equation_accumulator.hpp>
 #include <cilantro/core/normal_estimation.hpp>
+#include <cilantro/core/organized_normal_estimation.hpp>
 #include <cilantro/core/openmp_reductions.hpp>
 #include <cilantro/core/principal_component_analysis.hpp>
+#include <cilantro/core/radix_sort.hpp>
 #include <cilantro/core/random.hpp>
+#include <cilantro/core/smallest_eigenvector_batch_solver.hpp>
+#include <cilantro/core/space_filling_curve.hpp>
 #include <cilantro/core/space_transformations.hpp>
 #include <cilantro/core/spectral_embedding_base.hpp>
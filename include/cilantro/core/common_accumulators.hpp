@@ -46,7 +46,7 @@ namespace cilantro {
 
         enum {EigenAlign = (EigenDim != Eigen::Dynamic) && (sizeof(Vector<ScalarT,EigenDim>) % 16 == 0)};
 
-        inline PointSumAccumulator(size_t dim = 0) : pointSum(Vector<ScalarT,EigenDim>::Zero(dim,1)), pointCount(0) {}
+        inline PointSumAccumulator(size_t dim = (EigenDim == Eigen::Dynamic) ? 0 : EigenDim) : pointSum(Vector<ScalarT,EigenDim>::Zero(dim,1)), pointCount(0) {}
 
         inline PointSumAccumulator(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &point)
                 : pointSum(point), pointCount(1)
@@ -93,7 +93,7 @@ namespace cilantro {
 
         enum {EigenAlign = (EigenDim != Eigen::Dynamic) && (sizeof(Vector<ScalarT,EigenDim>) % 16 == 0)};
 
-        inline PointNormalSumAccumulator(size_t dim = 0)
+        inline PointNormalSumAccumulator(size_t dim = (EigenDim == Eigen::Dynamic) ? 0 : EigenDim)
                 : pointSum(Vector<ScalarT,EigenDim>::Zero(dim,1)),
                   normalSum(Vector<ScalarT,EigenDim>::Zero(dim,1)),
                   pointCount(0)
@@ -158,7 +158,7 @@ namespace cilantro {
 
         enum {EigenAlign = (EigenDim != Eigen::Dynamic) && (sizeof(Vector<ScalarT,EigenDim>) % 16 == 0)};
 
-        inline PointColorSumAccumulator(size_t dim = 0)
+        inline PointColorSumAccumulator(size_t dim = (EigenDim == Eigen::Dynamic) ? 0 : EigenDim)
                 : pointSum(Vector<ScalarT,EigenDim>::Zero(dim,1)),
                   colorSum(Vector<float,3>::Zero()),
                   pointCount(0)
@@ -215,7 +215,7 @@ namespace cilantro {
 
         enum {EigenAlign = (EigenDim != Eigen::Dynamic) && (sizeof(Vector<ScalarT,EigenDim>) % 16 == 0)};
 
-        inline PointNormalColorSumAccumulator(size_t dim = 0)
+        inline PointNormalColorSumAccumulator(size_t dim = (EigenDim == Eigen::Dynamic) ? 0 : EigenDim)
                 : pointSum(Vector<ScalarT,EigenDim>::Zero(dim,1)),
                   normalSum(Vector<ScalarT,EigenDim>::Zero(dim,1)),
                   colorSum(Vector<float,3>::Zero()),
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+namespace cilantro {
+    // Lock-free disjoint sets (union-find) over {0, ..., size - 1}; unite() and find() may be called concurrently.
+    // Roots are linked by CAS under the smaller index, so parents never increase, no cycles can form, and every set is
+    // represented by its smallest element once all unions have completed. find() compresses paths by halving.
+    class ConcurrentDisjointSets {
+    public:
+        inline ConcurrentDisjointSets(size_t size = 0) { reset(size); }
+
+        inline ConcurrentDisjointSets& reset(size_t size) {
+            parent_ = std::vector<std::atomic<size_t>>(size);
+#pragma omp parallel for
+            for (size_t i = 0; i < size; i++) {
+                parent_[i].store(i, std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        inline size_t size() const { return parent_.size(); }
+
+        inline size_t find(size_t x) {
+            while (true) {
+                size_t p = parent_[x].load(std::memory_order_relaxed);
+                if (p == x) return x;
+                const size_t gp = parent_[p].load(std::memory_order_relaxed);
+                if (gp != p) parent_[x].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+                x = gp;
+            }
+        }
+
+        // Returns true if x and y were in different sets
+        inline bool unite(size_t x, size_t y) {
+            while (true) {
+                x = find(x);
+                y = find(y);
+                if (x == y) return false;
+                if (x < y) std::swap(x, y);
+                // Link root x under y, unless x stopped being a root meanwhile
+                size_t expected = x;
+                if (parent_[x].compare_exchange_strong(expected, y, std::memory_order_relaxed)) return true;
+            }
+        }
+
+        inline bool inSameSet(size_t x, size_t y) {
+            while (true) {
+                x = find(x);
+                y = find(y);
+                if (x == y) return true;
+                // Sets are only known to differ if x is still a root
+                if (parent_[x].load(std::memory_order_relaxed) == x) return false;
+            }
+        }
+
+    private:
+        std::vector<std::atomic<size_t>> parent_;
+    };
+}
@@ -71,29 +71,20 @@ namespace cilantro {
     {
         if (correspondences.empty()) return;
 
-        CorrSetT correspondences_copy = correspondences;
+        // Sort so that the best match for each index comes first, then keep the first of each run (in place)
+        typedef typename CorrSetT::value_type CorrT;
         switch (search_dir) {
             case CorrespondenceSearchDirection::FIRST_TO_SECOND:
-                correspondences.clear();
-                std::sort(correspondences_copy.begin(), correspondences_copy.end(),
-                          typename CorrSetT::value_type::IndexInSecondAndValueLessComparator());
-                correspondences.push_back(correspondences_copy.front());
-                for (const auto &corr : correspondences_copy) {
-                    if (corr.indexInSecond != correspondences.back().indexInSecond) {
-                        correspondences.push_back(corr);
-                    }
-                }
+                std::sort(correspondences.begin(), correspondences.end(), typename CorrT::IndexInSecondAndValueLessComparator());
+                correspondences.erase(std::unique(correspondences.begin(), correspondences.end(),
+                                                  [](const CorrT &c1, const CorrT &c2) { return c1.indexInSecond == c2.indexInSecond; }),
+                                      correspondences.end());
                 break;
             case CorrespondenceSearchDirection::SECOND_TO_FIRST:
-                correspondences.clear();
-                std::sort(correspondences_copy.begin(), correspondences_copy.end(),
-                          typename CorrSetT::value_type::IndexInFirstAndValueLessComparator());
-                correspondences.push_back(correspondences_copy.front());
-                for (const auto &corr : correspondences_copy) {
-                    if (corr.indexInFirst != correspondences.back().indexInFirst) {
-                        correspondences.push_back(corr);
-                    }
-                }
+                std::sort(correspondences.begin(), correspondences.end(), typename CorrT::IndexInFirstAndValueLessComparator());
+                correspondences.erase(std::unique(correspondences.begin(), correspondences.end(),
+                                                  [](const CorrT &c1, const CorrT &c2) { return c1.indexInFirst == c2.indexInFirst; }),
+                                      correspondences.end());
                 break;
             default:
                 break;
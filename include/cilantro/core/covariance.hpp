@@ -48,6 +48,47 @@ namespace cilantro {
         }
     };
 
+    // Single pass mean and covariance (same conventions as Covariance) from running sums of the points shifted by a
+    // reference point close to them (e.g. the query point of a neighborhood), which avoids the cancellation of the
+    // unshifted sum of outer products
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    class CovarianceAccumulator {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        inline CovarianceAccumulator& reset(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &shift) {
+            shift_ = shift;
+            sum_.setZero(shift.rows(), 1);
+            outer_sum_.setZero(shift.rows(), shift.rows());
+            count_ = 0;
+            return *this;
+        }
+
+        inline CovarianceAccumulator& addPoint(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &point) {
+            const Vector<ScalarT,EigenDim> diff(point - shift_);
+            sum_ += diff;
+            outer_sum_.noalias() += diff*diff.transpose();
+            count_++;
+            return *this;
+        }
+
+        inline size_t getNumberOfPoints() const { return count_; }
+
+        inline bool getMeanAndCovariance(Vector<ScalarT,EigenDim> &mean, Eigen::Matrix<ScalarT,EigenDim,EigenDim> &cov) const {
+            if (count_ < shift_.rows()) return false;
+            const Vector<ScalarT,EigenDim> shifted_mean(sum_*((ScalarT)(1.0)/count_));
+            mean = shift_ + shifted_mean;
+            cov.noalias() = (ScalarT)(1.0)/(count_ - 1)*(outer_sum_ - shifted_mean*sum_.transpose());
+            return true;
+        }
+
+    private:
+        Vector<ScalarT,EigenDim> shift_;
+        Vector<ScalarT,EigenDim> sum_;
+        Eigen::Matrix<ScalarT,EigenDim,EigenDim> outer_sum_;
+        size_t count_;
+    };
+
     template <typename ScalarT, ptrdiff_t EigenDim, typename CovarianceT = Covariance<ScalarT, EigenDim>, typename RandomGeneratorT = std::default_random_engine>
     class MinimumCovarianceDeterminant {
     public:
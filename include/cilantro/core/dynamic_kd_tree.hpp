@@ -0,0 +1,236 @@
+#pragma once
+
+#include <memory>
+#include <numeric>
+#include <cilantro/core/kd_tree.hpp>
+
+namespace cilantro {
+    // Forwards subtree results to the wrapped result set, mapping local to global indices and skipping removed points
+    template <class ResultSetT, typename ScalarT, typename IndexT = size_t>
+    class FilteredSearchResultAdaptor {
+    public:
+        FilteredSearchResultAdaptor(ResultSetT &result_set, const std::vector<IndexT> &global_indices, const std::vector<char> &removed)
+                : result_set_(result_set), global_indices_(global_indices), removed_(removed)
+        {}
+
+        inline size_t size() const { return result_set_.size(); }
+
+        inline bool full() const { return result_set_.full(); }
+
+        inline bool addPoint(ScalarT dist, IndexT index) {
+            const IndexT ind = global_indices_[index];
+            if (removed_[ind]) return true;
+            return result_set_.addPoint(dist, ind);
+        }
+
+        inline ScalarT worstDist() const { return result_set_.worstDist(); }
+
+    private:
+        ResultSetT& result_set_;
+        const std::vector<IndexT>& global_indices_;
+        const std::vector<char>& removed_;
+    };
+
+    // Logarithmic forest of static KD-trees that supports point insertion and (lazy) removal.
+    // Point indices are assigned in insertion order and stay valid across insertions and removals;
+    // getPointsMatrixMap() covers all points ever inserted, including removed ones.
+    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor = KDTreeDistanceAdaptors::L2, typename IndexT = size_t>
+    class DynamicKDTree : public KDTreeSearchBase<DynamicKDTree<ScalarT,EigenDim,DistAdaptor,IndexT>,ScalarT,EigenDim,IndexT> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef KDTree<ScalarT,EigenDim,DistAdaptor,IndexT> StaticTree;
+
+        DynamicKDTree(size_t dim = (EigenDim == Eigen::Dynamic) ? 0 : EigenDim, size_t max_leaf_size = 10)
+                : data_(dim, 0),
+                  num_points_(0),
+                  data_map_(data_.data(), dim, 0),
+                  num_removed_(0),
+                  num_indexed_removed_(0),
+                  max_leaf_size_(max_leaf_size),
+                  max_removed_fraction_(0.5)
+        {}
+
+        DynamicKDTree(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &data, size_t max_leaf_size = 10)
+                : DynamicKDTree(data.rows(), max_leaf_size)
+        {
+            addPoints(data);
+        }
+
+        ~DynamicKDTree() {}
+
+        inline const ConstVectorSetMatrixMap<ScalarT,EigenDim>& getPointsMatrixMap() const { return data_map_; }
+
+        inline bool isEmpty() const { return num_points_ == num_removed_; }
+
+        // Number of points ever inserted (index upper bound)
+        inline size_t getNumberOfPoints() const { return num_points_; }
+
+        inline size_t getNumberOfActivePoints() const { return num_points_ - num_removed_; }
+
+        inline bool isRemoved(IndexT ind) const { return removed_[ind] != 0; }
+
+        inline size_t getNumberOfTrees() const {
+            size_t count = 0;
+            for (size_t l = 0; l < levels_.size(); l++) {
+                if (levels_[l]) count++;
+            }
+            return count;
+        }
+
+        // Removed points that are still stored in the trees trigger a full rebuild once they exceed this fraction
+        inline double getMaxRemovedFraction() const { return max_removed_fraction_; }
+
+        inline DynamicKDTree& setMaxRemovedFraction(double fraction) {
+            max_removed_fraction_ = fraction;
+            rebuild_if_needed_();
+            return *this;
+        }
+
+        // New points get consecutive indices starting at getNumberOfPoints()
+        DynamicKDTree& addPoints(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points) {
+            const size_t num_new = points.cols();
+            if (num_new == 0) return *this;
+
+            if (num_points_ == 0) data_.resize(points.rows(), data_.cols());
+            if (num_points_ + num_new > data_.cols()) {
+                data_.conservativeResize(Eigen::NoChange, std::max<size_t>(2*data_.cols(), num_points_ + num_new));
+            }
+            data_.middleCols(num_points_, num_new) = points;
+            removed_.resize(num_points_ + num_new, 0);
+
+            std::vector<IndexT> indices(num_new);
+            std::iota(indices.begin(), indices.end(), (IndexT)num_points_);
+
+            num_points_ += num_new;
+            new (&data_map_) ConstVectorSetMatrixMap<ScalarT,EigenDim>(data_.data(), data_.rows(), num_points_);
+
+            insert_(indices);
+            return *this;
+        }
+
+        inline DynamicKDTree& addPoint(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &point) {
+            return addPoints(ConstVectorSetMatrixMap<ScalarT,EigenDim>(point.data(), point.rows(), 1));
+        }
+
+        inline DynamicKDTree& removePoint(IndexT ind) {
+            remove_(ind);
+            rebuild_if_needed_();
+            return *this;
+        }
+
+        DynamicKDTree& removePoints(const std::vector<IndexT> &indices) {
+            for (size_t i = 0; i < indices.size(); i++) {
+                remove_(indices[i]);
+            }
+            rebuild_if_needed_();
+            return *this;
+        }
+
+        // Rebuilds a single tree over all active points, discarding removed ones
+        DynamicKDTree& rebuild() {
+            std::vector<IndexT> indices;
+            indices.reserve(getNumberOfActivePoints());
+            for (size_t l = 0; l < levels_.size(); l++) {
+                if (!levels_[l]) continue;
+                append_active_indices_(levels_[l]->indices, indices);
+                levels_[l].reset();
+            }
+            std::sort(indices.begin(), indices.end());
+            num_indexed_removed_ = 0;
+
+            size_t l = 0;
+            while (level_capacity_(l) < indices.size()) l++;
+            if (l >= levels_.size()) levels_.resize(l + 1);
+            if (!indices.empty()) levels_[l].reset(new TreeLevel(data_map_, indices, max_leaf_size_));
+            return *this;
+        }
+
+        // Raw search with a nanoflann-compatible result set; larger trees are searched first for better pruning
+        template <class ResultSetT>
+        inline void findNeighbors(ResultSetT &result_set, const ScalarT * query_pt) const {
+            for (size_t l = levels_.size(); l > 0; l--) {
+                if (!levels_[l-1]) continue;
+                FilteredSearchResultAdaptor<ResultSetT,ScalarT,IndexT> filtered(result_set, levels_[l-1]->indices, removed_);
+                levels_[l-1]->tree.findNeighbors(filtered, query_pt);
+            }
+        }
+
+    private:
+        struct TreeLevel {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            TreeLevel(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &data, std::vector<IndexT> &ind, size_t max_leaf_size)
+                    : points(gather_(data, ind)), indices(std::move(ind)), tree(points, max_leaf_size)
+            {}
+
+            static VectorSet<ScalarT,EigenDim> gather_(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &data, const std::vector<IndexT> &ind) {
+                VectorSet<ScalarT,EigenDim> res(data.rows(), ind.size());
+                for (size_t i = 0; i < ind.size(); i++) {
+                    res.col(i) = data.col(ind[i]);
+                }
+                return res;
+            }
+
+            VectorSet<ScalarT,EigenDim> points;
+            std::vector<IndexT> indices;
+            StaticTree tree;
+        };
+
+        VectorSet<ScalarT,EigenDim> data_;
+        size_t num_points_;
+        ConstVectorSetMatrixMap<ScalarT,EigenDim> data_map_;
+        std::vector<char> removed_;
+        size_t num_removed_;
+        size_t num_indexed_removed_;
+        size_t max_leaf_size_;
+        double max_removed_fraction_;
+        std::vector<std::unique_ptr<TreeLevel>> levels_;
+
+        static inline size_t level_capacity_(size_t level) { return (size_t)64 << level; }
+
+        inline void append_active_indices_(const std::vector<IndexT> &src, std::vector<IndexT> &dst) {
+            for (size_t i = 0; i < src.size(); i++) {
+                if (removed_[src[i]]) {
+                    num_indexed_removed_--;
+                } else {
+                    dst.emplace_back(src[i]);
+                }
+            }
+        }
+
+        // Merges lower levels into the new points until they fit (binary counter style)
+        void insert_(std::vector<IndexT> &indices) {
+            size_t l = 0;
+            while (true) {
+                if (l == levels_.size()) levels_.emplace_back();
+                if (levels_[l]) {
+                    append_active_indices_(levels_[l]->indices, indices);
+                    levels_[l].reset();
+                }
+                if (indices.size() <= level_capacity_(l)) break;
+                l++;
+            }
+            if (!indices.empty()) levels_[l].reset(new TreeLevel(data_map_, indices, max_leaf_size_));
+        }
+
+        inline void remove_(IndexT ind) {
+            if (ind >= num_points_ || removed_[ind]) return;
+            removed_[ind] = 1;
+            num_removed_++;
+            num_indexed_removed_++;
+        }
+
+        inline void rebuild_if_needed_() {
+            const size_t num_indexed = getNumberOfActivePoints() + num_indexed_removed_;
+            if (num_indexed_removed_ > 0 && num_indexed_removed_ >= max_removed_fraction_*num_indexed) rebuild();
+        }
+    };
+
+    typedef DynamicKDTree<float,2,KDTreeDistanceAdaptors::L2> DynamicKDTree2f;
+    typedef DynamicKDTree<double,2,KDTreeDistanceAdaptors::L2> DynamicKDTree2d;
+    typedef DynamicKDTree<float,3,KDTreeDistanceAdaptors::L2> DynamicKDTree3f;
+    typedef DynamicKDTree<double,3,KDTreeDistanceAdaptors::L2> DynamicKDTree3d;
+    typedef DynamicKDTree<float,Eigen::Dynamic,KDTreeDistanceAdaptors::L2> DynamicKDTreeXf;
+    typedef DynamicKDTree<double,Eigen::Dynamic,KDTreeDistanceAdaptors::L2> DynamicKDTreeXd;
+}
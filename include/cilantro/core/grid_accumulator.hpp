@@ -1,10 +1,21 @@
 #pragma once
 
 #include <map>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
 #include <cilantro/config.hpp>
 #include <cilantro/core/data_containers.hpp>
+#include <cilantro/core/radix_sort.hpp>
 
 namespace cilantro {
+    // Bin storage, which also determines bin iteration order (and hence e.g. the order of downsampled points):
+    // ORDERED_MAP (default) iterates bins in lexicographic grid point order; HASH_MAP builds in linear time, but bins
+    // come in hash table order; RADIX_SORT keeps the lexicographic order as long as grid coordinates pack into 64 bits.
+    enum struct GridBinningMethod {ORDERED_MAP, HASH_MAP, RADIX_SORT};
+
     namespace internal {
         template <typename ScalarT, ptrdiff_t EigenDim, ptrdiff_t EigenCoeff>
         struct EigenVectorComparatorHelper {
@@ -49,7 +60,354 @@ namespace cilantro {
         }
     };
 
-    template <typename ScalarT, ptrdiff_t EigenDim, class AccumulatorProxy, typename GridPointScalarT = ptrdiff_t>
+    namespace internal {
+        // splitmix64 finalizer
+        inline uint64_t mixHashBits(uint64_t x) {
+            x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+            x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+            return x ^ (x >> 31);
+        }
+    }
+
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    struct EigenVectorHasher {
+        template <typename VectorT>
+        inline size_t operator()(const VectorT &p) const {
+            uint64_t h = 0;
+            for (size_t i = 0; i < p.rows(); i++) {
+                h = internal::mixHashBits(h + 0x9e3779b97f4a7c15ULL + std::hash<ScalarT>()(p[i]));
+            }
+            return (size_t)h;
+        }
+    };
+
+    // Flat (contiguous) bin storage indexed by an open addressing, linear probing hash table.
+    // Iterators are stable between builds and dereference to std::pair<GridPoint,Accumulator>, as with std::map.
+    template <typename GridPointT, typename AccumulatorT, class HasherT = EigenVectorHasher<typename GridPointT::Scalar,GridPointT::RowsAtCompileTime>>
+    class GridBinHashMap {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef GridPointT key_type;
+        typedef AccumulatorT mapped_type;
+        typedef std::pair<GridPointT,AccumulatorT> value_type;
+        typedef std::vector<value_type,Eigen::aligned_allocator<value_type>> BinContainer;
+        typedef typename BinContainer::iterator iterator;
+        typedef typename BinContainer::const_iterator const_iterator;
+
+        GridBinHashMap() : mask_(0) {}
+
+        inline size_t size() const { return bins_.size(); }
+
+        inline bool empty() const { return bins_.empty(); }
+
+        inline iterator begin() { return bins_.begin(); }
+
+        inline iterator end() { return bins_.end(); }
+
+        inline const_iterator begin() const { return bins_.begin(); }
+
+        inline const_iterator end() const { return bins_.end(); }
+
+        inline iterator find(const GridPointT &key) {
+            const size_t ind = find_index_(key, hasher_(key));
+            return (ind == empty_slot_) ? bins_.end() : bins_.begin() + ind;
+        }
+
+        inline const_iterator find(const GridPointT &key) const {
+            const size_t ind = find_index_(key, hasher_(key));
+            return (ind == empty_slot_) ? bins_.end() : bins_.begin() + ind;
+        }
+
+        inline const HasherT& hash_function() const { return hasher_; }
+
+        inline GridBinHashMap& clear() {
+            bins_.clear();
+            hashes_.clear();
+            slots_.clear();
+            mask_ = 0;
+            return *this;
+        }
+
+        // Bins points [0, num_points), where grid_coords(i) returns the GridPoint of point i
+        template <class GridCoordinatesFunT, class AccumulatorProxyT>
+        GridBinHashMap& build(size_t num_points,
+                              const GridCoordinatesFunT &grid_coords,
+                              const AccumulatorProxyT &accum_proxy,
+                              bool parallel = true)
+        {
+            clear();
+
+            const size_t num_chunks = (num_points + chunk_size_ - 1)/chunk_size_;
+            if (!parallel || num_chunks < 2) {
+                for (size_t i = 0; i < num_points; i++) {
+                    GridPointT key(grid_coords(i));
+                    const size_t hash = hasher_(key);
+                    accumulate_(std::move(key), hash, accum_proxy, i);
+                }
+                return *this;
+            }
+
+            // Hash partitioning (top hash bits) makes the merge of the per-chunk maps lock-free;
+            // chunking only depends on num_points, so the result does not depend on the number of threads
+            size_t part_bits = 0;
+            while (((size_t)1 << part_bits) < std::min(num_chunks, max_partitions_)) part_bits++;
+            const size_t num_parts = (size_t)1 << part_bits;
+            const size_t part_shift = std::numeric_limits<size_t>::digits - part_bits;
+
+            std::vector<GridBinHashMap> chunk_maps(num_chunks);
+            std::vector<std::vector<size_t>> chunk_part_offsets(num_chunks, std::vector<size_t>(num_parts + 1));
+            std::vector<std::vector<size_t>> chunk_part_bins(num_chunks);
+            std::vector<GridBinHashMap> part_maps(num_parts);
+            std::vector<size_t> part_offsets(num_parts + 1, 0);
+
+#pragma omp parallel
+            {
+#pragma omp for schedule(dynamic)
+                for (size_t c = 0; c < num_chunks; c++) {
+                    GridBinHashMap &local = chunk_maps[c];
+                    const size_t end = std::min(num_points, (c + 1)*chunk_size_);
+                    for (size_t i = c*chunk_size_; i < end; i++) {
+                        GridPointT key(grid_coords(i));
+                        const size_t hash = hasher_(key);
+                        local.accumulate_(std::move(key), hash, accum_proxy, i);
+                    }
+
+                    // Counting sort of local bins by partition
+                    std::vector<size_t> &offsets = chunk_part_offsets[c];
+                    for (size_t b = 0; b < local.hashes_.size(); b++) {
+                        offsets[(local.hashes_[b] >> part_shift) + 1]++;
+                    }
+                    for (size_t p = 0; p < num_parts; p++) {
+                        offsets[p + 1] += offsets[p];
+                    }
+                    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+                    chunk_part_bins[c].resize(local.hashes_.size());
+                    for (size_t b = 0; b < local.hashes_.size(); b++) {
+                        chunk_part_bins[c][pos[local.hashes_[b] >> part_shift]++] = b;
+                    }
+                }
+
+#pragma omp for schedule(dynamic)
+                for (size_t p = 0; p < num_parts; p++) {
+                    GridBinHashMap &merged = part_maps[p];
+                    for (size_t c = 0; c < num_chunks; c++) {
+                        GridBinHashMap &local = chunk_maps[c];
+                        for (size_t k = chunk_part_offsets[c][p]; k < chunk_part_offsets[c][p + 1]; k++) {
+                            const size_t b = chunk_part_bins[c][k];
+                            merged.merge_(std::move(local.bins_[b]), local.hashes_[b]);
+                        }
+                    }
+                    part_offsets[p + 1] = merged.size();
+                }
+
+            }
+
+            chunk_maps.clear();
+            for (size_t p = 0; p < num_parts; p++) {
+                part_offsets[p + 1] += part_offsets[p];
+            }
+            bins_.reserve(part_offsets[num_parts]);
+            hashes_.reserve(part_offsets[num_parts]);
+            for (size_t p = 0; p < num_parts; p++) {
+                bins_.insert(bins_.end(), std::make_move_iterator(part_maps[p].bins_.begin()), std::make_move_iterator(part_maps[p].bins_.end()));
+                hashes_.insert(hashes_.end(), part_maps[p].hashes_.begin(), part_maps[p].hashes_.end());
+                part_maps[p].clear();
+            }
+
+            rebuild_index_(true);
+            return *this;
+        }
+
+        // Bins points given (bin key, point index) pairs sorted by key; equal keys share a bin
+        // Bins are created in key order and each one accumulates its points in the given order
+        template <typename KeyT, class GridCoordinatesFunT, class AccumulatorProxyT>
+        GridBinHashMap& build(const std::vector<std::pair<KeyT,size_t>> &sorted_keys,
+                              const GridCoordinatesFunT &grid_coords,
+                              const AccumulatorProxyT &accum_proxy,
+                              bool parallel = true)
+        {
+            clear();
+
+            const size_t num_points = sorted_keys.size();
+            if (num_points == 0) return *this;
+
+            // Run boundaries via blockwise compaction
+            const size_t num_chunks = (num_points + chunk_size_ - 1)/chunk_size_;
+            std::vector<size_t> chunk_offsets(num_chunks + 1, 0);
+#pragma omp parallel for if (parallel)
+            for (size_t c = 0; c < num_chunks; c++) {
+                const size_t end = std::min(num_points, (c + 1)*chunk_size_);
+                for (size_t i = c*chunk_size_; i < end; i++) {
+                    if (i == 0 || sorted_keys[i].first != sorted_keys[i - 1].first) chunk_offsets[c + 1]++;
+                }
+            }
+            for (size_t c = 0; c < num_chunks; c++) {
+                chunk_offsets[c + 1] += chunk_offsets[c];
+            }
+            std::vector<size_t> run_starts(chunk_offsets[num_chunks] + 1);
+            run_starts.back() = num_points;
+#pragma omp parallel for if (parallel)
+            for (size_t c = 0; c < num_chunks; c++) {
+                size_t pos = chunk_offsets[c];
+                const size_t end = std::min(num_points, (c + 1)*chunk_size_);
+                for (size_t i = c*chunk_size_; i < end; i++) {
+                    if (i == 0 || sorted_keys[i].first != sorted_keys[i - 1].first) run_starts[pos++] = i;
+                }
+            }
+
+            const size_t num_bins = run_starts.size() - 1;
+            bins_.resize(num_bins);
+            hashes_.resize(num_bins);
+#pragma omp parallel for if (parallel) schedule(dynamic, 256)
+            for (size_t b = 0; b < num_bins; b++) {
+                const size_t first = sorted_keys[run_starts[b]].second;
+                bins_[b].first = grid_coords(first);
+                bins_[b].second = accum_proxy.buildAccumulator(first);
+                for (size_t k = run_starts[b] + 1; k < run_starts[b + 1]; k++) {
+                    accum_proxy.addToAccumulator(bins_[b].second, sorted_keys[k].second);
+                }
+                hashes_[b] = hasher_(bins_[b].first);
+            }
+
+            rebuild_index_(parallel);
+            return *this;
+        }
+
+    private:
+        static const size_t empty_slot_ = std::numeric_limits<size_t>::max();
+        static const size_t chunk_size_ = 65536;
+        static const size_t max_partitions_ = 256;
+
+        BinContainer bins_;
+        std::vector<size_t> hashes_;
+        std::vector<size_t> slots_;
+        size_t mask_;
+        HasherT hasher_;
+
+        inline size_t find_index_(const GridPointT &key, size_t hash) const {
+            if (slots_.empty()) return empty_slot_;
+            size_t s = hash & mask_;
+            while (slots_[s] != empty_slot_) {
+                const size_t b = slots_[s];
+                if (hashes_[b] == hash && bins_[b].first == key) return b;
+                s = (s + 1) & mask_;
+            }
+            return empty_slot_;
+        }
+
+        inline void insert_slot_(size_t hash, size_t ind) {
+            size_t s = hash & mask_;
+            while (slots_[s] != empty_slot_) s = (s + 1) & mask_;
+            slots_[s] = ind;
+        }
+
+        // Keep load factor at or below 1/2
+        inline void reserve_slot_() {
+            if (2*(bins_.size() + 1) <= slots_.size()) return;
+            slots_.assign(std::max((size_t)16, 2*slots_.size()), empty_slot_);
+            mask_ = slots_.size() - 1;
+            for (size_t b = 0; b < hashes_.size(); b++) {
+                insert_slot_(hashes_[b], b);
+            }
+        }
+
+        template <class AccumulatorProxyT>
+        inline void accumulate_(GridPointT &&key, size_t hash, const AccumulatorProxyT &accum_proxy, size_t i) {
+            const size_t ind = find_index_(key, hash);
+            if (ind != empty_slot_) {
+                accum_proxy.addToAccumulator(bins_[ind].second, i);
+            } else {
+                reserve_slot_();
+                bins_.emplace_back(std::move(key), accum_proxy.buildAccumulator(i));
+                hashes_.emplace_back(hash);
+                insert_slot_(hash, bins_.size() - 1);
+            }
+        }
+
+        inline void merge_(value_type &&bin, size_t hash) {
+            const size_t ind = find_index_(bin.first, hash);
+            if (ind != empty_slot_) {
+                bins_[ind].second.mergeWith(bin.second);
+            } else {
+                reserve_slot_();
+                bins_.emplace_back(std::move(bin));
+                hashes_.emplace_back(hash);
+                insert_slot_(hash, bins_.size() - 1);
+            }
+        }
+
+        // Keys are unique here, so slots can be claimed concurrently by CAS without comparing keys
+        void rebuild_index_(bool parallel) {
+            size_t capacity = 16;
+            while (capacity < 2*bins_.size()) capacity *= 2;
+            mask_ = capacity - 1;
+            slots_.resize(capacity);
+
+            if (!parallel) {
+                std::fill(slots_.begin(), slots_.end(), empty_slot_);
+                for (size_t b = 0; b < hashes_.size(); b++) {
+                    insert_slot_(hashes_[b], b);
+                }
+                return;
+            }
+
+            std::vector<std::atomic<size_t>> slots_tmp(capacity);
+#pragma omp parallel
+            {
+#pragma omp for
+                for (size_t s = 0; s < capacity; s++) {
+                    slots_tmp[s].store(empty_slot_, std::memory_order_relaxed);
+                }
+#pragma omp for
+                for (size_t b = 0; b < hashes_.size(); b++) {
+                    size_t s = hashes_[b] & mask_;
+                    size_t expected = empty_slot_;
+                    while (!slots_tmp[s].compare_exchange_strong(expected, b, std::memory_order_relaxed)) {
+                        s = (s + 1) & mask_;
+                        expected = empty_slot_;
+                    }
+                }
+#pragma omp for
+                for (size_t s = 0; s < capacity; s++) {
+                    slots_[s] = slots_tmp[s].load(std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+
+    template <typename GridPointT, typename AccumulatorT, class HasherT>
+    const size_t GridBinHashMap<GridPointT,AccumulatorT,HasherT>::empty_slot_;
+
+    template <typename GridPointT, typename AccumulatorT, class HasherT>
+    const size_t GridBinHashMap<GridPointT,AccumulatorT,HasherT>::chunk_size_;
+
+    template <typename GridPointT, typename AccumulatorT, class HasherT>
+    const size_t GridBinHashMap<GridPointT,AccumulatorT,HasherT>::max_partitions_;
+
+    namespace internal {
+        template <typename GridPointT, typename AccumulatorT, GridBinningMethod BinningMethod>
+        struct GridBinMapSelector {};
+
+        template <typename GridPointT, typename AccumulatorT>
+        struct GridBinMapSelector<GridPointT,AccumulatorT,GridBinningMethod::ORDERED_MAP> {
+            typedef typename std::conditional<(GridPointT::RowsAtCompileTime != Eigen::Dynamic && sizeof(GridPointT) % 16 == 0) || (AccumulatorT::EigenAlign > 0),
+                    std::map<GridPointT,AccumulatorT,EigenVectorComparator<typename GridPointT::Scalar,GridPointT::RowsAtCompileTime>,Eigen::aligned_allocator<std::pair<const GridPointT,AccumulatorT>>>,
+                    std::map<GridPointT,AccumulatorT,EigenVectorComparator<typename GridPointT::Scalar,GridPointT::RowsAtCompileTime>>>::type GridBinMap;
+        };
+
+        template <typename GridPointT, typename AccumulatorT>
+        struct GridBinMapSelector<GridPointT,AccumulatorT,GridBinningMethod::HASH_MAP> {
+            typedef GridBinHashMap<GridPointT,AccumulatorT> GridBinMap;
+        };
+
+        template <typename GridPointT, typename AccumulatorT>
+        struct GridBinMapSelector<GridPointT,AccumulatorT,GridBinningMethod::RADIX_SORT> {
+            typedef GridBinHashMap<GridPointT,AccumulatorT> GridBinMap;
+        };
+    }
+
+    template <typename ScalarT, ptrdiff_t EigenDim, class AccumulatorProxy, typename GridPointScalarT = ptrdiff_t, GridBinningMethod BinningMethod = GridBinningMethod::ORDERED_MAP>
     class GridAccumulator {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -62,9 +420,7 @@ namespace cilantro {
 
         typedef Eigen::Matrix<GridPointScalarT,EigenDim,1> GridPoint;
 
-        typedef typename std::conditional<(EigenDim != Eigen::Dynamic && sizeof(GridPoint) % 16 == 0) || (Accumulator::EigenAlign > 0),
-                std::map<GridPoint,Accumulator,EigenVectorComparator<typename GridPoint::Scalar,EigenDim>,Eigen::aligned_allocator<std::pair<const GridPoint,Accumulator>>>,
-                std::map<GridPoint,Accumulator,EigenVectorComparator<typename GridPoint::Scalar,EigenDim>>>::type GridBinMap;
+        typedef typename internal::GridBinMapSelector<GridPoint,Accumulator,BinningMethod>::GridBinMap GridBinMap;
 
         typedef typename GridBinMap::iterator GridBinMapIterator;
 
@@ -107,7 +463,7 @@ namespace cilantro {
         }
 
         inline const GridBinMapConstIterator findContainingGridBin(size_t ind) const {
-            return getPointBinNeighbors(data_map_.col(ind));
+            return findContainingGridBin(data_map_.col(ind));
         }
 
         inline GridPoint getPointGridCoordinates(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &point) const {
@@ -139,7 +495,77 @@ namespace cilantro {
         GridBinMap grid_lookup_table_;
         std::vector<GridBinMapIterator> bin_iterators_;
 
-        inline void build_index_(const AccumulatorProxy &accum_proxy, bool parallel) {
+        inline void build_flat_bin_iterators_(bool parallel) {
+            bin_iterators_.resize(grid_lookup_table_.size());
+#pragma omp parallel for if (parallel)
+            for (size_t i = 0; i < bin_iterators_.size(); i++) {
+                bin_iterators_[i] = grid_lookup_table_.begin() + i;
+            }
+        }
+
+        template <GridBinningMethod BM = BinningMethod>
+        inline typename std::enable_if<BM == GridBinningMethod::HASH_MAP>::type build_index_(const AccumulatorProxy &accum_proxy, bool parallel) {
+            if (data_map_.cols() == 0) return;
+
+            grid_lookup_table_.build(data_map_.cols(), [this](size_t i) { return getPointGridCoordinates(data_map_.col(i)); }, accum_proxy, parallel);
+            build_flat_bin_iterators_(parallel);
+        }
+
+        // Bins are sorted by packed 64-bit keys that preserve lexicographic grid coordinate order,
+        // so bin order and per-bin accumulation order are deterministic for any number of threads
+        template <GridBinningMethod BM = BinningMethod>
+        inline typename std::enable_if<BM == GridBinningMethod::RADIX_SORT>::type build_index_(const AccumulatorProxy &accum_proxy, bool parallel) {
+            if (data_map_.cols() == 0) return;
+
+            auto grid_coords = [this](size_t i) { return getPointGridCoordinates(data_map_.col(i)); };
+
+            const Vector<ScalarT,EigenDim> min_point(data_map_.rowwise().minCoeff());
+            const Vector<ScalarT,EigenDim> max_point(data_map_.rowwise().maxCoeff());
+            const GridPoint min_coords(getPointGridCoordinates(min_point));
+            const GridPoint max_coords(getPointGridCoordinates(max_point));
+
+            const size_t dim = data_map_.rows();
+
+            // First coordinate is the most significant
+            std::vector<size_t> shifts(dim), bits(dim);
+            size_t num_bits = 0;
+            for (size_t d = dim; d-- > 0;) {
+                shifts[d] = num_bits;
+                bits[d] = 0;
+                uint64_t range = (uint64_t)(max_coords[d] - min_coords[d]);
+                while (range > 0) {
+                    bits[d]++;
+                    range >>= 1;
+                }
+                num_bits += bits[d];
+            }
+
+            // Cannot pack (or non-finite data); hash binning is also deterministic, albeit not ordered
+            if (num_bits > 64 || !min_point.allFinite() || !max_point.allFinite()) {
+                grid_lookup_table_.build(data_map_.cols(), grid_coords, accum_proxy, parallel);
+                build_flat_bin_iterators_(parallel);
+                return;
+            }
+
+            std::vector<std::pair<uint64_t,size_t>> keys(data_map_.cols());
+#pragma omp parallel for if (parallel)
+            for (size_t i = 0; i < keys.size(); i++) {
+                const GridPoint coords(grid_coords(i));
+                uint64_t key = 0;
+                for (size_t d = 0; d < dim; d++) {
+                    if (bits[d] > 0) key |= (uint64_t)(coords[d] - min_coords[d]) << shifts[d];
+                }
+                keys[i].first = key;
+                keys[i].second = i;
+            }
+            radixSortKeyValuePairs(keys, num_bits, parallel);
+
+            grid_lookup_table_.build(keys, grid_coords, accum_proxy, parallel);
+            build_flat_bin_iterators_(parallel);
+        }
+
+        template <GridBinningMethod BM = BinningMethod>
+        inline typename std::enable_if<BM == GridBinningMethod::ORDERED_MAP>::type build_index_(const AccumulatorProxy &accum_proxy, bool parallel) {
             if (data_map_.cols() == 0) return;
 
             if (parallel) {
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <atomic>
+#include <cassert>
+#include <cstring>
 #include <cilantro/core/space_transformations.hpp>
 
 namespace cilantro {
@@ -707,32 +710,244 @@ namespace cilantro {
         }
     }
 
-    template <class DepthConverterT>
-    void pointsToDepthImage(const ConstVectorSetMatrixMap<typename DepthConverterT::MetricDepth,3> &points,
-                            const Eigen::Ref<const Eigen::Matrix<typename DepthConverterT::MetricDepth,3,3>> &intrinsics,
-                            const DepthConverterT &depth_converter,
-                            typename DepthConverterT::RawDepth* depth_data,
-                            size_t image_w, size_t image_h)
-    {
-#pragma omp parallel
+    namespace internal {
+        struct AnyDepthFilter {
+            template <typename ScalarT>
+            inline bool operator()(ScalarT) const { return true; }
+        };
+    }
+
+    // Race free parallel z-buffer for point projection.
+    // Every pixel holds a 64-bit key with the (positive, float) depth bits in the upper half and the point index in the
+    // lower half, updated by atomic min: the nearest point wins and depth ties go to the smaller index, so the result
+    // does not depend on thread scheduling. Point indices must be smaller than 2^32 - 1.
+    template <typename ScalarT, typename IndexT = size_t>
+    class ProjectionZBuffer {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        ProjectionZBuffer(size_t image_w = 0, size_t image_h = 0) { resize(image_w, image_h); }
+
+        // Only reallocates if the number of pixels changes; contents are undefined until clear() or projectPoints()
+        inline ProjectionZBuffer& resize(size_t image_w, size_t image_h) {
+            if (image_w*image_h != buffer_.size()) std::vector<std::atomic<uint64_t>>(image_w*image_h).swap(buffer_);
+            image_w_ = image_w;
+            image_h_ = image_h;
+            return *this;
+        }
+
+        inline size_t getImageWidth() const { return image_w_; }
+
+        inline size_t getImageHeight() const { return image_h_; }
+
+        inline ProjectionZBuffer& clear() {
+#pragma omp parallel for
+            for (size_t i = 0; i < buffer_.size(); i++) {
+                buffer_[i].store(empty_key_, std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        inline bool isEmpty(size_t pixel) const {
+            return buffer_[pixel].load(std::memory_order_relaxed) == empty_key_;
+        }
+
+        // std::numeric_limits<IndexT>::max() for empty pixels
+        inline IndexT getIndex(size_t pixel) const {
+            const uint64_t key = buffer_[pixel].load(std::memory_order_relaxed);
+            return (key == empty_key_) ? std::numeric_limits<IndexT>::max() : (IndexT)(key & 0xFFFFFFFF);
+        }
+
+        inline IndexT getIndex(size_t x, size_t y) const { return getIndex(y*image_w_ + x); }
+
+        // Depth of the winning point, rounded to float precision
+        inline float getDepth(size_t pixel) const {
+            const uint32_t bits = (uint32_t)(buffer_[pixel].load(std::memory_order_relaxed) >> 32);
+            float depth;
+            std::memcpy(&depth, &bits, sizeof(float));
+            return depth;
+        }
+
+        // Thread safe; index must be smaller than 2^32 - 1, as it is stored in 32 bits
+        inline void insert(size_t pixel, ScalarT depth, IndexT index) {
+            assert((uint64_t)index < 0xFFFFFFFF);
+            const float depth_f = static_cast<float>(depth);
+            uint32_t bits;
+            std::memcpy(&bits, &depth_f, sizeof(float));
+            const uint64_t key = ((uint64_t)bits << 32) | (uint64_t)(uint32_t)index;
+            std::atomic<uint64_t> &slot = buffer_[pixel];
+            uint64_t current = slot.load(std::memory_order_relaxed);
+            while (key < current && !slot.compare_exchange_weak(current, key, std::memory_order_relaxed));
+        }
+
+        // Points are given in camera coordinates; only points with positive depth that pass depth_filter are projected
+        template <class DepthFilterT = internal::AnyDepthFilter>
+        ProjectionZBuffer& projectPoints(const ConstVectorSetMatrixMap<ScalarT,3> &points,
+                                         const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                         const DepthFilterT &depth_filter = DepthFilterT())
         {
-#pragma omp for
-            for (size_t i = 0; i < image_w*image_h; i++) {
-                depth_data[i] = (typename DepthConverterT::RawDepth)0;
+            clear();
+#pragma omp parallel for schedule(dynamic, 256)
+            for (size_t i = 0; i < points.cols(); i++) {
+                project_point_(points.col(i), (IndexT)i, intrinsics, depth_filter);
             }
+            return *this;
+        }
 
+        // Points are given in world coordinates; extrinsics is the camera pose
+        template <class DepthFilterT = internal::AnyDepthFilter>
+        ProjectionZBuffer& projectPoints(const ConstVectorSetMatrixMap<ScalarT,3> &points,
+                                         const RigidTransform<ScalarT,3> &extrinsics,
+                                         const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                         const DepthFilterT &depth_filter = DepthFilterT())
+        {
+            const RigidTransform<ScalarT,3> to_cam(extrinsics.inverse());
+            clear();
+#pragma omp parallel
+            {
+                Vector<ScalarT,3> pt_cam;
 #pragma omp for schedule(dynamic, 256)
+                for (size_t i = 0; i < points.cols(); i++) {
+                    pt_cam.noalias() = to_cam*points.col(i);
+                    project_point_(pt_cam, (IndexT)i, intrinsics, depth_filter);
+                }
+            }
+            return *this;
+        }
+
+        // Points are given in camera coordinates and cover a disk of the given (world) radius, i.e. of pixel radius
+        // inversely proportional to depth, capped at max_pixel_radius
+        template <class DepthFilterT = internal::AnyDepthFilter>
+        ProjectionZBuffer& splatPoints(const ConstVectorSetMatrixMap<ScalarT,3> &points,
+                                       const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                       ScalarT radius, size_t max_pixel_radius = 8,
+                                       const DepthFilterT &depth_filter = DepthFilterT())
+        {
+            clear();
+#pragma omp parallel for schedule(dynamic, 256)
             for (size_t i = 0; i < points.cols(); i++) {
-                if (points(2,i) <= (typename DepthConverterT::MetricDepth)0.0) continue;
-                size_t x = (size_t)std::llround(points(0,i)*intrinsics(0,0)/points(2,i) + intrinsics(0,2));
-                size_t y = (size_t)std::llround(points(1,i)*intrinsics(1,1)/points(2,i) + intrinsics(1,2));
-                if (x >= image_w || y >= image_h) continue;
-                size_t ind = y*image_w + x;
-                typename DepthConverterT::RawDepth depth_val = depth_converter.getRawValue(points(2,i));
-                if (depth_val > (typename DepthConverterT::RawDepth)0 &&
-                    (depth_data[ind] == (typename DepthConverterT::RawDepth)0 || depth_val < depth_data[ind]))
-                {
-                    depth_data[ind] = depth_val;
+                splat_point_(points.col(i), (IndexT)i, intrinsics, radius, max_pixel_radius, depth_filter);
+            }
+            return *this;
+        }
+
+        // Points are given in world coordinates; extrinsics is the camera pose
+        template <class DepthFilterT = internal::AnyDepthFilter>
+        ProjectionZBuffer& splatPoints(const ConstVectorSetMatrixMap<ScalarT,3> &points,
+                                       const RigidTransform<ScalarT,3> &extrinsics,
+                                       const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                       ScalarT radius, size_t max_pixel_radius = 8,
+                                       const DepthFilterT &depth_filter = DepthFilterT())
+        {
+            const RigidTransform<ScalarT,3> to_cam(extrinsics.inverse());
+            clear();
+#pragma omp parallel
+            {
+                Vector<ScalarT,3> pt_cam;
+#pragma omp for schedule(dynamic, 256)
+                for (size_t i = 0; i < points.cols(); i++) {
+                    pt_cam.noalias() = to_cam*points.col(i);
+                    splat_point_(pt_cam, (IndexT)i, intrinsics, radius, max_pixel_radius, depth_filter);
+                }
+            }
+            return *this;
+        }
+
+        inline const ProjectionZBuffer& getIndexMap(IndexT* index_map_data) const {
+#pragma omp parallel for
+            for (size_t i = 0; i < buffer_.size(); i++) {
+                index_map_data[i] = getIndex(i);
+            }
+            return *this;
+        }
+
+    private:
+        static const uint64_t empty_key_ = std::numeric_limits<uint64_t>::max();
+
+        std::vector<std::atomic<uint64_t>> buffer_;
+        size_t image_w_;
+        size_t image_h_;
+
+        template <class PointT, class DepthFilterT>
+        inline void project_point_(const PointT &pt_cam, IndexT index,
+                                   const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                   const DepthFilterT &depth_filter)
+        {
+            if (pt_cam(2) <= (ScalarT)0.0 || !depth_filter(pt_cam(2))) return;
+            size_t x = (size_t)std::llround(pt_cam(0)*intrinsics(0,0)/pt_cam(2) + intrinsics(0,2));
+            size_t y = (size_t)std::llround(pt_cam(1)*intrinsics(1,1)/pt_cam(2) + intrinsics(1,2));
+            if (x >= image_w_ || y >= image_h_) return;
+            insert(y*image_w_ + x, pt_cam(2), index);
+        }
+
+        template <class PointT, class DepthFilterT>
+        inline void splat_point_(const PointT &pt_cam, IndexT index,
+                                 const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                 ScalarT radius, size_t max_pixel_radius,
+                                 const DepthFilterT &depth_filter)
+        {
+            if (pt_cam(2) <= (ScalarT)0.0 || !depth_filter(pt_cam(2))) return;
+            const ScalarT u = pt_cam(0)*intrinsics(0,0)/pt_cam(2) + intrinsics(0,2);
+            const ScalarT v = pt_cam(1)*intrinsics(1,1)/pt_cam(2) + intrinsics(1,2);
+            const ScalarT ru = std::min<ScalarT>(radius*intrinsics(0,0)/pt_cam(2), (ScalarT)max_pixel_radius);
+            const ScalarT rv = std::min<ScalarT>(radius*intrinsics(1,1)/pt_cam(2), (ScalarT)max_pixel_radius);
+            const long long x_min = std::max<long long>(std::llround(u - ru), 0);
+            const long long x_max = std::min<long long>(std::llround(u + ru), (long long)image_w_ - 1);
+            const long long y_min = std::max<long long>(std::llround(v - rv), 0);
+            const long long y_max = std::min<long long>(std::llround(v + rv), (long long)image_h_ - 1);
+            const long long x_center = std::llround(u);
+            const long long y_center = std::llround(v);
+            const ScalarT ru2 = ru*ru;
+            const ScalarT rv2 = rv*rv;
+            for (long long y = y_min; y <= y_max; y++) {
+                const ScalarT dv = (ScalarT)y - v;
+                for (long long x = x_min; x <= x_max; x++) {
+                    const ScalarT du = (ScalarT)x - u;
+                    // The pixel the point projects to is always covered, even for sub-pixel splats
+                    if (du*du*rv2 + dv*dv*ru2 > ru2*rv2 && (x != x_center || y != y_center)) continue;
+                    insert(y*image_w_ + x, pt_cam(2), index);
+                }
+            }
+        }
+    };
+
+    namespace internal {
+        template <class DepthConverterT>
+        struct ValidRawDepthFilter {
+            ValidRawDepthFilter(const DepthConverterT &converter) : depthConverter(converter) {}
+
+            inline bool operator()(typename DepthConverterT::MetricDepth depth) const {
+                return depthConverter.getRawValue(depth) > (typename DepthConverterT::RawDepth)0;
+            }
+
+            const DepthConverterT& depthConverter;
+        };
+
+        template <class DepthConverterT>
+        void zBufferToRGBDImages(const ProjectionZBuffer<typename DepthConverterT::MetricDepth> &zbuffer,
+                                 const ConstVectorSetMatrixMap<typename DepthConverterT::MetricDepth,3> &points,
+                                 const ConstVectorSetMatrixMap<float,3> &colors,
+                                 const RigidTransform<typename DepthConverterT::MetricDepth,3> &to_cam,
+                                 const DepthConverterT &depth_converter,
+                                 unsigned char* rgb_data,
+                                 typename DepthConverterT::RawDepth* depth_data)
+        {
+            const size_t num_pixels = zbuffer.getImageWidth()*zbuffer.getImageHeight();
+#pragma omp parallel for
+            for (size_t i = 0; i < num_pixels; i++) {
+                const size_t ind = zbuffer.getIndex(i);
+                if (ind == std::numeric_limits<size_t>::max()) {
+                    depth_data[i] = (typename DepthConverterT::RawDepth)0;
+                    if (rgb_data == NULL) continue;
+                    rgb_data[3*i] = (unsigned char)0;
+                    rgb_data[3*i + 1] = (unsigned char)0;
+                    rgb_data[3*i + 2] = (unsigned char)0;
+                } else {
+                    depth_data[i] = depth_converter.getRawValue(to_cam.linear().row(2).dot(points.col(ind)) + to_cam.translation()(2));
+                    if (rgb_data == NULL) continue;
+                    rgb_data[3*i] = static_cast<unsigned char>(255.0f*colors(0,ind));
+                    rgb_data[3*i + 1] = static_cast<unsigned char>(255.0f*colors(1,ind));
+                    rgb_data[3*i + 2] = static_cast<unsigned char>(255.0f*colors(2,ind));
                 }
             }
         }
@@ -740,38 +955,27 @@ namespace cilantro {
 
     template <class DepthConverterT>
     void pointsToDepthImage(const ConstVectorSetMatrixMap<typename DepthConverterT::MetricDepth,3> &points,
-                            const RigidTransform<typename DepthConverterT::MetricDepth,3> &extrinsics,
                             const Eigen::Ref<const Eigen::Matrix<typename DepthConverterT::MetricDepth,3,3>> &intrinsics,
                             const DepthConverterT &depth_converter,
                             typename DepthConverterT::RawDepth* depth_data,
                             size_t image_w, size_t image_h)
     {
-        const RigidTransform<typename DepthConverterT::MetricDepth,3> to_cam(extrinsics.inverse());
-
-#pragma omp parallel
-        {
-#pragma omp for
-            for (size_t i = 0; i < image_w*image_h; i++) {
-                depth_data[i] = (typename DepthConverterT::RawDepth)0;
-            }
+        ProjectionZBuffer<typename DepthConverterT::MetricDepth> zbuffer(image_w, image_h);
+        zbuffer.projectPoints(points, intrinsics, internal::ValidRawDepthFilter<DepthConverterT>(depth_converter));
+        internal::zBufferToRGBDImages<DepthConverterT>(zbuffer, points, ConstVectorSetMatrixMap<float,3>(NULL, 3, 0), RigidTransform<typename DepthConverterT::MetricDepth,3>::Identity(), depth_converter, NULL, depth_data);
+    }
 
-            Vector<typename DepthConverterT::MetricDepth,3> pt_cam;
-#pragma omp for schedule(dynamic, 256)
-            for (size_t i = 0; i < points.cols(); i++) {
-                pt_cam.noalias() = to_cam*points.col(i);
-                if (pt_cam(2) <= (typename DepthConverterT::MetricDepth)0.0) continue;
-                size_t x = (size_t)std::llround(pt_cam(0)*intrinsics(0,0)/pt_cam(2) + intrinsics(0,2));
-                size_t y = (size_t)std::llround(pt_cam(1)*intrinsics(1,1)/pt_cam(2) + intrinsics(1,2));
-                if (x >= image_w || y >= image_h) continue;
-                size_t ind = y*image_w + x;
-                typename DepthConverterT::RawDepth depth_val = depth_converter.getRawValue(pt_cam(2));
-                if (depth_val > (typename DepthConverterT::RawDepth)0 &&
-                    (depth_data[ind] == (typename DepthConverterT::RawDepth)0 || depth_val < depth_data[ind]))
-                {
-                    depth_data[ind] = depth_val;
-                }
-            }
-        }
+    template <class DepthConverterT>
+    void pointsToDepthImage(const ConstVectorSetMatrixMap<typename DepthConverterT::MetricDepth,3> &points,
+                            const RigidTransform<typename DepthConverterT::MetricDepth,3> &extrinsics,
+                            const Eigen::Ref<const Eigen::Matrix<typename DepthConverterT::MetricDepth,3,3>> &intrinsics,
+                            const DepthConverterT &depth_converter,
+                            typename DepthConverterT::RawDepth* depth_data,
+                            size_t image_w, size_t image_h)
+    {
+        ProjectionZBuffer<typename DepthConverterT::MetricDepth> zbuffer(image_w, image_h);
+        zbuffer.projectPoints(points, extrinsics, intrinsics, internal::ValidRawDepthFilter<DepthConverterT>(depth_converter));
+        internal::zBufferToRGBDImages<DepthConverterT>(zbuffer, points, ConstVectorSetMatrixMap<float,3>(NULL, 3, 0), extrinsics.inverse(), depth_converter, NULL, depth_data);
     }
 
     template <class DepthConverterT>
@@ -783,34 +987,9 @@ namespace cilantro {
                                   typename DepthConverterT::RawDepth* depth_data,
                                   size_t image_w, size_t image_h)
     {
-#pragma omp parallel
-        {
-#pragma omp for
-            for (size_t i = 0; i < image_w*image_h; i++) {
-                rgb_data[3*i] = (unsigned char)0;
-                rgb_data[3*i + 1] = (unsigned char)0;
-                rgb_data[3*i + 2] = (unsigned char)0;
-                depth_data[i] = (typename DepthConverterT::RawDepth)0;
-            }
-
-#pragma omp for schedule(dynamic, 256)
-            for (size_t i = 0; i < points.cols(); i++) {
-                if (points(2,i) <= (typename DepthConverterT::MetricDepth)0.0) continue;
-                size_t x = (size_t)std::llround(points(0,i)*intrinsics(0,0)/points(2,i) + intrinsics(0,2));
-                size_t y = (size_t)std::llround(points(1,i)*intrinsics(1,1)/points(2,i) + intrinsics(1,2));
-                if (x >= image_w || y >= image_h) continue;
-                size_t ind = y*image_w + x;
-                typename DepthConverterT::RawDepth depth_val = depth_converter.getRawValue(points(2,i));
-                if (depth_val > (typename DepthConverterT::RawDepth)0 &&
-                    (depth_data[ind] == (typename DepthConverterT::RawDepth)0 || depth_val < depth_data[ind]))
-                {
-                    rgb_data[3*ind] = static_cast<unsigned char>(255.0f*colors(0,i));
-                    rgb_data[3*ind + 1] = static_cast<unsigned char>(255.0f*colors(1,i));
-                    rgb_data[3*ind + 2] = static_cast<unsigned char>(255.0f*colors(2,i));
-                    depth_data[ind] = depth_val;
-                }
-            }
-        }
+        ProjectionZBuffer<typename DepthConverterT::MetricDepth> zbuffer(image_w, image_h);
+        zbuffer.projectPoints(points, intrinsics, internal::ValidRawDepthFilter<DepthConverterT>(depth_converter));
+        internal::zBufferToRGBDImages<DepthConverterT>(zbuffer, points, colors, RigidTransform<typename DepthConverterT::MetricDepth,3>::Identity(), depth_converter, rgb_data, depth_data);
     }
 
     template <class DepthConverterT>
@@ -823,38 +1002,9 @@ namespace cilantro {
                                   typename DepthConverterT::RawDepth* depth_data,
                                   size_t image_w, size_t image_h)
     {
-        const RigidTransform<typename DepthConverterT::MetricDepth,3> to_cam(extrinsics.inverse());
-
-#pragma omp parallel
-        {
-#pragma omp for
-            for (size_t i = 0; i < image_w*image_h; i++) {
-                rgb_data[3*i] = (unsigned char)0;
-                rgb_data[3*i + 1] = (unsigned char)0;
-                rgb_data[3*i + 2] = (unsigned char)0;
-                depth_data[i] = (typename DepthConverterT::RawDepth)0;
-            }
-
-            Vector<typename DepthConverterT::MetricDepth,3> pt_cam;
-#pragma omp for schedule(dynamic, 256)
-            for (size_t i = 0; i < points.cols(); i++) {
-                pt_cam.noalias() = to_cam*points.col(i);
-                if (pt_cam(2) <= (typename DepthConverterT::MetricDepth)0.0) continue;
-                size_t x = (size_t)std::llround(pt_cam(0)*intrinsics(0,0)/pt_cam(2) + intrinsics(0,2));
-                size_t y = (size_t)std::llround(pt_cam(1)*intrinsics(1,1)/pt_cam(2) + intrinsics(1,2));
-                if (x >= image_w || y >= image_h) continue;
-                size_t ind = y*image_w + x;
-                typename DepthConverterT::RawDepth depth_val = depth_converter.getRawValue(pt_cam(2));
-                if (depth_val > (typename DepthConverterT::RawDepth)0 &&
-                    (depth_data[ind] == (typename DepthConverterT::RawDepth)0 || depth_val < depth_data[ind]))
-                {
-                    rgb_data[3*ind] = static_cast<unsigned char>(255.0f*colors(0,i));
-                    rgb_data[3*ind + 1] = static_cast<unsigned char>(255.0f*colors(1,i));
-                    rgb_data[3*ind + 2] = static_cast<unsigned char>(255.0f*colors(2,i));
-                    depth_data[ind] = depth_val;
-                }
-            }
-        }
+        ProjectionZBuffer<typename DepthConverterT::MetricDepth> zbuffer(image_w, image_h);
+        zbuffer.projectPoints(points, extrinsics, intrinsics, internal::ValidRawDepthFilter<DepthConverterT>(depth_converter));
+        internal::zBufferToRGBDImages<DepthConverterT>(zbuffer, points, colors, extrinsics.inverse(), depth_converter, rgb_data, depth_data);
     }
 
     template <typename PointT, typename IndexT = size_t>
@@ -863,27 +1013,7 @@ namespace cilantro {
                           IndexT* index_map_data,
                           size_t image_w, size_t image_h)
     {
-        const IndexT empty = std::numeric_limits<IndexT>::max();
-
-#pragma omp parallel
-        {
-#pragma omp for
-            for (size_t i = 0; i < image_w*image_h; i++) {
-                index_map_data[i] = empty;
-            }
-
-#pragma omp for schedule(dynamic, 256)
-            for (IndexT i = 0; i < points.cols(); i++) {
-                if (points(2,i) <= (PointT)0.0) continue;
-                size_t x = (size_t)std::llround(points(0,i)*intrinsics(0,0)/points(2,i) + intrinsics(0,2));
-                size_t y = (size_t)std::llround(points(1,i)*intrinsics(1,1)/points(2,i) + intrinsics(1,2));
-                if (x >= image_w || y >= image_h) continue;
-                size_t ind = y*image_w + x;
-                if (index_map_data[ind] == empty || points(2,i) < points(2,index_map_data[ind])) {
-                    index_map_data[ind] = i;
-                }
-            }
-        }
+        ProjectionZBuffer<PointT,IndexT>(image_w, image_h).projectPoints(points, intrinsics).getIndexMap(index_map_data);
     }
 
     template <typename PointT, typename IndexT = size_t>
@@ -893,33 +1023,6 @@ namespace cilantro {
                           IndexT* index_map_data,
                           size_t image_w, size_t image_h)
     {
-        const RigidTransform<PointT,3> to_cam(extrinsics.inverse());
-        const IndexT empty = std::numeric_limits<IndexT>::max();
-
-        VectorSet<PointT,3> points_cam(3, points.cols());
-#pragma omp parallel
-        {
-#pragma omp for
-            for (size_t i = 0; i < image_w*image_h; i++) {
-                index_map_data[i] = empty;
-            }
-
-#pragma omp for
-            for (size_t i = 0; i < points.cols(); i++) {
-                points_cam.col(i).noalias() = to_cam*points.col(i);
-            }
-
-#pragma omp for schedule(dynamic, 256)
-            for (IndexT i = 0; i < points.cols(); i++) {
-                if (points_cam(2,i) <= (PointT)0.0) continue;
-                size_t x = (size_t)std::llround(points_cam(0,i)*intrinsics(0,0)/points_cam(2,i) + intrinsics(0,2));
-                size_t y = (size_t)std::llround(points_cam(1,i)*intrinsics(1,1)/points_cam(2,i) + intrinsics(1,2));
-                if (x >= image_w || y >= image_h) continue;
-                size_t ind = y*image_w + x;
-                if (index_map_data[ind] == empty || points_cam(2,i) < points_cam(2,index_map_data[ind])) {
-                    index_map_data[ind] = i;
-                }
-            }
-        }
+        ProjectionZBuffer<PointT,IndexT>(image_w, image_h).projectPoints(points, extrinsics, intrinsics).getIndexMap(index_map_data);
     }
 }
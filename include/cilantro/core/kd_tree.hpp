@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <cilantro/3rd_party/nanoflann/nanoflann.hpp>
 #include <cilantro/core/data_containers.hpp>
 #include <cilantro/core/nearest_neighbors.hpp>
@@ -55,9 +56,17 @@ namespace cilantro {
     class KNNSearchResultAdaptor {
     public:
         KNNSearchResultAdaptor(Neighborhood<ScalarT,IndexT> &results, CountT k, ScalarT max_radius = std::numeric_limits<ScalarT>::max())
+                : k_(k), count_(0)
+        {
+            results.resize(k_);
+            results_ = results.data();
+            results_[k_-1].value = max_radius;
+        }
+
+        // Writes into a preallocated buffer of (at least) k neighbors
+        KNNSearchResultAdaptor(Neighbor<ScalarT,IndexT> * results, CountT k, ScalarT max_radius = std::numeric_limits<ScalarT>::max())
                 : results_(results), k_(k), count_(0)
         {
-            results_.resize(k_);
             results_[k_-1].value = max_radius;
         }
 
@@ -89,7 +98,7 @@ namespace cilantro {
         inline ScalarT worstDist() const { return results_[k_-1].value; }
 
     private:
-        Neighborhood<ScalarT,IndexT>& results_;
+        Neighbor<ScalarT,IndexT> * results_;
         const CountT k_;
         CountT count_;
     };
@@ -98,13 +107,14 @@ namespace cilantro {
     template <typename ScalarT, typename IndexT = size_t, typename CountT = size_t>
     class RadiusSearchResultAdaptor {
     public:
-        RadiusSearchResultAdaptor(Neighborhood<ScalarT,IndexT> &results, ScalarT radius)
-                : results_(results), radius_(radius)
+        // If append is true, results are added after the existing contents of the buffer
+        RadiusSearchResultAdaptor(Neighborhood<ScalarT,IndexT> &results, ScalarT radius, bool append = false)
+                : results_(results), radius_(radius), offset_(append ? results.size() : 0)
         {
-            results_.clear();
+            if (!append) results_.clear();
         }
 
-        inline CountT size() const { return results_.size(); }
+        inline CountT size() const { return results_.size() - offset_; }
 
         inline bool full() const { return true; }
 
@@ -119,13 +129,39 @@ namespace cilantro {
     private:
         Neighborhood<ScalarT,IndexT>& results_;
         const ScalarT radius_;
+        const size_t offset_;
     };
 
-    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor = KDTreeDistanceAdaptors::L2, typename IndexT = size_t>
-    class KDTree {
+    // Forwards every neighbor within radius to visitor(index, dist), without storing the neighborhood
+    template <typename ScalarT, typename IndexT, class VisitorT>
+    class RadiusSearchVisitorAdaptor {
     public:
-        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+        RadiusSearchVisitorAdaptor(VisitorT &visitor, ScalarT radius)
+                : visitor_(visitor), radius_(radius), count_(0)
+        {}
+
+        inline size_t size() const { return count_; }
 
+        inline bool full() const { return true; }
+
+        inline bool addPoint(ScalarT dist, IndexT index) {
+            visitor_(index, dist);
+            count_++;
+            return true;
+        }
+
+        inline ScalarT worstDist() const { return radius_; }
+
+    private:
+        VisitorT& visitor_;
+        const ScalarT radius_;
+        size_t count_;
+    };
+
+    // Search API shared by all KD-tree types; DerivedT provides findNeighbors(result_set, query_pt_data)
+    template <class DerivedT, typename ScalarT, ptrdiff_t EigenDim, typename IndexT>
+    class KDTreeSearchBase {
+    public:
         typedef ScalarT Scalar;
         typedef IndexT Index;
 
@@ -133,54 +169,48 @@ namespace cilantro {
         typedef Neighborhood<ScalarT,IndexT> NeighborhoodResult;
         typedef NeighborSet<ScalarT,IndexT> NeighborSetResult;
         typedef NeighborhoodSet<ScalarT,IndexT> NeighborhoodSetResult;
+        typedef FlatNeighborhoodSet<ScalarT,IndexT> FlatNeighborhoodSetResult;
 
         enum { Dimension = EigenDim };
 
-        typedef nanoflann::KDTreeSingleIndexAdaptor<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>>,KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>,EigenDim,IndexT> InternalTree;
-
-        KDTree(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &data, size_t max_leaf_size = 10)
-                : data_map_(data),
-                  data_adaptor_(data_map_),
-                  kd_tree_(data.rows(), data_adaptor_, nanoflann::KDTreeSingleIndexAdaptorParams(max_leaf_size))
-        {
-            params_.sorted = true;
-            kd_tree_.buildIndex();
-        }
-
-        ~KDTree() {}
-
-        inline const ConstVectorSetMatrixMap<ScalarT,EigenDim>& getPointsMatrixMap() const { return data_map_; }
-
-        inline bool isEmpty() const { return data_map_.cols() == 0; }
-
-        inline const InternalTree& nanoflannTree() const { return kd_tree_; }
-
         // Do not call if tree is empty!
-        inline const KDTree& nearestNeighborSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                                   NeighborResult &result) const
+        inline const DerivedT& nearestNeighborSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                                     NeighborResult &result) const
         {
-            kd_tree_.knnSearch(query_pt.data(), 1, &result.index, &result.value);
-            return *this;
+            KNNSearchResultAdaptor<ScalarT,IndexT,size_t> sra(&result, 1);
+            derived_().findNeighbors(sra, query_pt.data());
+            return derived_();
         }
 
         // Do not call if tree is empty!
         inline NeighborResult nearestNeighborSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt) const
         {
             NeighborResult result;
-            kd_tree_.knnSearch(query_pt.data(), 1, &result.index, &result.value);
+            KNNSearchResultAdaptor<ScalarT,IndexT,size_t> sra(&result, 1);
+            derived_().findNeighbors(sra, query_pt.data());
             return result;
         }
 
+        // Allocation free; returns false (and leaves result unspecified) if no point lies within radius
+        inline bool nearestNeighborInRadiusSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                                  ScalarT radius,
+                                                  NeighborResult &result) const
+        {
+            KNNSearchResultAdaptor<ScalarT,IndexT,size_t> sra(&result, 1, radius);
+            derived_().findNeighbors(sra, query_pt.data());
+            return sra.size() > 0;
+        }
+
         // Do not call if tree is empty!
-        const KDTree& nearestNeighborSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                            NeighborhoodResult &results) const
+        const DerivedT& nearestNeighborSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                              NeighborhoodResult &results) const
         {
             results.resize(query_pts.cols());
 #pragma omp parallel for shared (results)
             for (size_t i = 0; i < query_pts.cols(); i++) {
                 nearestNeighborSearch(query_pts.col(i), results[i]);
             }
-            return *this;
+            return derived_();
         }
 
         // Do not call if tree is empty!
@@ -192,14 +222,14 @@ namespace cilantro {
         }
 
         template <typename CountT = size_t>
-        inline const KDTree& kNNSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                       CountT k,
-                                       NeighborhoodResult &results) const
+        inline const DerivedT& kNNSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                         CountT k,
+                                         NeighborhoodResult &results) const
         {
             KNNSearchResultAdaptor<ScalarT,IndexT,CountT> sra(results, k);
-            kd_tree_.findNeighbors(sra, query_pt.data(), params_);
+            derived_().findNeighbors(sra, query_pt.data());
             results.resize(sra.size());
-            return *this;
+            return derived_();
         }
 
         template <typename CountT = size_t>
@@ -212,16 +242,16 @@ namespace cilantro {
         }
 
         template <typename CountT = size_t>
-        const KDTree& kNNSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                CountT k,
-                                NeighborhoodSetResult &results) const
+        const DerivedT& kNNSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                  CountT k,
+                                  NeighborhoodSetResult &results) const
         {
             results.resize(query_pts.cols());
 #pragma omp parallel for shared (results)
             for (size_t i = 0; i < query_pts.cols(); i++) {
                 kNNSearch(query_pts.col(i), k, results[i]);
             }
-            return *this;
+            return derived_();
         }
 
         template <typename CountT = size_t>
@@ -233,14 +263,24 @@ namespace cilantro {
             return results;
         }
 
-        inline const KDTree& radiusSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                          ScalarT radius,
-                                          NeighborhoodResult &results) const
+        // Flat (CSR) batch result, no per-query allocations
+        template <typename CountT = size_t>
+        inline const DerivedT& kNNSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                         CountT k,
+                                         FlatNeighborhoodSetResult &results) const
+        {
+            knn_search_flat_(query_pts, k, std::numeric_limits<ScalarT>::max(), results);
+            return derived_();
+        }
+
+        inline const DerivedT& radiusSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                            ScalarT radius,
+                                            NeighborhoodResult &results) const
         {
             RadiusSearchResultAdaptor<ScalarT,IndexT,size_t> sra(results, radius);
-            kd_tree_.findNeighbors(sra, query_pt.data(), params_);
+            derived_().findNeighbors(sra, query_pt.data());
             std::sort(results.begin(), results.end(), typename NeighborResult::ValueLessComparator());
-            return *this;
+            return derived_();
         }
 
         inline NeighborhoodResult radiusSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
@@ -251,16 +291,16 @@ namespace cilantro {
             return results;
         }
 
-        const KDTree& radiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                   ScalarT radius,
-                                   NeighborhoodSetResult &results) const
+        const DerivedT& radiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                     ScalarT radius,
+                                     NeighborhoodSetResult &results) const
         {
             results.resize(query_pts.cols());
 #pragma omp parallel for shared (results)
             for (size_t i = 0; i < query_pts.cols(); i++) {
                 radiusSearch(query_pts.col(i), radius, results[i]);
             }
-            return *this;
+            return derived_();
         }
 
         inline NeighborhoodSetResult radiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
@@ -271,16 +311,66 @@ namespace cilantro {
             return results;
         }
 
+        // Fused radius search: calls visitor(index, dist) for every neighbor (in tree order), e.g. to accumulate
+        // neighborhood statistics while the points are still in cache
+        template <class VisitorT>
+        inline const DerivedT& radiusSearchVisit(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                                 ScalarT radius,
+                                                 VisitorT &visitor) const
+        {
+            RadiusSearchVisitorAdaptor<ScalarT,IndexT,VisitorT> sva(visitor, radius);
+            derived_().findNeighbors(sva, query_pt.data());
+            return derived_();
+        }
+
+        // Flat (CSR) batch result, no per-query allocations
+        const DerivedT& radiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                     ScalarT radius,
+                                     FlatNeighborhoodSetResult &results) const
+        {
+            const size_t num_queries = query_pts.cols();
+            const size_t block_size = 256;
+            const size_t num_blocks = (num_queries + block_size - 1)/block_size;
+
+            // Each block of queries appends to its own buffer; offsets temporarily hold counts
+            std::vector<NeighborhoodResult> block_results(num_blocks);
+            results.offsets.resize(num_queries + 1);
+            results.offsets[0] = 0;
+#pragma omp parallel for shared (block_results, results) schedule(dynamic)
+            for (size_t b = 0; b < num_blocks; b++) {
+                NeighborhoodResult &buffer = block_results[b];
+                const size_t end = std::min(num_queries, (b + 1)*block_size);
+                for (size_t i = b*block_size; i < end; i++) {
+                    const size_t start = buffer.size();
+                    RadiusSearchResultAdaptor<ScalarT,IndexT,size_t> sra(buffer, radius, true);
+                    derived_().findNeighbors(sra, query_pts.col(i).data());
+                    std::sort(buffer.begin() + start, buffer.end(), typename NeighborResult::ValueLessComparator());
+                    results.offsets[i + 1] = buffer.size() - start;
+                }
+            }
+
+            for (size_t i = 0; i < num_queries; i++) {
+                results.offsets[i + 1] += results.offsets[i];
+            }
+            results.neighbors.resize(results.offsets[num_queries]);
+#pragma omp parallel for shared (block_results, results)
+            for (size_t b = 0; b < num_blocks; b++) {
+                std::copy(block_results[b].begin(), block_results[b].end(), results.neighbors.begin() + results.offsets[b*block_size]);
+                NeighborhoodResult().swap(block_results[b]);
+            }
+            return derived_();
+        }
+
         template <typename CountT = size_t>
-        inline const KDTree& kNNInRadiusSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                               CountT k,
-                                               ScalarT radius,
-                                               NeighborhoodResult &results) const
+        inline const DerivedT& kNNInRadiusSearch(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                                 CountT k,
+                                                 ScalarT radius,
+                                                 NeighborhoodResult &results) const
         {
             KNNSearchResultAdaptor<ScalarT,IndexT,CountT> sra(results, k, radius);
-            kd_tree_.findNeighbors(sra, query_pt.data(), params_);
+            derived_().findNeighbors(sra, query_pt.data());
             results.resize(sra.size());
-            return *this;
+            return derived_();
         }
 
         template <typename CountT = size_t>
@@ -294,17 +384,17 @@ namespace cilantro {
         }
 
         template <typename CountT = size_t>
-        const KDTree& kNNInRadiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                        CountT k,
-                                        ScalarT radius,
-                                        NeighborhoodSetResult &results) const
+        const DerivedT& kNNInRadiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                          CountT k,
+                                          ScalarT radius,
+                                          NeighborhoodSetResult &results) const
         {
             results.resize(query_pts.cols());
 #pragma omp parallel for shared (results)
             for (size_t i = 0; i < query_pts.cols(); i++) {
                 kNNInRadiusSearch(query_pts.col(i), k, radius, results[i]);
             }
-            return *this;
+            return derived_();
         }
 
         template <typename CountT = size_t>
@@ -317,56 +407,93 @@ namespace cilantro {
             return results;
         }
 
+        // Flat (CSR) batch result, no per-query allocations
         template <typename CountT = size_t>
-        inline const KDTree& search(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                    const KNNNeighborhoodSpecification<CountT> &nh,
-                                    NeighborhoodResult &results) const
+        inline const DerivedT& kNNInRadiusSearch(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                                 CountT k,
+                                                 ScalarT radius,
+                                                 FlatNeighborhoodSetResult &results) const
+        {
+            knn_search_flat_(query_pts, k, radius, results);
+            return derived_();
+        }
+
+        template <typename CountT = size_t>
+        inline const DerivedT& search(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                      const KNNNeighborhoodSpecification<CountT> &nh,
+                                      NeighborhoodResult &results) const
         {
             kNNSearch(query_pt, nh.maxNumberOfNeighbors, results);
-            return *this;
+            return derived_();
         }
 
         template <typename CountT = size_t>
-        inline const KDTree& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                    const KNNNeighborhoodSpecification<CountT> &nh,
-                                    NeighborhoodSetResult &results) const
+        inline const DerivedT& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                      const KNNNeighborhoodSpecification<CountT> &nh,
+                                      NeighborhoodSetResult &results) const
         {
             kNNSearch(query_pts, nh.maxNumberOfNeighbors, results);
-            return *this;
+            return derived_();
         }
 
-        inline const KDTree& search(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                    const RadiusNeighborhoodSpecification<ScalarT> &nh,
-                                    NeighborhoodResult &results) const
+        inline const DerivedT& search(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                      const RadiusNeighborhoodSpecification<ScalarT> &nh,
+                                      NeighborhoodResult &results) const
         {
             radiusSearch(query_pt, nh.radius, results);
-            return *this;
+            return derived_();
         }
 
-        inline const KDTree& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                    const RadiusNeighborhoodSpecification<ScalarT> &nh,
-                                    NeighborhoodSetResult &results) const
+        inline const DerivedT& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                      const RadiusNeighborhoodSpecification<ScalarT> &nh,
+                                      NeighborhoodSetResult &results) const
         {
             radiusSearch(query_pts, nh.radius, results);
-            return *this;
+            return derived_();
         }
 
         template <typename CountT = size_t>
-        inline const KDTree& search(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
-                                    const KNNInRadiusNeighborhoodSpecification<ScalarT,CountT> &nh,
-                                    NeighborhoodResult &results) const
+        inline const DerivedT& search(const Eigen::Ref<const Vector<ScalarT,EigenDim>> &query_pt,
+                                      const KNNInRadiusNeighborhoodSpecification<ScalarT,CountT> &nh,
+                                      NeighborhoodResult &results) const
         {
             kNNInRadiusSearch(query_pt, nh.maxNumberOfNeighbors, nh.radius, results);
-            return *this;
+            return derived_();
+        }
+
+        template <typename CountT = size_t>
+        inline const DerivedT& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                      const KNNInRadiusNeighborhoodSpecification<ScalarT,CountT> &nh,
+                                      NeighborhoodSetResult &results) const
+        {
+            kNNInRadiusSearch(query_pts, nh.maxNumberOfNeighbors, nh.radius, results);
+            return derived_();
+        }
+
+        template <typename CountT = size_t>
+        inline const DerivedT& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                      const KNNNeighborhoodSpecification<CountT> &nh,
+                                      FlatNeighborhoodSetResult &results) const
+        {
+            kNNSearch(query_pts, nh.maxNumberOfNeighbors, results);
+            return derived_();
+        }
+
+        inline const DerivedT& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                      const RadiusNeighborhoodSpecification<ScalarT> &nh,
+                                      FlatNeighborhoodSetResult &results) const
+        {
+            radiusSearch(query_pts, nh.radius, results);
+            return derived_();
         }
 
         template <typename CountT = size_t>
-        inline const KDTree& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
-                                    const KNNInRadiusNeighborhoodSpecification<ScalarT,CountT> &nh,
-                                    NeighborhoodSetResult &results) const
+        inline const DerivedT& search(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                                      const KNNInRadiusNeighborhoodSpecification<ScalarT,CountT> &nh,
+                                      FlatNeighborhoodSetResult &results) const
         {
             kNNInRadiusSearch(query_pts, nh.maxNumberOfNeighbors, nh.radius, results);
-            return *this;
+            return derived_();
         }
 
         template <typename PointT, typename NeighborhoodSpecT>
@@ -389,11 +516,378 @@ namespace cilantro {
             return res;
         }
 
+    protected:
+        inline const DerivedT& derived_() const { return *static_cast<const DerivedT*>(this); }
+
+        // Searches write directly at a fixed stride of k; the buffer is compacted only if some neighborhoods are short
+        template <typename CountT>
+        void knn_search_flat_(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &query_pts,
+                              CountT k,
+                              ScalarT max_radius,
+                              FlatNeighborhoodSetResult &results) const
+        {
+            const size_t num_queries = query_pts.cols();
+            const size_t stride = k;
+            results.offsets.resize(num_queries + 1);
+            results.offsets[0] = 0;
+            if (stride == 0) {
+                results.neighbors.clear();
+                std::fill(results.offsets.begin(), results.offsets.end(), 0);
+                return;
+            }
+
+            results.neighbors.resize(num_queries*stride);
+#pragma omp parallel for shared (results)
+            for (size_t i = 0; i < num_queries; i++) {
+                KNNSearchResultAdaptor<ScalarT,IndexT,CountT> sra(results.neighbors.data() + i*stride, k, max_radius);
+                derived_().findNeighbors(sra, query_pts.col(i).data());
+                results.offsets[i + 1] = sra.size();
+            }
+
+            size_t sum = 0;
+            for (size_t i = 0; i < num_queries; i++) {
+                const size_t count = results.offsets[i + 1];
+                if (sum != i*stride) {
+                    std::copy(results.neighbors.begin() + i*stride, results.neighbors.begin() + i*stride + count, results.neighbors.begin() + sum);
+                }
+                sum += count;
+                results.offsets[i + 1] = sum;
+            }
+            results.neighbors.resize(sum);
+        }
+    };
+
+    template <typename ScalarT, ptrdiff_t EigenDim, template <class> class DistAdaptor = KDTreeDistanceAdaptors::L2, typename IndexT = size_t>
+    class KDTree : public KDTreeSearchBase<KDTree<ScalarT,EigenDim,DistAdaptor,IndexT>,ScalarT,EigenDim,IndexT> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef nanoflann::KDTreeSingleIndexAdaptor<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>>,KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>,EigenDim,IndexT> InternalTree;
+
+        // If parallel is true, large trees are built by multiple threads: split planes match the sequential build, but
+        // the contents and order of leaves may differ
+        KDTree(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &data, size_t max_leaf_size = 10, bool parallel = true)
+                : data_map_(data),
+                  data_adaptor_(data_map_),
+                  kd_tree_(data.rows(), data_adaptor_, nanoflann::KDTreeSingleIndexAdaptorParams(max_leaf_size))
+        {
+            params_.sorted = true;
+            if (parallel && data.cols() >= ParallelBuildMinSize) {
+                build_index_parallel_();
+            } else {
+                kd_tree_.buildIndex();
+            }
+        }
+
+        ~KDTree() {}
+
+        inline const ConstVectorSetMatrixMap<ScalarT,EigenDim>& getPointsMatrixMap() const { return data_map_; }
+
+        inline bool isEmpty() const { return data_map_.cols() == 0; }
+
+        inline const InternalTree& nanoflannTree() const { return kd_tree_; }
+
+        // Raw search with a nanoflann-compatible result set
+        template <class ResultSetT>
+        inline void findNeighbors(ResultSetT &result_set, const ScalarT * query_pt) const {
+            kd_tree_.findNeighbors(result_set, query_pt, params_);
+        }
+
     private:
+        typedef typename InternalTree::Node Node;
+        typedef typename InternalTree::BoundingBox BoundingBox;
+        typedef typename InternalTree::DistanceType DistanceType;
+
+        enum { ParallelBuildMinSize = 65536 };
+
+        // Node of the top levels of a parallel build; leaves of the top levels are the roots of the concurrently
+        // built subtrees. Point indices of the node are in vind or (in_buffer) in the partition buffer.
+        struct TopNode {
+            Node * node;
+            size_t left, right;
+            BoundingBox bbox;
+            ptrdiff_t child1, child2;
+            bool in_buffer;
+        };
+
         ConstVectorSetMatrixMap<ScalarT,EigenDim> data_map_;
         const KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim> data_adaptor_;
         InternalTree kd_tree_;
         nanoflann::SearchParams params_;
+        std::vector<std::unique_ptr<nanoflann::PooledAllocator>> subtree_pools_;
+
+        // Parallel nanoflann::KDTreeSingleIndexAdaptor::buildIndex(): the top levels are split one node at a time, with
+        // parallel min/max and partition passes, down to subtrees of about 1/256 of the points (size dependent only),
+        // which are then built concurrently, each from its own node pool. Split planes are the same as in the
+        // sequential build; only the order of the points within a leaf may differ.
+        void build_index_parallel_() {
+            InternalTree &tree = kd_tree_;
+            const size_t num_points = data_map_.cols();
+            const size_t dim = data_map_.rows();
+            tree.freeIndex(tree);
+            tree.m_size = num_points;
+            tree.m_size_at_index_build = num_points;
+            tree.vind.resize(num_points);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_points; i++) {
+                tree.vind[i] = i;
+            }
+
+            std::vector<TopNode> top(1);
+            top[0].node = tree.pool.template allocate<Node>();
+            top[0].left = 0;
+            top[0].right = num_points;
+            top[0].child1 = top[0].child2 = -1;
+            top[0].in_buffer = false;
+            std::vector<size_t> all_dims(dim);
+            for (size_t d = 0; d < dim; d++) all_dims[d] = d;
+            compute_min_max_(tree.vind.data(), num_points, all_dims, top[0].bbox);
+
+            const size_t subtree_size = std::max<size_t>(num_points/256, std::max<size_t>(tree.m_leaf_max_size, 4096));
+            std::vector<size_t> subtrees;
+            std::vector<IndexT> buffer(num_points);
+            std::vector<ScalarT> values(num_points);
+            for (size_t t = 0; t < top.size(); t++) {
+                if (top[t].right - top[t].left <= subtree_size) {
+                    subtrees.emplace_back(t);
+                    continue;
+                }
+
+                IndexT * src = (top[t].in_buffer ? buffer.data() : tree.vind.data()) + top[t].left;
+                IndexT * dst = (top[t].in_buffer ? tree.vind.data() : buffer.data()) + top[t].left;
+                int cutfeat;
+                DistanceType cutval;
+                const size_t mid = top[t].left + split_parallel_(src, dst, top[t].right - top[t].left, top[t].bbox, cutfeat, cutval, values);
+                top[t].node->node_type.sub.divfeat = cutfeat;
+
+                TopNode child;
+                child.child1 = child.child2 = -1;
+                child.in_buffer = !top[t].in_buffer;
+                child.node = tree.pool.template allocate<Node>();
+                child.left = top[t].left;
+                child.right = mid;
+                child.bbox = top[t].bbox;
+                child.bbox[cutfeat].high = cutval;
+                top[t].child1 = top.size();
+                top.emplace_back(child);
+
+                child.node = tree.pool.template allocate<Node>();
+                child.left = mid;
+                child.right = top[t].right;
+                child.bbox = top[t].bbox;
+                child.bbox[cutfeat].low = cutval;
+                top[t].child2 = top.size();
+                top.emplace_back(child);
+            }
+
+            subtree_pools_.resize(subtrees.size());
+#pragma omp parallel for schedule (dynamic)
+            for (size_t s = 0; s < subtrees.size(); s++) {
+                TopNode &root = top[subtrees[s]];
+                if (root.in_buffer) {
+                    std::copy(buffer.begin() + root.left, buffer.begin() + root.right, tree.vind.begin() + root.left);
+                }
+                subtree_pools_[s].reset(new nanoflann::PooledAllocator);
+                divide_tree_(root.node, root.left, root.right, root.bbox, *subtree_pools_[s]);
+            }
+
+            // Children come after their parents; divlow/divhigh and bounding boxes are those of the (built) children
+            for (size_t t = top.size(); t-- > 0;) {
+                if (top[t].child1 < 0) continue;
+                const BoundingBox &left_bbox = top[top[t].child1].bbox;
+                const BoundingBox &right_bbox = top[top[t].child2].bbox;
+                Node * node = top[t].node;
+                node->child1 = top[top[t].child1].node;
+                node->child2 = top[top[t].child2].node;
+                node->node_type.sub.divlow = left_bbox[node->node_type.sub.divfeat].high;
+                node->node_type.sub.divhigh = right_bbox[node->node_type.sub.divfeat].low;
+                for (size_t d = 0; d < dim; d++) {
+                    top[t].bbox[d].low = std::min(left_bbox[d].low, right_bbox[d].low);
+                    top[t].bbox[d].high = std::max(left_bbox[d].high, right_bbox[d].high);
+                }
+            }
+
+            tree.root_bbox = top[0].bbox;
+            tree.root_node = top[0].node;
+        }
+
+        // Extent of the points ind[0, count) along the given dimensions (others are left as they are)
+        void compute_min_max_(const IndexT * ind, size_t count, const std::vector<size_t> &dims, BoundingBox &bbox) const {
+            nanoflann::resize(bbox, data_map_.rows());
+            for (size_t j = 0; j < dims.size(); j++) {
+                bbox[dims[j]].low = std::numeric_limits<ScalarT>::max();
+                bbox[dims[j]].high = std::numeric_limits<ScalarT>::lowest();
+            }
+#pragma omp parallel
+            {
+                BoundingBox bbox_private(bbox);
+#pragma omp for nowait
+                for (size_t i = 0; i < count; i++) {
+                    for (size_t j = 0; j < dims.size(); j++) {
+                        const ScalarT val = data_map_(dims[j],ind[i]);
+                        if (val < bbox_private[dims[j]].low) bbox_private[dims[j]].low = val;
+                        if (val > bbox_private[dims[j]].high) bbox_private[dims[j]].high = val;
+                    }
+                }
+#pragma omp critical
+                {
+                    for (size_t j = 0; j < dims.size(); j++) {
+                        bbox[dims[j]].low = std::min(bbox[dims[j]].low, bbox_private[dims[j]].low);
+                        bbox[dims[j]].high = std::max(bbox[dims[j]].high, bbox_private[dims[j]].high);
+                    }
+                }
+            }
+        }
+
+        // nanoflann's middleSplit_() on src[0, count), with a parallel three-way (<, ==, > cutval) partition into dst;
+        // returns the split position. Split coordinates are gathered once into values (size >= count), as the top
+        // levels are dominated by cache misses.
+        size_t split_parallel_(const IndexT * src, IndexT * dst, size_t count,
+                               const BoundingBox &bbox,
+                               int &cutfeat, DistanceType &cutval,
+                               std::vector<ScalarT> &values) const
+        {
+            const size_t dim = data_map_.rows();
+
+            // Only dimensions with (nearly) the largest span are split candidates
+            const DistanceType eps = static_cast<DistanceType>(0.00001);
+            ScalarT max_span = bbox[0].high - bbox[0].low;
+            for (size_t d = 1; d < dim; d++) {
+                max_span = std::max(max_span, bbox[d].high - bbox[d].low);
+            }
+            std::vector<size_t> dims;
+            for (size_t d = 0; d < dim; d++) {
+                if (bbox[d].high - bbox[d].low > (1 - eps)*max_span) dims.emplace_back(d);
+            }
+            // Zero span along all dimensions (identical points): nanoflann splits on dimension 0, at count/2
+            if (dims.empty()) dims.emplace_back(0);
+
+            ScalarT min_val = std::numeric_limits<ScalarT>::max();
+            ScalarT max_val = std::numeric_limits<ScalarT>::lowest();
+            if (dims.size() == 1) {
+                cutfeat = dims[0];
+#pragma omp parallel
+                {
+                    ScalarT min_val_private = min_val, max_val_private = max_val;
+#pragma omp for nowait
+                    for (size_t i = 0; i < count; i++) {
+                        const ScalarT val = data_map_(cutfeat,src[i]);
+                        values[i] = val;
+                        min_val_private = std::min(min_val_private, val);
+                        max_val_private = std::max(max_val_private, val);
+                    }
+#pragma omp critical
+                    {
+                        min_val = std::min(min_val, min_val_private);
+                        max_val = std::max(max_val, max_val_private);
+                    }
+                }
+            } else {
+                BoundingBox extent;
+                compute_min_max_(src, count, dims, extent);
+                ScalarT max_spread = -1;
+                cutfeat = 0;
+                for (size_t j = 0; j < dims.size(); j++) {
+                    if (extent[dims[j]].high - extent[dims[j]].low > max_spread) {
+                        cutfeat = dims[j];
+                        max_spread = extent[dims[j]].high - extent[dims[j]].low;
+                    }
+                }
+                min_val = extent[cutfeat].low;
+                max_val = extent[cutfeat].high;
+#pragma omp parallel for
+                for (size_t i = 0; i < count; i++) {
+                    values[i] = data_map_(cutfeat,src[i]);
+                }
+            }
+            const DistanceType split_val = (bbox[cutfeat].low + bbox[cutfeat].high)/2;
+            cutval = std::min<DistanceType>(std::max<DistanceType>(split_val, min_val), max_val);
+
+            const size_t block_size = 65536;
+            const size_t num_blocks = (count + block_size - 1)/block_size;
+            // Per block: number of points below, at and above cutval, then their output offsets
+            std::vector<size_t> offsets(3*num_blocks);
+#pragma omp parallel for
+            for (size_t b = 0; b < num_blocks; b++) {
+                size_t below = 0, equal = 0;
+                const size_t end = std::min(count, (b + 1)*block_size);
+                for (size_t i = b*block_size; i < end; i++) {
+                    below += values[i] < cutval;
+                    equal += values[i] == cutval;
+                }
+                offsets[3*b] = below;
+                offsets[3*b + 1] = equal;
+                offsets[3*b + 2] = end - b*block_size - below - equal;
+            }
+            size_t sum = 0;
+            for (size_t c = 0; c < 3; c++) {
+                for (size_t b = 0; b < num_blocks; b++) {
+                    const size_t num = offsets[3*b + c];
+                    offsets[3*b + c] = sum;
+                    sum += num;
+                }
+            }
+            const size_t lim1 = offsets[1];
+            const size_t lim2 = offsets[2];
+
+#pragma omp parallel for
+            for (size_t b = 0; b < num_blocks; b++) {
+                size_t * block_offsets = offsets.data() + 3*b;
+                const size_t end = std::min(count, (b + 1)*block_size);
+                for (size_t i = b*block_size; i < end; i++) {
+                    dst[block_offsets[(values[i] < cutval) ? 0 : ((values[i] == cutval) ? 1 : 2)]++] = src[i];
+                }
+            }
+
+            if (lim1 > count/2) return lim1;
+            if (lim2 < count/2) return lim2;
+            return count/2;
+        }
+
+        // nanoflann's divideTree(), allocating from the given pool
+        void divide_tree_(Node * node, size_t left, size_t right, BoundingBox &bbox, nanoflann::PooledAllocator &pool) {
+            InternalTree &tree = kd_tree_;
+            const size_t dim = data_map_.rows();
+            if (right - left <= tree.m_leaf_max_size) {
+                node->child1 = node->child2 = NULL;
+                node->node_type.lr.left = left;
+                node->node_type.lr.right = right;
+                for (size_t d = 0; d < dim; d++) {
+                    bbox[d].low = bbox[d].high = data_map_(d,tree.vind[left]);
+                }
+                for (size_t k = left + 1; k < right; k++) {
+                    for (size_t d = 0; d < dim; d++) {
+                        const ScalarT val = data_map_(d,tree.vind[k]);
+                        if (val < bbox[d].low) bbox[d].low = val;
+                        if (val > bbox[d].high) bbox[d].high = val;
+                    }
+                }
+                return;
+            }
+
+            IndexT idx;
+            int cutfeat;
+            DistanceType cutval;
+            tree.middleSplit_(tree, tree.vind.data() + left, right - left, idx, cutfeat, cutval, bbox);
+            node->node_type.sub.divfeat = cutfeat;
+
+            BoundingBox left_bbox(bbox);
+            left_bbox[cutfeat].high = cutval;
+            node->child1 = pool.template allocate<Node>();
+            divide_tree_(node->child1, left, left + idx, left_bbox, pool);
+
+            BoundingBox right_bbox(bbox);
+            right_bbox[cutfeat].low = cutval;
+            node->child2 = pool.template allocate<Node>();
+            divide_tree_(node->child2, left + idx, right, right_bbox, pool);
+
+            node->node_type.sub.divlow = left_bbox[cutfeat].high;
+            node->node_type.sub.divhigh = right_bbox[cutfeat].low;
+            for (size_t d = 0; d < dim; d++) {
+                bbox[d].low = std::min(left_bbox[d].low, right_bbox[d].low);
+                bbox[d].high = std::max(left_bbox[d].high, right_bbox[d].high);
+            }
+        }
     };
 
     typedef KDTree<float,2,KDTreeDistanceAdaptors::L2> KDTree2f;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <iterator>
 #include <Eigen/Dense>
 
 namespace cilantro {
@@ -52,6 +53,77 @@ namespace cilantro {
     template <typename ScalarT, typename IndexT = size_t>
     using NeighborhoodSet = std::vector<Neighborhood<ScalarT,IndexT>>;
 
+    // Lightweight view of a contiguous range of neighbors (e.g. one neighborhood of a FlatNeighborhoodSet)
+    template <typename IteratorT>
+    class NeighborhoodRange {
+    public:
+        typedef typename std::iterator_traits<IteratorT>::value_type value_type;
+        typedef typename std::iterator_traits<IteratorT>::reference reference;
+        typedef IteratorT iterator;
+        typedef IteratorT const_iterator;
+
+        inline NeighborhoodRange(IteratorT begin, IteratorT end) : begin_(begin), end_(end) {}
+
+        inline IteratorT begin() const { return begin_; }
+
+        inline IteratorT end() const { return end_; }
+
+        inline size_t size() const { return end_ - begin_; }
+
+        inline bool empty() const { return begin_ == end_; }
+
+        inline reference operator[](size_t i) const { return begin_[i]; }
+
+    private:
+        IteratorT begin_;
+        IteratorT end_;
+    };
+
+    // Compressed (CSR) storage for a set of neighborhoods:
+    // neighborhood i occupies neighbors[offsets[i]] to neighbors[offsets[i+1]-1]
+    template <typename ScalarT, typename IndexT = size_t>
+    struct FlatNeighborhoodSet {
+        typedef Neighbor<ScalarT,IndexT> NeighborT;
+        typedef std::vector<NeighborT> NeighborContainer;
+        typedef NeighborhoodRange<typename NeighborContainer::iterator> NeighborhoodView;
+        typedef NeighborhoodRange<typename NeighborContainer::const_iterator> ConstNeighborhoodView;
+        typedef ConstNeighborhoodView value_type;
+
+        NeighborContainer neighbors;
+        std::vector<size_t> offsets;
+
+        inline FlatNeighborhoodSet() : offsets(1, 0) {}
+
+        inline size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+        inline bool empty() const { return size() == 0; }
+
+        inline size_t getNumberOfNeighbors(size_t i) const { return offsets[i+1] - offsets[i]; }
+
+        inline NeighborhoodView operator[](size_t i) {
+            return NeighborhoodView(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i+1]);
+        }
+
+        inline ConstNeighborhoodView operator[](size_t i) const {
+            return ConstNeighborhoodView(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i+1]);
+        }
+
+        inline FlatNeighborhoodSet& clear() {
+            neighbors.clear();
+            offsets.assign(1, 0);
+            return *this;
+        }
+
+        NeighborhoodSet<ScalarT,IndexT> toNeighborhoodSet() const {
+            NeighborhoodSet<ScalarT,IndexT> res(size());
+#pragma omp parallel for
+            for (size_t i = 0; i < res.size(); i++) {
+                res[i].assign(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i+1]);
+            }
+            return res;
+        }
+    };
+
     template <typename CountT = size_t>
     struct KNNNeighborhoodSpecification {
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cilantro/core/data_containers.hpp>
+
+namespace cilantro {
+    // Accumulates weighted least squares normal equations (AtA, Atb) one scalar equation at a time.
+    // Equations are buffered in structure-of-arrays batches of Lanes rows; every batch updates per-lane partial sums
+    // of the unique entries of the augmented system [A b]^T W [A b] (upper triangle only) with packet (SIMD) math.
+    // Lanes are reduced and the symmetric part mirrored once, in accumulateNormalEquations().
+    template <typename ScalarT, ptrdiff_t NumUnknowns>
+    class NormalEquationAccumulator {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        enum {
+            Lanes = 16,
+            NumColumns = NumUnknowns + 1,
+            NumTerms = NumColumns*(NumColumns + 1)/2
+        };
+
+        inline NormalEquationAccumulator() { reset(); }
+
+        inline NormalEquationAccumulator& reset() {
+            rows_.setZero();
+            weights_.setZero();
+            sums_.setZero();
+            count_ = 0;
+            return *this;
+        }
+
+        // Adds the equation weight*(jac.dot(x) - residual)^2
+        template <class JacobianT>
+        inline NormalEquationAccumulator& addEquation(const Eigen::MatrixBase<JacobianT> &jac, ScalarT residual, ScalarT weight) {
+            rows_.row(count_).template head<NumUnknowns>() = jac.transpose();
+            rows_(count_,NumUnknowns) = residual;
+            weights_[count_] = weight;
+            if (++count_ == Lanes) flush_();
+            return *this;
+        }
+
+        // Adds the equations weight*(jac.col(j).dot(x) - residual[j])^2, for all columns j
+        template <class JacobianT, class ResidualT>
+        inline NormalEquationAccumulator& addEquations(const Eigen::MatrixBase<JacobianT> &jac, const Eigen::MatrixBase<ResidualT> &residual, ScalarT weight) {
+            for (size_t j = 0; j < jac.cols(); j++) {
+                addEquation(jac.col(j), residual[j], weight);
+            }
+            return *this;
+        }
+
+        // Adds the accumulated system to AtA and Atb (e.g. thread private reduction copies)
+        NormalEquationAccumulator& accumulateNormalEquations(Eigen::Matrix<ScalarT,NumUnknowns,NumUnknowns> &AtA,
+                                                             Eigen::Matrix<ScalarT,NumUnknowns,1> &Atb)
+        {
+            if (count_ > 0) {
+                rows_.bottomRows(Lanes - count_).setZero();
+                weights_.tail(Lanes - count_).setZero();
+                flush_();
+            }
+            const Eigen::Matrix<ScalarT,1,NumTerms> terms(sums_.colwise().sum());
+            size_t k = 0;
+            for (size_t i = 0; i < NumUnknowns; i++) {
+                for (size_t j = i; j < NumUnknowns; j++) {
+                    AtA(i,j) += terms[k];
+                    if (j != i) AtA(j,i) += terms[k];
+                    k++;
+                }
+                Atb[i] += terms[k++];
+            }
+            return *this;
+        }
+
+    private:
+        Eigen::Array<ScalarT,Lanes,NumColumns> rows_;
+        Eigen::Array<ScalarT,Lanes,1> weights_;
+        Eigen::Array<ScalarT,Lanes,NumTerms> sums_;
+        size_t count_;
+
+        inline void flush_() {
+            size_t k = 0;
+            for (size_t i = 0; i < NumColumns; i++) {
+                const Eigen::Array<ScalarT,Lanes,1> weighted(weights_*rows_.col(i));
+                for (size_t j = i; j < NumColumns; j++) {
+                    sums_.col(k++) += weighted*rows_.col(j);
+                }
+            }
+            count_ = 0;
+        }
+    };
+}
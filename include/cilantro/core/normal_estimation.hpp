@@ -2,16 +2,17 @@
 
 #include <cilantro/core/covariance.hpp>
 #include <cilantro/core/kd_tree.hpp>
+#include <cilantro/core/smallest_eigenvector_batch_solver.hpp>
 
 namespace cilantro {
-    template <typename ScalarT, ptrdiff_t EigenDim, typename IndexT = size_t, typename CovarianceT = Covariance<ScalarT, EigenDim>>
+    template <typename ScalarT, ptrdiff_t EigenDim, typename IndexT = size_t, typename CovarianceT = Covariance<ScalarT, EigenDim>, class SearchTreeT = KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2,IndexT>>
     class NormalEstimation {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
         typedef ScalarT Scalar;
         typedef IndexT Index;
-        typedef KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2,IndexT> SearchTree;
+        typedef SearchTreeT SearchTree;
 
         enum { Dimension = EigenDim };
 
@@ -213,6 +214,7 @@ namespace cilantro {
             return *this;
         }
 
+        // nh can also be a FlatNeighborhoodSet of precomputed neighborhoods, one per point
         template <typename NeighborhoodSpecT>
         inline const NormalEstimation& getNormalsAndCurvature(VectorSet<ScalarT,EigenDim> &normals,
                                                               VectorSet<ScalarT,1> &curvature,
@@ -274,6 +276,73 @@ namespace cilantro {
         ConstVectorSetMatrixMap<ScalarT,EigenDim> ref_normals_;
         CovarianceT compute_mean_and_covariance_;
 
+        template <typename NeighborhoodSpecT>
+        inline void find_neighbors_(size_t i, const NeighborhoodSpecT &nh, typename SearchTree::NeighborhoodResult &nn) const {
+            kd_tree_ptr_->search(points_.col(i), nh, nn);
+        }
+
+        // Precomputed neighborhoods (one per point); copied into the thread-local buffer since CovarianceT may reorder them
+        inline void find_neighbors_(size_t i, const typename SearchTree::FlatNeighborhoodSetResult &neighborhoods, typename SearchTree::NeighborhoodResult &nn) const {
+            nn.assign(neighborhoods[i].begin(), neighborhoods[i].end());
+        }
+
+        // Calls result_fun(i, normal, curvature) for the points with a valid neighborhood covariance and invalid_fun(i)
+        // for the rest; eigen-decompositions are batched per thread (closed form, SIMD batches in 3D)
+        template <typename NeighborhoodSpecT, class ResultFunT, class InvalidFunT>
+        void for_each_normal_curvature_(const NeighborhoodSpecT &nh,
+                                        const ResultFunT &result_fun,
+                                        const InvalidFunT &invalid_fun) const
+        {
+#pragma omp parallel
+            {
+                typename SearchTree::NeighborhoodResult nn;
+                Vector<ScalarT,EigenDim> mean;
+                Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
+                SmallestEigenvectorBatchSolver<ScalarT,EigenDim> solver;
+#pragma omp for
+                for (size_t i = 0; i < points_.cols(); i++) {
+                    find_neighbors_(i, nh, nn);
+                    if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
+                        invalid_fun(i);
+                        continue;
+                    }
+                    solver.add(i, cov);
+                    if (solver.full()) solver.flush(result_fun);
+                }
+                solver.flush(result_fun);
+            }
+        }
+
+        // Radius neighborhoods with the default covariance: single pass, the search feeds the covariance sums directly
+        // (no neighborhood buffer, every neighbor is read once, while still in cache)
+        template <class ResultFunT, class InvalidFunT, class CovT = CovarianceT>
+        typename std::enable_if<std::is_same<CovT,Covariance<ScalarT,EigenDim>>::value>::type
+        for_each_normal_curvature_(const RadiusNeighborhoodSpecification<ScalarT> &nh,
+                                   const ResultFunT &result_fun,
+                                   const InvalidFunT &invalid_fun) const
+        {
+#pragma omp parallel
+            {
+                CovarianceAccumulator<ScalarT,EigenDim> accum;
+                auto add_neighbor = [this,&accum](IndexT ind, ScalarT) { accum.addPoint(points_.col(ind)); };
+                Vector<ScalarT,EigenDim> mean;
+                Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
+                SmallestEigenvectorBatchSolver<ScalarT,EigenDim> solver;
+#pragma omp for
+                for (size_t i = 0; i < points_.cols(); i++) {
+                    accum.reset(points_.col(i));
+                    kd_tree_ptr_->radiusSearchVisit(points_.col(i), nh.radius, add_neighbor);
+                    if (!accum.getMeanAndCovariance(mean, cov)) {
+                        invalid_fun(i);
+                        continue;
+                    }
+                    solver.add(i, cov);
+                    if (solver.full()) solver.flush(result_fun);
+                }
+                solver.flush(result_fun);
+            }
+        }
+
         // Normals only, no normal consistency unless view point or reference normals were set
         template <typename NeighborhoodSpecT>
         void compute_normals_(VectorSetMatrixMap<ScalarT,EigenDim> normals,
@@ -290,20 +359,11 @@ namespace cilantro {
                 return;
             }
 
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (normals) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov);
-                normals.col(i) = eig.eigenvectors().col(0);
-            }
+            for_each_normal_curvature_(nh, [&normals](size_t i, const Vector<ScalarT,EigenDim> &normal, ScalarT) {
+                normals.col(i) = normal;
+            }, [&normals](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+            });
         }
 
         // Normals only, normal consistency by view point
@@ -311,24 +371,15 @@ namespace cilantro {
         void compute_normals_view_point_(VectorSetMatrixMap<ScalarT,EigenDim> normals,
                                         const NeighborhoodSpecT &nh) const
         {
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (normals) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov);
-                if (eig.eigenvectors().col(0).dot(view_point_ - points_.col(i)) < (ScalarT)0.0) {
-                    normals.col(i) = -eig.eigenvectors().col(0);
+            for_each_normal_curvature_(nh, [this,&normals](size_t i, const Vector<ScalarT,EigenDim> &normal, ScalarT) {
+                if (normal.dot(view_point_ - points_.col(i)) < (ScalarT)0.0) {
+                    normals.col(i) = -normal;
                 } else {
-                    normals.col(i) = eig.eigenvectors().col(0);
+                    normals.col(i) = normal;
                 }
-            }
+            }, [&normals](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+            });
         }
 
         // Normals only, normal consistency by reference normals
@@ -336,25 +387,16 @@ namespace cilantro {
         void compute_normals_reference_normals_(VectorSetMatrixMap<ScalarT,EigenDim> normals,
                                                 const NeighborhoodSpecT &nh) const
         {
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (normals) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
-                    // normals.col(i) = ref_normals_.col(i).normalized();
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov);
-                if (eig.eigenvectors().col(0).dot(ref_normals_.col(i)) < (ScalarT)0.0) {
-                    normals.col(i) = -eig.eigenvectors().col(0);
+            for_each_normal_curvature_(nh, [this,&normals](size_t i, const Vector<ScalarT,EigenDim> &normal, ScalarT) {
+                if (normal.dot(ref_normals_.col(i)) < (ScalarT)0.0) {
+                    normals.col(i) = -normal;
                 } else {
-                    normals.col(i) = eig.eigenvectors().col(0);
+                    normals.col(i) = normal;
                 }
-            }
+            }, [&normals](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+                // normals.col(i) = ref_normals_.col(i).normalized();
+            });
         }
 
         // Normals and curvature, no normal consistency unless view point or reference normals were set
@@ -374,22 +416,13 @@ namespace cilantro {
                 return;
             }
 
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (normals, curvature) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
-                    curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov);
-                normals.col(i) = eig.eigenvectors().col(0);
-                curvature[i] = eig.eigenvalues()[0]/eig.eigenvalues().sum();
-            }
+            for_each_normal_curvature_(nh, [&normals,&curvature](size_t i, const Vector<ScalarT,EigenDim> &normal, ScalarT curv) {
+                normals.col(i) = normal;
+                curvature[i] = curv;
+            }, [&normals,&curvature](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+                curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
+            });
         }
 
         // Normals and curvature, normal consistency by view point
@@ -398,26 +431,17 @@ namespace cilantro {
                                                    VectorSetMatrixMap<ScalarT,1> curvature,
                                                    const NeighborhoodSpecT &nh) const
         {
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (normals, curvature) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
-                    curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov);
-                if (eig.eigenvectors().col(0).dot(view_point_ - points_.col(i)) < (ScalarT)0.0) {
-                    normals.col(i) = -eig.eigenvectors().col(0);
+            for_each_normal_curvature_(nh, [this,&normals,&curvature](size_t i, const Vector<ScalarT,EigenDim> &normal, ScalarT curv) {
+                if (normal.dot(view_point_ - points_.col(i)) < (ScalarT)0.0) {
+                    normals.col(i) = -normal;
                 } else {
-                    normals.col(i) = eig.eigenvectors().col(0);
+                    normals.col(i) = normal;
                 }
-                curvature[i] = eig.eigenvalues()[0]/eig.eigenvalues().sum();
-            }
+                curvature[i] = curv;
+            }, [&normals,&curvature](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+                curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
+            });
         }
 
         // Normals and curvature, normal consistency by reference normals
@@ -426,26 +450,17 @@ namespace cilantro {
                                         VectorSetMatrixMap<ScalarT,1> curvature,
                                         const NeighborhoodSpecT &nh) const
         {
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (normals, curvature) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
-                    curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov);
-                if (eig.eigenvectors().col(0).dot(ref_normals_.col(i)) < (ScalarT)0.0) {
-                    normals.col(i) = -eig.eigenvectors().col(0);
+            for_each_normal_curvature_(nh, [this,&normals,&curvature](size_t i, const Vector<ScalarT,EigenDim> &normal, ScalarT curv) {
+                if (normal.dot(ref_normals_.col(i)) < (ScalarT)0.0) {
+                    normals.col(i) = -normal;
                 } else {
-                    normals.col(i) = eig.eigenvectors().col(0);
+                    normals.col(i) = normal;
                 }
-                curvature[i] = eig.eigenvalues()[0]/eig.eigenvalues().sum();
-            }
+                curvature[i] = curv;
+            }, [&normals,&curvature](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+                curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
+            });
         }
 
         // Curvature only
@@ -453,20 +468,11 @@ namespace cilantro {
         void compute_curvature_(VectorSetMatrixMap<ScalarT,1> curvature,
                                 const NeighborhoodSpecT &nh) const
         {
-            typename SearchTree::NeighborhoodResult nn;
-            Vector<ScalarT,EigenDim> mean;
-            Eigen::Matrix<ScalarT,EigenDim,EigenDim> cov;
-#pragma omp parallel for shared (curvature) private (nn, mean, cov)
-            for (size_t i = 0; i < points_.cols(); i++) {
-                kd_tree_ptr_->search(points_.col(i), nh, nn);
-                if (!compute_mean_and_covariance_(points_, nn, mean, cov)) {
-                    curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
-                    continue;
-                }
-
-                Eigen::SelfAdjointEigenSolver<Eigen::Matrix<ScalarT,EigenDim,EigenDim>> eig(cov, Eigen::EigenvaluesOnly);
-                curvature[i] = eig.eigenvalues()[0]/eig.eigenvalues().sum();
-            }
+            for_each_normal_curvature_(nh, [&curvature](size_t i, const Vector<ScalarT,EigenDim> &, ScalarT curv) {
+                curvature[i] = curv;
+            }, [&curvature](size_t i) {
+                curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
+            });
         }
     };
 
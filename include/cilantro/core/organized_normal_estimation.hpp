@@ -0,0 +1,302 @@
+#pragma once
+
+#include <cilantro/core/data_containers.hpp>
+#include <cilantro/core/smallest_eigenvector_batch_solver.hpp>
+
+namespace cilantro {
+    // Normals (and curvature) of organized point clouds, i.e. image_w*image_h points in row-major pixel order, as output
+    // by depthImageToPoints() with keep_invalid = true. Pixels with non-finite coordinates or at the view point (zero
+    // depth) are invalid.
+    // Every normal is the smallest eigenvector of the covariance of the valid points in a square pixel window around
+    // it, read in constant time from integral images of the point sums and outer product sums, so no search tree is
+    // needed. Windows do not cross depth discontinuities (neighboring pixels whose distances to the view point differ
+    // by more than maxDepthChangeFactor times the smaller one, per pixel of separation when up to windowRadius invalid
+    // pixels, e.g. an occlusion shadow, lie between them): they shrink to fit between them, and points next to a
+    // discontinuity get no normal. Normals point towards the view point (camera center).
+    template <typename ScalarT>
+    class OrganizedNormalEstimation {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef ScalarT Scalar;
+
+        OrganizedNormalEstimation(const ConstVectorSetMatrixMap<ScalarT,3> &points, size_t image_w, size_t image_h)
+                : points_(points),
+                  image_w_(image_w),
+                  image_h_(image_h),
+                  view_point_(Vector<ScalarT,3>::Zero()),
+                  window_radius_(4),
+                  max_depth_change_factor_((ScalarT)0.02)
+        {}
+
+        inline size_t getImageWidth() const { return image_w_; }
+
+        inline size_t getImageHeight() const { return image_h_; }
+
+        inline const Vector<ScalarT,3>& getViewPoint() const { return view_point_; }
+
+        inline OrganizedNormalEstimation& setViewPoint(const Eigen::Ref<const Vector<ScalarT,3>> &vp) {
+            view_point_ = vp;
+            return *this;
+        }
+
+        // Half size of the (2*radius + 1)^2 pixel window
+        inline size_t getWindowRadius() const { return window_radius_; }
+
+        inline OrganizedNormalEstimation& setWindowRadius(size_t radius) {
+            window_radius_ = radius;
+            return *this;
+        }
+
+        inline ScalarT getMaxDepthChangeFactor() const { return max_depth_change_factor_; }
+
+        inline OrganizedNormalEstimation& setMaxDepthChangeFactor(ScalarT factor) {
+            max_depth_change_factor_ = factor;
+            return *this;
+        }
+
+        inline const OrganizedNormalEstimation& getNormalsAndCurvature(VectorSet<ScalarT,3> &normals,
+                                                                       VectorSet<ScalarT,1> &curvature) const
+        {
+            normals.resize(3, points_.cols());
+            curvature.resize(1, points_.cols());
+            compute_normals_curvature_(normals, curvature);
+            return *this;
+        }
+
+        // External buffers
+        inline const OrganizedNormalEstimation& estimateNormalsAndCurvature(VectorSetMatrixMap<ScalarT,3> normals,
+                                                                            VectorSetMatrixMap<ScalarT,1> curvature) const
+        {
+            compute_normals_curvature_(normals, curvature);
+            return *this;
+        }
+
+        inline VectorSet<ScalarT,3> getNormals() const {
+            VectorSet<ScalarT,3> normals(3, points_.cols());
+            estimateNormals(normals);
+            return normals;
+        }
+
+        // External buffer
+        inline const OrganizedNormalEstimation& estimateNormals(VectorSetMatrixMap<ScalarT,3> normals) const {
+            for_each_normal_curvature_([&normals](size_t i, const Vector<ScalarT,3> &normal, ScalarT) {
+                normals.col(i) = normal;
+            }, [&normals](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+            });
+            return *this;
+        }
+
+        inline VectorSet<ScalarT,1> getCurvature() const {
+            VectorSet<ScalarT,1> curvature(1, points_.cols());
+            estimateCurvature(curvature);
+            return curvature;
+        }
+
+        // External buffer
+        inline const OrganizedNormalEstimation& estimateCurvature(VectorSetMatrixMap<ScalarT,1> curvature) const {
+            for_each_normal_curvature_([&curvature](size_t i, const Vector<ScalarT,3> &, ScalarT curv) {
+                curvature[i] = curv;
+            }, [&curvature](size_t i) {
+                curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
+            });
+            return *this;
+        }
+
+    private:
+        // Integral image channels: count, sum of points (3), sum of outer products (upper triangle, 6); accumulated in
+        // double precision, as covariances are differences of (large) window sums
+        enum { NumChannels = 10 };
+
+        typedef Eigen::Matrix<double,NumChannels,Eigen::Dynamic> IntegralImage;
+
+        ConstVectorSetMatrixMap<ScalarT,3> points_;
+        size_t image_w_;
+        size_t image_h_;
+        Vector<ScalarT,3> view_point_;
+        size_t window_radius_;
+        ScalarT max_depth_change_factor_;
+
+        // Distances of the points to the view point; zero for invalid pixels
+        void compute_depths_(std::vector<ScalarT> &depth) const {
+            depth.resize(points_.cols());
+#pragma omp parallel for
+            for (size_t i = 0; i < depth.size(); i++) {
+                depth[i] = (points_.col(i).allFinite()) ? (points_.col(i) - view_point_).norm() : (ScalarT)0.0;
+            }
+        }
+
+        // Entry (x, y) holds the sums over pixels [0, x) x [0, y), at column y*(image_w + 1) + x
+        void compute_integral_image_(const std::vector<ScalarT> &depth, IntegralImage &integral) const {
+            const size_t stride = image_w_ + 1;
+            integral.resize(NumChannels, stride*(image_h_ + 1));
+            integral.leftCols(stride).setZero();
+
+            // Row prefix sums
+#pragma omp parallel for
+            for (size_t y = 0; y < image_h_; y++) {
+                Eigen::Matrix<double,NumChannels,1> acc(Eigen::Matrix<double,NumChannels,1>::Zero());
+                integral.col((y + 1)*stride).setZero();
+                for (size_t x = 0; x < image_w_; x++) {
+                    const size_t k = y*image_w_ + x;
+                    if (depth[k] > (ScalarT)0.0) {
+                        const Eigen::Vector3d p(points_.col(k).template cast<double>());
+                        acc[0] += 1.0;
+                        acc.template segment<3>(1) += p;
+                        acc[4] += p[0]*p[0]; acc[5] += p[0]*p[1]; acc[6] += p[0]*p[2];
+                        acc[7] += p[1]*p[1]; acc[8] += p[1]*p[2]; acc[9] += p[2]*p[2];
+                    }
+                    integral.col((y + 1)*stride + x + 1) = acc;
+                }
+            }
+
+            // Column prefix sums, in blocks of contiguous columns
+            const size_t block_size = 16;
+#pragma omp parallel for
+            for (size_t b = 0; b < stride; b += block_size) {
+                const size_t b_end = std::min(b + block_size, stride);
+                for (size_t y = 2; y <= image_h_; y++) {
+                    integral.middleCols(y*stride + b, b_end - b) += integral.middleCols((y - 1)*stride + b, b_end - b);
+                }
+            }
+        }
+
+        // Chessboard distance (in pixels) of every pixel to the nearest depth discontinuity, capped at max_dist; only
+        // the far side of a discontinuity is marked. Runs of up to max_gap invalid pixels (e.g. occlusion shadows)
+        // between two valid pixels are looked across, with the allowed depth change scaled by the pixel distance.
+        void compute_discontinuity_distances_(const std::vector<ScalarT> &depth, size_t max_dist, size_t max_gap, std::vector<size_t> &dist) const {
+            dist.assign(depth.size(), max_dist);
+            const ptrdiff_t w = image_w_, h = image_h_;
+#pragma omp parallel for
+            for (ptrdiff_t y = 0; y < h; y++) {
+                for (ptrdiff_t x = 0; x < w; x++) {
+                    const size_t k = y*w + x;
+                    const ScalarT d = depth[k];
+                    if (d <= (ScalarT)0.0) continue;
+                    const ptrdiff_t dx[4] = {-1, 1, 0, 0};
+                    const ptrdiff_t dy[4] = {0, 0, -1, 1};
+                    for (size_t n = 0; n < 4 && dist[k] > 0; n++) {
+                        // First valid pixel in direction n
+                        for (ptrdiff_t step = 1; step <= (ptrdiff_t)max_gap + 1; step++) {
+                            const ptrdiff_t xn = x + step*dx[n], yn = y + step*dy[n];
+                            if (xn < 0 || xn >= w || yn < 0 || yn >= h) break;
+                            const ScalarT dn = depth[yn*w + xn];
+                            if (dn <= (ScalarT)0.0) continue;
+                            if (dn < d && d - dn > step*max_depth_change_factor_*dn) dist[k] = 0;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // Two pass chamfer transform over 8-neighborhoods (exact for the chessboard metric)
+            for (size_t y = 0; y < image_h_; y++) {
+                for (size_t x = 0; x < image_w_; x++) {
+                    size_t &d = dist[y*image_w_ + x];
+                    if (x > 0) d = std::min(d, dist[y*image_w_ + x - 1] + 1);
+                    if (y > 0) {
+                        const size_t up = (y - 1)*image_w_ + x;
+                        d = std::min(d, dist[up] + 1);
+                        if (x > 0) d = std::min(d, dist[up - 1] + 1);
+                        if (x + 1 < image_w_) d = std::min(d, dist[up + 1] + 1);
+                    }
+                }
+            }
+            for (size_t y = image_h_; y-- > 0;) {
+                for (size_t x = image_w_; x-- > 0;) {
+                    size_t &d = dist[y*image_w_ + x];
+                    if (x + 1 < image_w_) d = std::min(d, dist[y*image_w_ + x + 1] + 1);
+                    if (y + 1 < image_h_) {
+                        const size_t down = (y + 1)*image_w_ + x;
+                        d = std::min(d, dist[down] + 1);
+                        if (x > 0) d = std::min(d, dist[down - 1] + 1);
+                        if (x + 1 < image_w_) d = std::min(d, dist[down + 1] + 1);
+                    }
+                }
+            }
+        }
+
+        // Calls result_fun(i, normal, curvature) for the pixels with a valid window covariance and invalid_fun(i) for
+        // the rest
+        template <class ResultFunT, class InvalidFunT>
+        void for_each_normal_curvature_(const ResultFunT &result_fun, const InvalidFunT &invalid_fun) const {
+            if ((size_t)points_.cols() != image_w_*image_h_ || points_.cols() == 0) {
+#pragma omp parallel for
+                for (size_t i = 0; i < points_.cols(); i++) invalid_fun(i);
+                return;
+            }
+
+            std::vector<ScalarT> depth;
+            compute_depths_(depth);
+            IntegralImage integral;
+            compute_integral_image_(depth, integral);
+            std::vector<size_t> dist;
+            compute_discontinuity_distances_(depth, window_radius_ + 1, window_radius_, dist);
+
+            const size_t stride = image_w_ + 1;
+            const auto oriented_result_fun = [this,&result_fun](size_t i, const Vector<ScalarT,3> &normal, ScalarT curvature) {
+                if (normal.dot(view_point_ - points_.col(i)) < (ScalarT)0.0) {
+                    result_fun(i, -normal, curvature);
+                } else {
+                    result_fun(i, normal, curvature);
+                }
+            };
+
+#pragma omp parallel
+            {
+                SmallestEigenvectorBatchSolver<ScalarT,3> solver;
+                Eigen::Matrix<ScalarT,3,3> cov;
+#pragma omp for
+                for (size_t y = 0; y < image_h_; y++) {
+                    for (size_t x = 0; x < image_w_; x++) {
+                        const size_t k = y*image_w_ + x;
+                        // Window may not reach a marked pixel
+                        const size_t r = std::min(window_radius_, dist[k] - (dist[k] > 0));
+                        if (depth[k] <= (ScalarT)0.0 || r == 0) {
+                            invalid_fun(k);
+                            continue;
+                        }
+
+                        const size_t x0 = (x > r) ? x - r : 0, x1 = std::min(x + r + 1, image_w_);
+                        const size_t y0 = (y > r) ? y - r : 0, y1 = std::min(y + r + 1, image_h_);
+                        const Eigen::Matrix<double,NumChannels,1> s(integral.col(y1*stride + x1) - integral.col(y0*stride + x1) -
+                                                                    integral.col(y1*stride + x0) + integral.col(y0*stride + x0));
+                        const double n = s[0];
+                        if (n < 3.0) {
+                            invalid_fun(k);
+                            continue;
+                        }
+
+                        const Eigen::Vector3d mean(s.template segment<3>(1)/n);
+                        const double norm = 1.0/(n - 1.0);
+                        cov(0,0) = (ScalarT)((s[4] - mean[0]*s[1])*norm);
+                        cov(0,1) = cov(1,0) = (ScalarT)((s[5] - mean[0]*s[2])*norm);
+                        cov(0,2) = cov(2,0) = (ScalarT)((s[6] - mean[0]*s[3])*norm);
+                        cov(1,1) = (ScalarT)((s[7] - mean[1]*s[2])*norm);
+                        cov(1,2) = cov(2,1) = (ScalarT)((s[8] - mean[1]*s[3])*norm);
+                        cov(2,2) = (ScalarT)((s[9] - mean[2]*s[3])*norm);
+                        solver.add(k, cov);
+                        if (solver.full()) solver.flush(oriented_result_fun);
+                    }
+                }
+                solver.flush(oriented_result_fun);
+            }
+        }
+
+        void compute_normals_curvature_(VectorSetMatrixMap<ScalarT,3> normals,
+                                        VectorSetMatrixMap<ScalarT,1> curvature) const
+        {
+            for_each_normal_curvature_([&normals,&curvature](size_t i, const Vector<ScalarT,3> &normal, ScalarT curv) {
+                normals.col(i) = normal;
+                curvature[i] = curv;
+            }, [&normals,&curvature](size_t i) {
+                normals.col(i).setConstant(std::numeric_limits<ScalarT>::quiet_NaN());
+                curvature[i] = std::numeric_limits<ScalarT>::quiet_NaN();
+            });
+        }
+    };
+
+    typedef OrganizedNormalEstimation<float> OrganizedNormalEstimationf;
+    typedef OrganizedNormalEstimation<double> OrganizedNormalEstimationd;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+namespace cilantro {
+    // Stable LSD radix sort of (key, value) pairs on the num_key_bits least significant bits of an unsigned key.
+    // Blocking only depends on the input size, so results are identical for any number of threads.
+    template <typename KeyT, typename ValueT>
+    void radixSortKeyValuePairs(std::vector<std::pair<KeyT,ValueT>> &pairs,
+                                size_t num_key_bits = 8*sizeof(KeyT),
+                                bool parallel = true)
+    {
+        static_assert(std::is_unsigned<KeyT>::value, "Radix sort keys must be of unsigned integer type");
+
+        const size_t radix_bits = 8;
+        const size_t num_buckets = (size_t)1 << radix_bits;
+        const size_t block_size = 65536;
+
+        const size_t num_pairs = pairs.size();
+        if (num_pairs < 2) return;
+        const size_t num_blocks = (num_pairs + block_size - 1)/block_size;
+        parallel = parallel && num_blocks > 1;
+
+        std::vector<std::pair<KeyT,ValueT>> buffer(num_pairs);
+        std::vector<size_t> offsets(num_blocks*num_buckets);
+
+        for (size_t shift = 0; shift < num_key_bits && shift < 8*sizeof(KeyT); shift += radix_bits) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+
+#pragma omp parallel for if (parallel)
+            for (size_t b = 0; b < num_blocks; b++) {
+                size_t * block_counts = offsets.data() + b*num_buckets;
+                const size_t end = std::min(num_pairs, (b + 1)*block_size);
+                for (size_t i = b*block_size; i < end; i++) {
+                    block_counts[(pairs[i].first >> shift) & (num_buckets - 1)]++;
+                }
+            }
+
+            // Bucket-major, block-minor exclusive scan keeps the scatter stable
+            size_t sum = 0;
+            bool skip_pass = false;
+            for (size_t d = 0; d < num_buckets; d++) {
+                const size_t bucket_start = sum;
+                for (size_t b = 0; b < num_blocks; b++) {
+                    const size_t count = offsets[b*num_buckets + d];
+                    offsets[b*num_buckets + d] = sum;
+                    sum += count;
+                }
+                if (sum - bucket_start == num_pairs) skip_pass = true;
+            }
+            if (skip_pass) continue;
+
+#pragma omp parallel for if (parallel)
+            for (size_t b = 0; b < num_blocks; b++) {
+                size_t * block_offsets = offsets.data() + b*num_buckets;
+                const size_t end = std::min(num_pairs, (b + 1)*block_size);
+                for (size_t i = b*block_size; i < end; i++) {
+                    buffer[block_offsets[(pairs[i].first >> shift) & (num_buckets - 1)]++] = pairs[i];
+                }
+            }
+            pairs.swap(buffer);
+        }
+    }
+}
@@ -0,0 +1,187 @@
+#pragma once
+
+#include <limits>
+#include <cilantro/core/data_containers.hpp>
+
+namespace cilantro {
+    // Eigenvector of the smallest eigenvalue (e.g. normal) and curvature (smallest eigenvalue over eigenvalue sum) of
+    // symmetric positive semi-definite matrices (e.g. covariances), solved in batches: add() matrices while !full(),
+    // then flush(fun), which calls fun(index, eigenvector, curvature) for every added matrix and empties the batch.
+    // Generic dimension: one matrix per batch, via Eigen::SelfAdjointEigenSolver.
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    class SmallestEigenvectorBatchSolver {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::Matrix<ScalarT,EigenDim,EigenDim> Matrix;
+
+        enum { Lanes = 1 };
+
+        inline SmallestEigenvectorBatchSolver() : count_(0) {}
+
+        inline size_t size() const { return count_; }
+
+        inline bool full() const { return count_ == Lanes; }
+
+        inline SmallestEigenvectorBatchSolver& add(size_t ind, const Matrix &mat) {
+            ind_ = ind;
+            mat_ = mat;
+            count_ = 1;
+            return *this;
+        }
+
+        template <class ResultFunT>
+        inline SmallestEigenvectorBatchSolver& flush(const ResultFunT &fun) {
+            if (count_ == 0) return *this;
+            Eigen::SelfAdjointEigenSolver<Matrix> eig(mat_);
+            const Vector<ScalarT,EigenDim> vec(eig.eigenvectors().col(0));
+            fun(ind_, vec, eig.eigenvalues()[0]/eig.eigenvalues().sum());
+            count_ = 0;
+            return *this;
+        }
+
+    private:
+        size_t ind_;
+        Matrix mat_;
+        size_t count_;
+    };
+
+    // 3x3 specialization: closed form, structure-of-arrays batches of Lanes matrices (packet math).
+    // Matrices are scaled to unit max entry; eigenvalues follow from the trigonometric solution of the characteristic
+    // cubic and eigenvectors from the largest cross product of two rows of (A - lambda*I), as in Eberly's robust 3x3
+    // eigensolver. Curvature uses the Rayleigh quotient of the eigenvector, which is more accurate than the closed form
+    // eigenvalue. Isotropic matrices (no well defined eigenvector) fall back to Eigen::SelfAdjointEigenSolver.
+    template <typename ScalarT>
+    class SmallestEigenvectorBatchSolver<ScalarT,3> {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::Matrix<ScalarT,3,3> Matrix;
+
+        enum { Lanes = 16 };
+
+        inline SmallestEigenvectorBatchSolver() : count_(0) {}
+
+        inline size_t size() const { return count_; }
+
+        inline bool full() const { return count_ == Lanes; }
+
+        inline SmallestEigenvectorBatchSolver& add(size_t ind, const Matrix &mat) {
+            ind_[count_] = ind;
+            a00_[count_] = mat(0,0);
+            a01_[count_] = mat(0,1);
+            a02_[count_] = mat(0,2);
+            a11_[count_] = mat(1,1);
+            a12_[count_] = mat(1,2);
+            a22_[count_] = mat(2,2);
+            count_++;
+            return *this;
+        }
+
+// GCC (-O2 -Wall, AVX-512) flags the deliberately undefined passthrough operand of the unmasked max/sqrt
+// intrinsics behind Eigen's packet math as maybe-uninitialized; all lanes below are initialized
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+        template <class ResultFunT>
+        SmallestEigenvectorBatchSolver& flush(const ResultFunT &fun) {
+            if (count_ == 0) return *this;
+            // Unused lanes hold a well conditioned matrix
+            for (size_t l = count_; l < Lanes; l++) {
+                a00_[l] = (ScalarT)1.0; a11_[l] = (ScalarT)2.0; a22_[l] = (ScalarT)3.0;
+                a01_[l] = a02_[l] = a12_[l] = (ScalarT)0.0;
+            }
+
+            const LaneArray max_abs(a00_.abs().max(a01_.abs()).max(a02_.abs()).max(a11_.abs()).max(a12_.abs()).max(a22_.abs()));
+            const LaneArray scale((max_abs > (ScalarT)0.0).select(max_abs.inverse(), (ScalarT)1.0));
+            const LaneArray b00(a00_*scale), b01(a01_*scale), b02(a02_*scale), b11(a11_*scale), b12(a12_*scale), b22(a22_*scale);
+
+            // Eigenvalues of B are q + 2*p*cos(phi + 2*k*pi/3), largest for k = 0, smallest for k = 1
+            const LaneArray q((b00 + b11 + b22)*(ScalarT)(1.0/3.0));
+            const LaneArray c00(b00 - q), c11(b11 - q), c22(b22 - q);
+            const LaneArray off_sq(b01.square() + b02.square() + b12.square());
+            const LaneArray p(((c00.square() + c11.square() + c22.square() + (ScalarT)2.0*off_sq)*(ScalarT)(1.0/6.0)).sqrt());
+            const LaneArray p_inv((p > (ScalarT)0.0).select(p.inverse(), (ScalarT)0.0));
+            const LaneArray det(c00*(c11*c22 - b12.square()) - b01*(b01*c22 - b12*b02) + b02*(b01*b12 - c11*b02));
+            const LaneArray half_det(((ScalarT)0.5*det*p_inv.cube()).max((ScalarT)(-1.0)).min((ScalarT)1.0));
+            const LaneArray phi(half_det.acos()*(ScalarT)(1.0/3.0));
+
+            // Only the eigenvalue farthest from the middle one is accurate (acos is ill conditioned near +/-1), so its
+            // eigenvector is computed first; if that is the largest one, the smallest follows from the 2x2 problem in
+            // its orthogonal complement
+            const auto largest_first = half_det >= (ScalarT)0.0;
+            const LaneArray lambda(q + (ScalarT)2.0*p*largest_first.select(phi.cos(), (phi + (ScalarT)2.09439510239319549231).cos()));
+
+            // Rows of B - lambda*I and their pairwise cross products
+            const LaneArray r00(b00 - lambda), r11(b11 - lambda), r22(b22 - lambda);
+            const LaneArray x01(b01*b12 - b02*r11), y01(b02*b01 - r00*b12), z01(r00*r11 - b01*b01);
+            const LaneArray x02(b01*r22 - b02*b12), y02(b02*b02 - r00*r22), z02(r00*b12 - b01*b02);
+            const LaneArray x12(r11*r22 - b12*b12), y12(b12*b02 - b01*r22), z12(b01*b12 - r11*b02);
+            const LaneArray n01(x01.square() + y01.square() + z01.square());
+            const LaneArray n02(x02.square() + y02.square() + z02.square());
+            const LaneArray n12(x12.square() + y12.square() + z12.square());
+
+            const auto use01 = (n01 >= n02) && (n01 >= n12);
+            const auto use02 = !use01 && (n02 >= n12);
+            const LaneArray n_max(n01.max(n02).max(n12));
+            const LaneArray n_inv((n_max > (ScalarT)0.0).select(n_max.rsqrt(), (ScalarT)0.0));
+            const LaneArray ex(use01.select(x01, use02.select(x02, x12))*n_inv);
+            const LaneArray ey(use01.select(y01, use02.select(y02, y12))*n_inv);
+            const LaneArray ez(use01.select(z01, use02.select(z02, z12))*n_inv);
+
+            // Orthonormal basis (u, w) of the complement of e, and B restricted to it
+            const auto x_major = ex.abs() > ey.abs();
+            const LaneArray u_inv(x_major.select((ex.square() + ez.square()).rsqrt(), (ey.square() + ez.square()).rsqrt()));
+            const LaneArray ux(x_major.select(-ez*u_inv, (ScalarT)0.0));
+            const LaneArray uy(x_major.select(LaneArray::Zero(), ez*u_inv));
+            const LaneArray uz(x_major.select(ex*u_inv, -ey*u_inv));
+            const LaneArray wx(ey*uz - ez*uy), wy(ez*ux - ex*uz), wz(ex*uy - ey*ux);
+            const LaneArray bux(b00*ux + b01*uy + b02*uz), buy(b01*ux + b11*uy + b12*uz), buz(b02*ux + b12*uy + b22*uz);
+            const LaneArray m00(ux*bux + uy*buy + uz*buz);
+            const LaneArray m01(wx*bux + wy*buy + wz*buz);
+            const LaneArray m11(wx*(b00*wx + b01*wy + b02*wz) + wy*(b01*wx + b11*wy + b12*wz) + wz*(b02*wx + b12*wy + b22*wz));
+
+            // Minor eigenvector (-sin(t), cos(t)) of the 2x2 problem, from the half angle formulas of tan(2*t) = 2*m01/(m00 - m11)
+            const LaneArray diff(m00 - m11);
+            const LaneArray rad((diff.square() + (ScalarT)4.0*m01.square()).sqrt());
+            const LaneArray cos_2t((rad > (ScalarT)0.0).select(diff/rad, (ScalarT)1.0));
+            const LaneArray cos_t((((ScalarT)1.0 + cos_2t)*(ScalarT)0.5).max((ScalarT)0.0).sqrt());
+            const LaneArray sin_t((m01 < (ScalarT)0.0).select(-LaneArray::Ones(), LaneArray::Ones())*(((ScalarT)1.0 - cos_2t)*(ScalarT)0.5).max((ScalarT)0.0).sqrt());
+
+            const LaneArray vx(largest_first.select(cos_t*wx - sin_t*ux, ex));
+            const LaneArray vy(largest_first.select(cos_t*wy - sin_t*uy, ey));
+            const LaneArray vz(largest_first.select(cos_t*wz - sin_t*uz, ez));
+
+            const LaneArray rayleigh(b00*vx.square() + b11*vy.square() + b22*vz.square() + (ScalarT)2.0*(b01*vx*vy + b02*vx*vz + b12*vy*vz));
+            const LaneArray curvature(rayleigh.max((ScalarT)0.0)/(b00 + b11 + b22));
+
+            // Cross products are pure rounding noise if B - lambda*I has rank below 2
+            const ScalarT n_min = (ScalarT)65536.0*std::numeric_limits<ScalarT>::epsilon()*std::numeric_limits<ScalarT>::epsilon();
+            for (size_t l = 0; l < count_; l++) {
+                if (n_max[l] > n_min) {
+                    fun(ind_[l], Vector<ScalarT,3>(vx[l], vy[l], vz[l]), curvature[l]);
+                } else {
+                    Matrix mat;
+                    mat << a00_[l], a01_[l], a02_[l],
+                           a01_[l], a11_[l], a12_[l],
+                           a02_[l], a12_[l], a22_[l];
+                    Eigen::SelfAdjointEigenSolver<Matrix> eig(mat);
+                    fun(ind_[l], Vector<ScalarT,3>(eig.eigenvectors().col(0)), eig.eigenvalues()[0]/eig.eigenvalues().sum());
+                }
+            }
+            count_ = 0;
+            return *this;
+        }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+    private:
+        typedef Eigen::Array<ScalarT,Lanes,1> LaneArray;
+
+        size_t ind_[Lanes];
+        LaneArray a00_, a01_, a02_, a11_, a12_, a22_;
+        size_t count_;
+    };
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <cilantro/core/data_containers.hpp>
+#include <cilantro/core/radix_sort.hpp>
+
+namespace cilantro {
+    enum struct SpaceFillingCurve {MORTON, HILBERT};
+
+    namespace internal {
+        // Skilling's in-place conversion of num_bits bit coordinates to the transposed Hilbert index
+        // ("Programming the Hilbert curve", AIP Conf. Proc. 707, 2004)
+        inline void hilbertAxesToTranspose(uint64_t *x, size_t dim, size_t num_bits) {
+            const uint64_t m = (uint64_t)1 << (num_bits - 1);
+            // Inverse undo
+            for (uint64_t q = m; q > 1; q >>= 1) {
+                const uint64_t p = q - 1;
+                for (size_t i = 0; i < dim; i++) {
+                    if (x[i] & q) {
+                        x[0] ^= p;
+                    } else {
+                        const uint64_t t = (x[0] ^ x[i]) & p;
+                        x[0] ^= t;
+                        x[i] ^= t;
+                    }
+                }
+            }
+            // Gray encode
+            for (size_t i = 1; i < dim; i++) x[i] ^= x[i-1];
+            uint64_t t = 0;
+            for (uint64_t q = m; q > 1; q >>= 1) {
+                if (x[dim-1] & q) t ^= q - 1;
+            }
+            for (size_t i = 0; i < dim; i++) x[i] ^= t;
+        }
+
+        // Most significant bits first, coordinate 0 first within each bit level
+        inline uint64_t interleaveBits(const uint64_t *x, size_t dim, size_t num_bits) {
+            uint64_t key = 0;
+            for (size_t b = num_bits; b-- > 0;) {
+                for (size_t i = 0; i < dim; i++) {
+                    key = (key << 1) | ((x[i] >> b) & 1);
+                }
+            }
+            return key;
+        }
+    }
+
+    // Permutation that sorts the points along a Morton (Z-order) or Hilbert curve over their bounding box: order[i] is
+    // the index of the i-th point along the curve. Coordinates are quantized to 64/dim bits (at most 32, and only the
+    // first 64 dimensions are used); ties keep the input order and non-finite points go last.
+    // Nearby points end up close in memory once reordered (see reorderVectorSet()), which speeds up KD-tree
+    // construction, neighborhood queries and grid binning; Hilbert order has no long jumps, Morton keys are cheaper.
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    void computeSpaceFillingCurveOrder(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                                       std::vector<size_t> &order,
+                                       SpaceFillingCurve curve = SpaceFillingCurve::HILBERT)
+    {
+        order.resize(points.cols());
+        if (points.cols() == 0) return;
+
+        const size_t dim = std::min<size_t>(points.rows(), 64);
+        if (dim == 0) {
+            for (size_t i = 0; i < order.size(); i++) order[i] = i;
+            return;
+        }
+        const size_t num_bits = std::min<size_t>(64/dim, 32);
+        const size_t num_key_bits = num_bits*dim;
+
+        // Bounding box of the finite points
+        Eigen::VectorXd min_pt(Eigen::VectorXd::Constant(dim, std::numeric_limits<double>::infinity()));
+        Eigen::VectorXd max_pt(Eigen::VectorXd::Constant(dim, -std::numeric_limits<double>::infinity()));
+#pragma omp parallel
+        {
+            Eigen::VectorXd min_pt_private(min_pt), max_pt_private(max_pt);
+#pragma omp for nowait
+            for (size_t i = 0; i < points.cols(); i++) {
+                if (!points.col(i).allFinite()) continue;
+                for (size_t d = 0; d < dim; d++) {
+                    min_pt_private[d] = std::min(min_pt_private[d], (double)points(d,i));
+                    max_pt_private[d] = std::max(max_pt_private[d], (double)points(d,i));
+                }
+            }
+#pragma omp critical
+            {
+                min_pt = min_pt.cwiseMin(min_pt_private);
+                max_pt = max_pt.cwiseMax(max_pt_private);
+            }
+        }
+
+        const double max_coord = (double)(((uint64_t)1 << num_bits) - 1);
+        Eigen::VectorXd scale(dim);
+        for (size_t d = 0; d < dim; d++) {
+            const double extent = max_pt[d] - min_pt[d];
+            scale[d] = (extent > 0.0) ? max_coord/extent : 0.0;
+        }
+
+        // Non-finite points get a key above every finite one; without a spare key bit, they are moved out instead
+        const bool has_invalid_key = num_key_bits < 64;
+        const uint64_t invalid_key = has_invalid_key ? (uint64_t)1 << num_key_bits : 0;
+        std::vector<std::pair<uint64_t,size_t>> keys(points.cols());
+#pragma omp parallel for
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (!points.col(i).allFinite()) {
+                keys[i] = std::pair<uint64_t,size_t>(invalid_key, i);
+                continue;
+            }
+            uint64_t coords[64];
+            for (size_t d = 0; d < dim; d++) {
+                coords[d] = (uint64_t)std::min(std::max(((double)points(d,i) - min_pt[d])*scale[d], 0.0), max_coord);
+            }
+            if (curve == SpaceFillingCurve::HILBERT) internal::hilbertAxesToTranspose(coords, dim, num_bits);
+            keys[i] = std::pair<uint64_t,size_t>(internal::interleaveBits(coords, dim, num_bits), i);
+        }
+
+        if (has_invalid_key) {
+            radixSortKeyValuePairs(keys, num_key_bits + 1);
+        } else {
+            std::vector<size_t> invalid;
+            size_t num_valid = 0;
+            for (size_t i = 0; i < keys.size(); i++) {
+                if (points.col(i).allFinite()) {
+                    keys[num_valid++] = keys[i];
+                } else {
+                    invalid.emplace_back(i);
+                }
+            }
+            keys.resize(num_valid);
+            radixSortKeyValuePairs(keys, num_key_bits);
+            std::copy(invalid.begin(), invalid.end(), order.begin() + num_valid);
+        }
+#pragma omp parallel for
+        for (size_t i = 0; i < keys.size(); i++) {
+            order[i] = keys[i].second;
+        }
+    }
+
+    // result.col(i) = data.col(order[i]); result must not alias data
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    void reorderVectorSet(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &data,
+                          const std::vector<size_t> &order,
+                          VectorSet<ScalarT,EigenDim> &result)
+    {
+        result.resize(data.rows(), order.size());
+#pragma omp parallel for
+        for (size_t i = 0; i < order.size(); i++) {
+            result.col(i) = data.col(order[i]);
+        }
+    }
+
+    // In place; order receives the applied permutation (for reordering associated data, e.g. normals or colors)
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    void reorderAlongSpaceFillingCurve(VectorSet<ScalarT,EigenDim> &points,
+                                       std::vector<size_t> &order,
+                                       SpaceFillingCurve curve = SpaceFillingCurve::HILBERT)
+    {
+        computeSpaceFillingCurveOrder<ScalarT,EigenDim>(points, order, curve);
+        VectorSet<ScalarT,EigenDim> reordered;
+        reorderVectorSet<ScalarT,EigenDim>(points, order, reordered);
+        points.swap(reordered);
+    }
+}
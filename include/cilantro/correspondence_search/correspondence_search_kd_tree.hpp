@@ -6,13 +6,25 @@
 #include <cilantro/correspondence_search/correspondence_search_kd_tree_utilities.hpp>
 
 namespace cilantro {
-//    template <typename T, typename = int>
-//    struct IsIsometry : std::false_type {};
-//
-//    template <typename T>
-//    struct IsIsometry<T, decltype((void) T::Mode, 0)> : std::conditional<T::Mode == Eigen::Isometry, std::true_type, std::false_type>::type {};
-
-    template <class SearchFeatureAdaptorT, template <class> class DistAdaptor = KDTreeDistanceAdaptors::L2, class EvaluationFeatureAdaptorT = SearchFeatureAdaptorT, class EvaluatorT = DistanceEvaluator<typename SearchFeatureAdaptorT::Scalar,typename EvaluationFeatureAdaptorT::Scalar>, typename IndexT = size_t>
+    template <typename T, typename = int>
+    struct IsIsometry : std::false_type {};
+
+    template <typename T>
+    struct IsIsometry<T, decltype((void) T::Mode, 0)> : std::conditional<T::Mode == Eigen::Isometry, std::true_type, std::false_type>::type {};
+
+    // Whether distances computed by DistAdaptor are preserved by rigid motions of the feature space
+    template <template <class> class DistAdaptor, typename ScalarT, ptrdiff_t EigenDim>
+    struct IsRigidlyInvariantDistance : std::integral_constant<bool,
+            std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>>,KDTreeDistanceAdaptors::L2<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>>>::value ||
+            std::is_same<DistAdaptor<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>>,KDTreeDistanceAdaptors::L2Simple<KDTreeDataAdaptors::EigenMap<ScalarT,EigenDim>>>::value>
+    {};
+
+    // Nearest neighbor correspondences between destination and source features, optionally after transforming the source.
+    // findCorrespondences(tform) leaves the source search and evaluation adaptors' transformed features current for
+    // tform; for rigid transforms and rigidly invariant distances, searches towards the source (FIRST_TO_SECOND, BOTH)
+    // query the static source tree with inverse-transformed destination features, which also overwrites the destination
+    // search adaptor's transformed features.
+    template <class SearchFeatureAdaptorT, template <class> class DistAdaptor = KDTreeDistanceAdaptors::L2, class EvaluationFeatureAdaptorT = SearchFeatureAdaptorT, class EvaluatorT = DistanceEvaluator<typename SearchFeatureAdaptorT::Scalar,typename EvaluationFeatureAdaptorT::Scalar>, typename IndexT = size_t, class SearchTreeT = KDTree<typename SearchFeatureAdaptorT::Scalar,SearchFeatureAdaptorT::FeatureDimension,DistAdaptor,IndexT>>
     class CorrespondenceSearchKDTree {
     public:
         EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -27,7 +39,10 @@ namespace cilantro {
 
         typedef typename SearchFeatureAdaptorT::Scalar SearchFeatureScalar;
 
-        typedef KDTree<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension,DistAdaptor,CorrespondenceIndex> SearchTree;
+        typedef SearchTreeT SearchTree;
+
+        // Whether searches use the Euclidean distance, e.g. so that a tree over raw points can answer nearest point queries
+        enum { HasEuclideanSearchDistance = IsRigidlyInvariantDistance<DistAdaptor,SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>::value };
 
         template <class EvalFeatAdaptorT = EvaluationFeatureAdaptorT, class = typename std::enable_if<std::is_same<EvalFeatAdaptorT,SearchFeatureAdaptorT>::value>::type>
         CorrespondenceSearchKDTree(SearchFeatureAdaptorT &dst_features,
@@ -54,19 +69,15 @@ namespace cilantro {
         CorrespondenceSearchKDTree& findCorrespondences() {
             switch (search_dir_) {
                 case CorrespondenceSearchDirection::FIRST_TO_SECOND: {
-                    if (!src_tree_ptr_) src_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.getFeaturesMatrixMap()));
-                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), *src_tree_ptr_, false, correspondences_, max_distance_, evaluator_);
+                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), getSourceSearchTree(), false, correspondences_, max_distance_, evaluator_);
                     break;
                 }
                 case CorrespondenceSearchDirection::SECOND_TO_FIRST: {
-                    if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_search_features_adaptor_.getFeaturesMatrixMap()));
-                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(src_search_features_adaptor_.getFeaturesMatrixMap(), *dst_tree_ptr_, true, correspondences_, max_distance_, evaluator_);
+                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(src_search_features_adaptor_.getFeaturesMatrixMap(), getDestinationSearchTree(), true, correspondences_, max_distance_, evaluator_);
                     break;
                 }
                 case CorrespondenceSearchDirection::BOTH: {
-                    if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_search_features_adaptor_.getFeaturesMatrixMap()));
-                    if (!src_tree_ptr_) src_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.getFeaturesMatrixMap()));
-                    findNNCorrespondencesBidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), src_search_features_adaptor_.getFeaturesMatrixMap(), *dst_tree_ptr_, *src_tree_ptr_, correspondences_, max_distance_, require_reciprocality_, evaluator_);
+                    findNNCorrespondencesBidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), src_search_features_adaptor_.getFeaturesMatrixMap(), getDestinationSearchTree(), getSourceSearchTree(), correspondences_, corr_first_to_second_, corr_second_to_first_, max_distance_, require_reciprocality_, evaluator_);
                     break;
                 }
             }
@@ -81,73 +92,13 @@ namespace cilantro {
         // Interface for ICP use
         template <class TransformT>
         CorrespondenceSearchKDTree& findCorrespondences(const TransformT &tform) {
-
-//            if (IsIsometry<TransformT>::value && std::is_same<SearchTree,KDTree<FeatureScalar,FeatureAdaptorT::FeatureDimension,KDTreeDistanceAdaptors::L2>>::value) {
-//                // Avoid re-building tree for src if transformation is rigid and metric is L2
-//                switch (search_dir_) {
-//                    case CorrespondenceSearchDirection::FIRST_TO_SECOND: {
-//                        if (!src_tree_ptr_) src_tree_ptr_.reset(new SearchTree(src_features_adaptor_.getFeaturesMatrixMap()));
-//                        findNNCorrespondencesUnidirectional<FeatureScalar,FeatureAdaptorT::FeatureDimension,DistAdaptor,EvaluatorT>(dst_features_adaptor_.transformFeatures(tform.inverse()).getTransformedFeaturesMatrixMap(), *src_tree_ptr_, false, correspondences_, max_distance_, evaluator_);
-//                        break;
-//                    }
-//                    case CorrespondenceSearchDirection::SECOND_TO_FIRST: {
-//                        if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_features_adaptor_.getFeaturesMatrixMap()));
-//                        findNNCorrespondencesUnidirectional<FeatureScalar,FeatureAdaptorT::FeatureDimension,DistAdaptor,EvaluatorT>(src_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), *dst_tree_ptr_, true, correspondences_, max_distance_, evaluator_);
-//                        break;
-//                    }
-//                    case CorrespondenceSearchDirection::BOTH: {
-//                        if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_features_adaptor_.getFeaturesMatrixMap()));
-//                        if (!src_tree_ptr_) src_tree_ptr_.reset(new SearchTree(src_features_adaptor_.getFeaturesMatrixMap()));
-//                        findNNCorrespondencesBidirectional<FeatureScalar,FeatureAdaptorT::FeatureDimension,DistAdaptor,EvaluatorT>(dst_features_adaptor_.transformFeatures(tform.inverse()).getTransformedFeaturesMatrixMap(), src_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), *dst_tree_ptr_, *src_tree_ptr_, correspondences_, max_distance_, require_reciprocality_, evaluator_);
-//                        break;
-//                    }
-//                }
-//            } else {
-//                // General case
-//                switch (search_dir_) {
-//                    case CorrespondenceSearchDirection::FIRST_TO_SECOND: {
-//                        src_trans_tree_ptr_.reset(new SearchTree(src_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap()));
-//                        findNNCorrespondencesUnidirectional<FeatureScalar,FeatureAdaptorT::FeatureDimension,DistAdaptor,EvaluatorT>(dst_features_adaptor_.getFeaturesMatrixMap(), *src_trans_tree_ptr_, false, correspondences_, max_distance_, evaluator_);
-//                        break;
-//                    }
-//                    case CorrespondenceSearchDirection::SECOND_TO_FIRST: {
-//                        if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_features_adaptor_.getFeaturesMatrixMap()));
-//                        findNNCorrespondencesUnidirectional<FeatureScalar,FeatureAdaptorT::FeatureDimension,DistAdaptor,EvaluatorT>(src_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), *dst_tree_ptr_, true, correspondences_, max_distance_, evaluator_);
-//                        break;
-//                    }
-//                    case CorrespondenceSearchDirection::BOTH: {
-//                        if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_features_adaptor_.getFeaturesMatrixMap()));
-//                        src_trans_tree_ptr_.reset(new SearchTree(src_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap()));
-//                        findNNCorrespondencesBidirectional<FeatureScalar,FeatureAdaptorT::FeatureDimension,DistAdaptor,EvaluatorT>(dst_features_adaptor_.getFeaturesMatrixMap(), src_features_adaptor_.getTransformedFeaturesMatrixMap(), *dst_tree_ptr_, *src_trans_tree_ptr_, correspondences_, max_distance_, require_reciprocality_, evaluator_);
-//                        break;
-//                    }
-//                }
-//            }
-
             if (!std::is_same<SearchFeatureAdaptorT,EvaluationFeatureAdaptorT>::value ||
                 &src_search_features_adaptor_ != (SearchFeatureAdaptorT *)(&src_evaluation_features_adaptor_))
             {
                 src_evaluation_features_adaptor_.transformFeatures(tform);
             }
 
-            switch (search_dir_) {
-                case CorrespondenceSearchDirection::FIRST_TO_SECOND: {
-                    src_trans_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap()));
-                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), *src_trans_tree_ptr_, false, correspondences_, max_distance_, evaluator_);
-                    break;
-                }
-                case CorrespondenceSearchDirection::SECOND_TO_FIRST: {
-                    if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_search_features_adaptor_.getFeaturesMatrixMap()));
-                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), *dst_tree_ptr_, true, correspondences_, max_distance_, evaluator_);
-                    break;
-                }
-                case CorrespondenceSearchDirection::BOTH: {
-                    if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_search_features_adaptor_.getFeaturesMatrixMap()));
-                    src_trans_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap()));
-                    findNNCorrespondencesBidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), src_search_features_adaptor_.getTransformedFeaturesMatrixMap(), *dst_tree_ptr_, *src_trans_tree_ptr_, correspondences_, max_distance_, require_reciprocality_, evaluator_);
-                    break;
-                }
-            }
+            find_correspondences_transformed_(tform);
 
             filterCorrespondencesFraction(correspondences_, inlier_fraction_);
             if (one_to_one_)
@@ -158,6 +109,18 @@ namespace cilantro {
 
         inline const SearchResult& getCorrespondences() const { return correspondences_; }
 
+        // Trees over the (untransformed) search features are built on first use and shared by all subsequent
+        // searches and other users of the engine (e.g. ICP residual computation)
+        inline const SearchTree& getDestinationSearchTree() {
+            if (!dst_tree_ptr_) dst_tree_ptr_.reset(new SearchTree(dst_search_features_adaptor_.getFeaturesMatrixMap()));
+            return *dst_tree_ptr_;
+        }
+
+        inline const SearchTree& getSourceSearchTree() {
+            if (!src_tree_ptr_) src_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.getFeaturesMatrixMap()));
+            return *src_tree_ptr_;
+        }
+
         inline Evaluator& evaluator() { return evaluator_; }
 
         inline const CorrespondenceSearchDirection& getSearchDirection() const { return search_dir_; }
@@ -196,6 +159,52 @@ namespace cilantro {
         }
 
        private:
+        // Rigid transform and rigidly invariant metric: keep both trees static and query the source tree with inverse-transformed destination features
+        template <class TransformT>
+        typename std::enable_if<IsIsometry<TransformT>::value && IsRigidlyInvariantDistance<DistAdaptor,SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>::value>::type
+        find_correspondences_transformed_(const TransformT &tform) {
+            // Not needed with static trees
+            src_trans_tree_ptr_.reset();
+            switch (search_dir_) {
+                case CorrespondenceSearchDirection::FIRST_TO_SECOND: {
+                    // Only keeps the source's transformed features current, the search does not use them
+                    src_search_features_adaptor_.transformFeatures(tform);
+                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.transformFeatures(tform.inverse()).getTransformedFeaturesMatrixMap(), getSourceSearchTree(), false, correspondences_, max_distance_, evaluator_);
+                    break;
+                }
+                case CorrespondenceSearchDirection::SECOND_TO_FIRST: {
+                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), getDestinationSearchTree(), true, correspondences_, max_distance_, evaluator_);
+                    break;
+                }
+                case CorrespondenceSearchDirection::BOTH: {
+                    findNNCorrespondencesBidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.transformFeatures(tform.inverse()).getTransformedFeaturesMatrixMap(), src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), getDestinationSearchTree(), getSourceSearchTree(), correspondences_, corr_first_to_second_, corr_second_to_first_, max_distance_, require_reciprocality_, evaluator_);
+                    break;
+                }
+            }
+        }
+
+        // General case: the source tree is rebuilt on the transformed features
+        template <class TransformT>
+        typename std::enable_if<!(IsIsometry<TransformT>::value && IsRigidlyInvariantDistance<DistAdaptor,SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>::value)>::type
+        find_correspondences_transformed_(const TransformT &tform) {
+            switch (search_dir_) {
+                case CorrespondenceSearchDirection::FIRST_TO_SECOND: {
+                    src_trans_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap()));
+                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), *src_trans_tree_ptr_, false, correspondences_, max_distance_, evaluator_);
+                    break;
+                }
+                case CorrespondenceSearchDirection::SECOND_TO_FIRST: {
+                    findNNCorrespondencesUnidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), getDestinationSearchTree(), true, correspondences_, max_distance_, evaluator_);
+                    break;
+                }
+                case CorrespondenceSearchDirection::BOTH: {
+                    src_trans_tree_ptr_.reset(new SearchTree(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap()));
+                    findNNCorrespondencesBidirectional<SearchFeatureScalar,SearchFeatureAdaptorT::FeatureDimension>(dst_search_features_adaptor_.getFeaturesMatrixMap(), src_search_features_adaptor_.getTransformedFeaturesMatrixMap(), getDestinationSearchTree(), *src_trans_tree_ptr_, correspondences_, corr_first_to_second_, corr_second_to_first_, max_distance_, require_reciprocality_, evaluator_);
+                    break;
+                }
+            }
+        }
+
         SearchFeatureAdaptorT& dst_search_features_adaptor_;
         SearchFeatureAdaptorT& src_search_features_adaptor_;
 
@@ -213,5 +222,8 @@ namespace cilantro {
         bool one_to_one_;
 
         SearchResult correspondences_;
+        // Buffers for bidirectional search, kept across calls
+        SearchResult corr_first_to_second_;
+        SearchResult corr_second_to_first_;
     };
 }
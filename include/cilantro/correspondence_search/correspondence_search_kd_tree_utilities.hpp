@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits>
 #include <cilantro/core/common_pair_evaluators.hpp>
 
 namespace cilantro {
@@ -18,30 +19,36 @@ namespace cilantro {
             return;
         }
 
-        CorrSetT corr_tmp(query_pts.cols());
-        std::vector<bool> keep(query_pts.cols());
-        typename TreeT::NeighborhoodResult nn;
+        // Results are written in place (query index set to invalid on rejection) and compacted, so no temporaries are allocated
+        const CorrIndexT invalid = std::numeric_limits<CorrIndexT>::max();
+        correspondences.resize(query_pts.cols());
+        typename TreeT::NeighborResult nn;
         typename EvaluatorT::OutputScalar dist;
+        size_t count = 0;
         if (ref_is_first) {
-#pragma omp parallel for shared(corr_tmp) private(nn, dist) schedule(dynamic, 256)
+#pragma omp parallel for shared(correspondences) private(nn, dist) schedule(dynamic, 256)
             for (CorrIndexT i = 0; i < query_pts.cols(); i++) {
-                ref_tree.kNNInRadiusSearch(query_pts.col(i), 1, max_distance, nn);
-                keep[i] = !nn.empty() && (dist = evaluator(nn[0].index, i, nn[0].value)) < max_distance;
-                if (keep[i]) corr_tmp[i] = {nn[0].index, i, dist};
+                if (ref_tree.nearestNeighborInRadiusSearch(query_pts.col(i), max_distance, nn) && (dist = evaluator(nn.index, i, nn.value)) < max_distance) {
+                    correspondences[i] = {nn.index, i, dist};
+                } else {
+                    correspondences[i].indexInSecond = invalid;
+                }
+            }
+            for (size_t i = 0; i < correspondences.size(); i++) {
+                if (correspondences[i].indexInSecond != invalid) correspondences[count++] = correspondences[i];
             }
         } else {
-#pragma omp parallel for shared(corr_tmp) private(nn, dist) schedule(dynamic, 256)
+#pragma omp parallel for shared(correspondences) private(nn, dist) schedule(dynamic, 256)
             for (CorrIndexT i = 0; i < query_pts.cols(); i++) {
-                ref_tree.kNNInRadiusSearch(query_pts.col(i), 1, max_distance, nn);
-                keep[i] = !nn.empty() && (dist = evaluator(i, nn[0].index, nn[0].value)) < max_distance;
-                if (keep[i]) corr_tmp[i] = {i, nn[0].index, dist};
+                if (ref_tree.nearestNeighborInRadiusSearch(query_pts.col(i), max_distance, nn) && (dist = evaluator(i, nn.index, nn.value)) < max_distance) {
+                    correspondences[i] = {i, nn.index, dist};
+                } else {
+                    correspondences[i].indexInFirst = invalid;
+                }
+            }
+            for (size_t i = 0; i < correspondences.size(); i++) {
+                if (correspondences[i].indexInFirst != invalid) correspondences[count++] = correspondences[i];
             }
-        }
-
-        correspondences.resize(corr_tmp.size());
-        size_t count = 0;
-        for (size_t i = 0; i < corr_tmp.size(); i++) {
-            if (keep[i]) correspondences[count++] = corr_tmp[i];
         }
         correspondences.resize(count);
     }
@@ -58,17 +65,19 @@ namespace cilantro {
         return corr_set;
     }
 
+    // Variant with caller-owned buffers for the unidirectional results, for repeated calls without reallocation
     template <typename ScalarT, ptrdiff_t EigenDim, typename FirstTreeT, typename SecondTreeT, typename CorrSetT, class EvaluatorT = DistanceEvaluator<ScalarT,ScalarT>>
     void findNNCorrespondencesBidirectional(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &first_points,
                                             const ConstVectorSetMatrixMap<ScalarT,EigenDim> &second_points,
                                             const FirstTreeT &first_tree,
                                             const SecondTreeT &second_tree,
                                             CorrSetT &correspondences,
+                                            CorrSetT &corr_first_to_second,
+                                            CorrSetT &corr_second_to_first,
                                             typename EvaluatorT::OutputScalar max_distance,
                                             bool require_reciprocal = false,
                                             const EvaluatorT &evaluator = EvaluatorT())
     {
-        CorrSetT corr_first_to_second, corr_second_to_first;
         findNNCorrespondencesUnidirectional<ScalarT,EigenDim>(first_points, second_tree, false, corr_first_to_second, max_distance, evaluator);
         findNNCorrespondencesUnidirectional<ScalarT,EigenDim>(second_points, first_tree, true, corr_second_to_first, max_distance, evaluator);
 
@@ -96,6 +105,20 @@ namespace cilantro {
         }
     }
 
+    template <typename ScalarT, ptrdiff_t EigenDim, typename FirstTreeT, typename SecondTreeT, typename CorrSetT, class EvaluatorT = DistanceEvaluator<ScalarT,ScalarT>>
+    inline void findNNCorrespondencesBidirectional(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &first_points,
+                                                   const ConstVectorSetMatrixMap<ScalarT,EigenDim> &second_points,
+                                                   const FirstTreeT &first_tree,
+                                                   const SecondTreeT &second_tree,
+                                                   CorrSetT &correspondences,
+                                                   typename EvaluatorT::OutputScalar max_distance,
+                                                   bool require_reciprocal = false,
+                                                   const EvaluatorT &evaluator = EvaluatorT())
+    {
+        CorrSetT corr_first_to_second, corr_second_to_first;
+        findNNCorrespondencesBidirectional<ScalarT,EigenDim>(first_points, second_points, first_tree, second_tree, correspondences, corr_first_to_second, corr_second_to_first, max_distance, require_reciprocal, evaluator);
+    }
+
     template <typename ScalarT, ptrdiff_t EigenDim, typename FirstTreeT, typename SecondTreeT, typename CorrSetT, class EvaluatorT = DistanceEvaluator<ScalarT,ScalarT>>
     inline CorrSetT findNNCorrespondencesBidirectional(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &first_points,
                                                        const ConstVectorSetMatrixMap<ScalarT,EigenDim> &second_points,
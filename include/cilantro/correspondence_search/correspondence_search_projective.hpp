@@ -6,6 +6,10 @@
 #include <cilantro/correspondence_search/common_transformable_feature_adaptors.hpp>
 
 namespace cilantro {
+    // Correspondences between source points and the destination points rendered at their projections (index map).
+    // findCorrespondences(tform) transforms and projects the source on the fly, so the source search adaptor's
+    // transformed features are NOT updated for single transforms (a separate evaluation adaptor still is);
+    // findCorrespondences(tforms) for per point transforms updates both.
     template <class ScalarT, class EvaluationFeatureAdaptorT = PointFeaturesAdaptor<ScalarT,3>, class EvaluatorT = DistanceEvaluator<ScalarT,typename EvaluationFeatureAdaptorT::Scalar>, typename IndexT = size_t>
     class CorrespondenceSearchProjective {
     public:
@@ -28,6 +32,7 @@ namespace cilantro {
                   projection_image_width_(640), projection_image_height_(480),
                   projection_extrinsics_(RigidTransform<ScalarT,3>::Identity()),
                   projection_extrinsics_inv_(RigidTransform<ScalarT,3>::Identity()),
+                  splat_radius_((ScalarT)0.0), max_splat_pixel_radius_(8), search_window_radius_(0),
                   max_distance_((CorrespondenceScalar)(0.01*0.01)), inlier_fraction_(1.0)
         {
             // "Kinect"-like defaults
@@ -43,6 +48,7 @@ namespace cilantro {
                   projection_image_width_(640), projection_image_height_(480),
                   projection_extrinsics_(RigidTransform<ScalarT,3>::Identity()),
                   projection_extrinsics_inv_(RigidTransform<ScalarT,3>::Identity()),
+                  splat_radius_((ScalarT)0.0), max_splat_pixel_radius_(8), search_window_radius_(0),
                   max_distance_((CorrespondenceScalar)(0.01*0.01)), inlier_fraction_(1.0)
         {
             // "Kinect"-like defaults
@@ -50,11 +56,15 @@ namespace cilantro {
         }
 
         inline CorrespondenceSearchProjective& findCorrespondences() {
-            find_correspondences_(src_search_features_adaptor_.getFeaturesMatrixMap(), correspondences_);
+            find_correspondences_(src_search_features_adaptor_.getFeaturesMatrixMap(), RigidTransform<ScalarT,3>::Identity(), correspondences_);
             return *this;
         }
 
         // Interface for ICP use
+        // Source points are transformed and projected on the fly: after the call, getTransformedFeaturesMatrixMap()
+        // of the source search adaptor still holds the features of its last transformFeatures() call, not tform
+        // applied to the source; call src_points.transformFeatures(tform) if they are needed. A separate evaluation
+        // adaptor is transformed by tform.
         template <class TransformT>
         inline CorrespondenceSearchProjective& findCorrespondences(const TransformT &tform) {
             if (!std::is_same<PointFeaturesAdaptor<ScalarT,3>,EvaluationFeatureAdaptorT>::value ||
@@ -62,7 +72,19 @@ namespace cilantro {
             {
                 src_evaluation_features_adaptor_.transformFeatures(tform);
             }
-            find_correspondences_(src_search_features_adaptor_.transformFeatures(tform).getTransformedFeaturesMatrixMap(), correspondences_);
+            find_correspondences_(src_search_features_adaptor_.getFeaturesMatrixMap(), tform, correspondences_);
+            return *this;
+        }
+
+        // Per point transforms (warp fields)
+        template <class TransformT>
+        inline CorrespondenceSearchProjective& findCorrespondences(const TransformSet<TransformT> &tforms) {
+            if (!std::is_same<PointFeaturesAdaptor<ScalarT,3>,EvaluationFeatureAdaptorT>::value ||
+                &src_search_features_adaptor_ != (PointFeaturesAdaptor<ScalarT,3> *)(&src_evaluation_features_adaptor_))
+            {
+                src_evaluation_features_adaptor_.transformFeatures(tforms);
+            }
+            find_correspondences_(src_search_features_adaptor_.transformFeatures(tforms).getTransformedFeaturesMatrixMap(), RigidTransform<ScalarT,3>::Identity(), correspondences_);
             return *this;
         }
 
@@ -105,6 +127,33 @@ namespace cilantro {
             return *this;
         }
 
+        inline ScalarT getDestinationSplatRadius() const { return splat_radius_; }
+
+        // Destination points are rendered as disks of this (world) radius, so that sparse or downsampled clouds
+        // leave fewer holes in the index map; zero renders single pixels
+        inline CorrespondenceSearchProjective& setDestinationSplatRadius(ScalarT radius) {
+            splat_radius_ = radius;
+            index_map_.resize(0,0);
+            return *this;
+        }
+
+        inline size_t getMaxSplatPixelRadius() const { return max_splat_pixel_radius_; }
+
+        inline CorrespondenceSearchProjective& setMaxSplatPixelRadius(size_t radius) {
+            max_splat_pixel_radius_ = radius;
+            index_map_.resize(0,0);
+            return *this;
+        }
+
+        inline size_t getSearchWindowRadius() const { return search_window_radius_; }
+
+        // Every source point is matched to the best (lowest evaluator value) destination candidate in the
+        // (2*radius + 1)x(2*radius + 1) pixel window around its projection
+        inline CorrespondenceSearchProjective& setSearchWindowRadius(size_t radius) {
+            search_window_radius_ = radius;
+            return *this;
+        }
+
         inline CorrespondenceScalar getMaxDistance() const { return max_distance_; }
 
         inline CorrespondenceSearchProjective& setMaxDistance(CorrespondenceScalar dist_thresh) {
@@ -126,57 +175,116 @@ namespace cilantro {
         EvaluationFeatureAdaptorT& src_evaluation_features_adaptor_;
         Evaluator& evaluator_;
 
-        Eigen::Matrix<IndexT,Eigen::Dynamic,Eigen::Dynamic> index_map_;
+        ProjectionZBuffer<ScalarT,IndexT> index_map_;
         Eigen::Matrix<ScalarT,3,3> projection_intrinsics_;
         size_t projection_image_width_;
         size_t projection_image_height_;
         RigidTransform<ScalarT,3> projection_extrinsics_;
         RigidTransform<ScalarT,3> projection_extrinsics_inv_;
 
+        ScalarT splat_radius_;
+        size_t max_splat_pixel_radius_;
+        size_t search_window_radius_;
+
         CorrespondenceScalar max_distance_;
         double inlier_fraction_;
 
         SearchResult correspondences_;
 
-        void find_correspondences_(const ConstVectorSetMatrixMap<ScalarT,3>& src_points_trans, SearchResult &correspondences) {
-            const ConstVectorSetMatrixMap<ScalarT,3>& dst_points(dst_search_features_adaptor_.getFeaturesMatrixMap());
+        enum { ProjectionBlockSize = 256 };
 
-            if (index_map_.rows() != projection_image_width_ || index_map_.cols() != projection_image_height_) {
-                index_map_.resize(projection_image_width_, projection_image_height_);
-                pointsToIndexMap<ScalarT,IndexT>(dst_points, projection_extrinsics_, projection_intrinsics_, index_map_.data(), projection_image_width_, projection_image_height_);
+        inline void update_index_map_() {
+            if (index_map_.getImageWidth() == projection_image_width_ && index_map_.getImageHeight() == projection_image_height_) return;
+
+            const ConstVectorSetMatrixMap<ScalarT,3>& dst_points(dst_search_features_adaptor_.getFeaturesMatrixMap());
+            index_map_.resize(projection_image_width_, projection_image_height_);
+            if (splat_radius_ > (ScalarT)0.0) {
+                index_map_.splatPoints(dst_points, projection_extrinsics_, projection_intrinsics_, splat_radius_, max_splat_pixel_radius_);
+            } else {
+                index_map_.projectPoints(dst_points, projection_extrinsics_, projection_intrinsics_);
             }
+        }
 
+        // Keeps the best destination candidate in the search window around pixel (x,y)
+        template <class PointT>
+        inline void match_pixel_(size_t x, size_t y, IndexT i, const PointT &src_pt_trans, Correspondence<CorrespondenceScalar,IndexT> &corr) {
+            const ConstVectorSetMatrixMap<ScalarT,3>& dst_points(dst_search_features_adaptor_.getFeaturesMatrixMap());
             const IndexT empty = std::numeric_limits<IndexT>::max();
-            SearchResult corr_tmp(src_points_trans.cols());
+
+            const size_t x_min = (x > search_window_radius_) ? x - search_window_radius_ : 0;
+            const size_t x_max = std::min(x + search_window_radius_, projection_image_width_ - 1);
+            const size_t y_min = (y > search_window_radius_) ? y - search_window_radius_ : 0;
+            const size_t y_max = std::min(y + search_window_radius_, projection_image_height_ - 1);
+            for (size_t wy = y_min; wy <= y_max; wy++) {
+                for (size_t wx = x_min; wx <= x_max; wx++) {
+                    IndexT ind = index_map_.getIndex(wx, wy);
+                    if (ind == empty) continue;
+                    const CorrespondenceScalar value = evaluator_(ind, i, (src_pt_trans - dst_points.col(ind)).squaredNorm());
+                    if (value < corr.value) {
+                        corr.indexInFirst = ind;
+                        corr.indexInSecond = i;
+                        corr.value = value;
+                    }
+                }
+            }
+        }
+
+        // Fused transform and projection: source points are processed in blocks; camera frame coordinates are stored
+        // coordinate-wise (row-major), so that pixel coordinates are computed with packet operations on contiguous rows
+        template <class TransformT>
+        void find_correspondences_(const ConstVectorSetMatrixMap<ScalarT,3>& src_points, const TransformT &tform, SearchResult &correspondences) {
+            typedef Eigen::Matrix<ScalarT,3,Eigen::Dynamic,0,3,ProjectionBlockSize> BlockPoints;
+            typedef Eigen::Matrix<ScalarT,3,Eigen::Dynamic,Eigen::RowMajor,3,ProjectionBlockSize> BlockCameraPoints;
+            typedef Eigen::Array<ScalarT,1,Eigen::Dynamic,Eigen::RowMajor,1,ProjectionBlockSize> BlockCoordinates;
+
+            update_index_map_();
+
             const CorrespondenceScalar value_to_reject = max_distance_ + (CorrespondenceScalar)1.0;
 
+            const Eigen::Matrix<ScalarT,3,3> rot(tform.linear());
+            const Vector<ScalarT,3> trans(tform.translation());
+            const Eigen::Matrix<ScalarT,3,3> rot_cam(projection_extrinsics_inv_.linear());
+            const Vector<ScalarT,3> trans_cam(projection_extrinsics_inv_.translation());
+            const ScalarT fx = projection_intrinsics_(0,0), fy = projection_intrinsics_(1,1);
+            const ScalarT cx = projection_intrinsics_(0,2), cy = projection_intrinsics_(1,2);
+
+            const size_t num_points = src_points.cols();
+            const size_t num_blocks = (num_points + ProjectionBlockSize - 1)/ProjectionBlockSize;
+
+            // Written in place and compacted, so that repeated calls do not allocate
+            correspondences.resize(num_points);
 #pragma omp parallel
             {
-#pragma omp for
-                for (size_t i = 0; i < corr_tmp.size(); i++) {
-                    corr_tmp[i].value = value_to_reject;
-                }
-
-                Vector<ScalarT,3> src_pt_trans_cam;
-#pragma omp for schedule(dynamic, 256)
-                for (IndexT i = 0; i < src_points_trans.cols(); i++) {
-                    src_pt_trans_cam.noalias() = projection_extrinsics_inv_*src_points_trans.col(i);
-                    if (src_pt_trans_cam(2) <= (ScalarT)0.0) continue;
-                    size_t x = (size_t)std::llround(src_pt_trans_cam(0)*projection_intrinsics_(0,0)/src_pt_trans_cam(2) + projection_intrinsics_(0,2));
-                    size_t y = (size_t)std::llround(src_pt_trans_cam(1)*projection_intrinsics_(1,1)/src_pt_trans_cam(2) + projection_intrinsics_(1,2));
-                    if (x >= projection_image_width_ || y >= projection_image_height_) continue;
-                    IndexT ind = index_map_(x,y);
-                    if (ind == empty) continue;
-                    corr_tmp[i].indexInFirst = ind;
-                    corr_tmp[i].indexInSecond = i;
-                    corr_tmp[i].value = evaluator_(ind, i, (src_points_trans.col(i) - dst_points.col(ind)).squaredNorm());
+                BlockPoints pts_trans;
+                BlockCameraPoints pts_cam;
+                BlockCoordinates z, u, v;
+#pragma omp for schedule(dynamic)
+                for (size_t b = 0; b < num_blocks; b++) {
+                    const size_t start = b*ProjectionBlockSize;
+                    const size_t count = std::min<size_t>(ProjectionBlockSize, num_points - start);
+
+                    pts_trans.noalias() = rot*src_points.middleCols(start, count);
+                    pts_trans.colwise() += trans;
+                    pts_cam.noalias() = rot_cam*pts_trans;
+                    z = pts_cam.row(2).array() + trans_cam[2];
+                    u = fx*(pts_cam.row(0).array() + trans_cam[0])/z + cx;
+                    v = fy*(pts_cam.row(1).array() + trans_cam[1])/z + cy;
+
+                    for (size_t k = 0; k < count; k++) {
+                        Correspondence<CorrespondenceScalar,IndexT> &corr = correspondences[start + k];
+                        corr.value = value_to_reject;
+                        if (z[k] <= (ScalarT)0.0) continue;
+                        size_t x = (size_t)std::llround(u[k]);
+                        size_t y = (size_t)std::llround(v[k]);
+                        if (x >= projection_image_width_ || y >= projection_image_height_) continue;
+                        match_pixel_(x, y, (IndexT)(start + k), pts_trans.col(k), corr);
+                    }
                 }
             }
 
-            correspondences.resize(corr_tmp.size());
             size_t count = 0;
-            for (size_t i = 0; i < corr_tmp.size(); i++) {
-                if (corr_tmp[i].value < max_distance_) correspondences[count++] = corr_tmp[i];
+            for (size_t i = 0; i < correspondences.size(); i++) {
+                if (correspondences[i].value < max_distance_) correspondences[count++] = correspondences[i];
             }
             correspondences.resize(count);
 
@@ -3,10 +3,34 @@
 #include <vector>
 #include <algorithm>
 #include <random>
+#include <cmath>
+#include <type_traits>
 #include <Eigen/Dense>
 
 namespace cilantro {
+    namespace internal {
+        // Detects the optional single point residual interface: ResidualScalar computeResidual(const Model&, size_t)
+        template <class ModelEstimatorT, class ModelT>
+        struct HasPointResidual {
+            template <class T>
+            static auto test(int) -> decltype(std::declval<T&>().computeResidual(std::declval<const ModelT&>(), (size_t)0), std::true_type());
+
+            template <class>
+            static std::false_type test(...);
+
+            enum { value = decltype(test<ModelEstimatorT>(0))::value };
+        };
+    }
+
     // CRTP base class
+    // Derived estimators provide getDataPointsCount(), estimateModel(sample_ind, model) and
+    // computeResiduals(model, residuals); adaptive estimation also uses computeResidual(model, point_ind) if available.
+    // By default, hypotheses are evaluated one by one until max_iter or the target inlier count is reached.
+    // In adaptive mode, batches of hypotheses are evaluated in parallel (estimateModel() must be thread safe), the
+    // required number of iterations is updated from the best inlier ratio so far and the confidence level, and
+    // hypotheses are scored preemptively: a hypothesis is rejected if its inlier count on a fixed random subset of
+    // the data is significantly (three standard deviations) below that expected at the best inlier ratio so far,
+    // and full inlier counting bails out as soon as the best count cannot be exceeded.
     template <class ModelEstimatorT, class ModelT, typename ResidualScalarT, typename IndexT = size_t>
     class RandomSampleConsensusBase {
     public:
@@ -28,6 +52,10 @@ namespace cilantro {
                   max_iter_(max_iter),
                   inlier_dist_thresh_(inlier_dist_thresh),
                   re_estimate_(re_estimate),
+                  adaptive_(false),
+                  confidence_(0.99),
+                  batch_size_(16),
+                  preemptive_test_size_(1000),
                   iteration_count_(0)
         {}
 
@@ -66,6 +94,35 @@ namespace cilantro {
             return *static_cast<ModelEstimatorT*>(this);
         }
 
+        inline bool getAdaptiveTermination() const { return adaptive_; }
+
+        inline ModelEstimatorT& setAdaptiveTermination(bool adaptive) {
+            adaptive_ = adaptive;
+            return *static_cast<ModelEstimatorT*>(this);
+        }
+
+        inline double getConfidence() const { return confidence_; }
+
+        inline ModelEstimatorT& setConfidence(double confidence) {
+            confidence_ = confidence;
+            return *static_cast<ModelEstimatorT*>(this);
+        }
+
+        inline size_t getHypothesisBatchSize() const { return batch_size_; }
+
+        inline ModelEstimatorT& setHypothesisBatchSize(size_t batch_size) {
+            batch_size_ = batch_size;
+            return *static_cast<ModelEstimatorT*>(this);
+        }
+
+        inline size_t getPreemptiveTestSize() const { return preemptive_test_size_; }
+
+        // Size of the random subset used for preemptive hypothesis rejection (0 disables it)
+        inline ModelEstimatorT& setPreemptiveTestSize(size_t test_size) {
+            preemptive_test_size_ = test_size;
+            return *static_cast<ModelEstimatorT*>(this);
+        }
+
         ModelEstimatorT& estimate() {
             ModelEstimatorT& estimator = *static_cast<ModelEstimatorT*>(this);
             const size_t num_points = estimator.getDataPointsCount();
@@ -81,55 +138,53 @@ namespace cilantro {
             std::shuffle(perm.begin(), perm.end(), rng);
             auto sample_start_it = perm.begin();
 
-            // Random sample results
-            Model curr_params;
-            ResidualVector curr_residuals;
-            IndexVector curr_inliers;
-
+            model_residuals_.clear();
+            model_inliers_.clear();
             iteration_count_ = 0;
-            while (iteration_count_ < max_iter_) {
-                // Pick a random sample
-                if (std::distance(sample_start_it, perm.end()) < sample_size_) {
-                    std::shuffle(perm.begin(), perm.end(), rng);
-                    sample_start_it = perm.begin();
-                }
-                IndexVector sample_ind(sample_start_it, sample_start_it + sample_size_);
-                sample_start_it += sample_size_;
-
-                // Fit model to sample and get its inliers
-                estimator.estimateModel(sample_ind, curr_params);
-                estimator.computeResiduals(curr_params, curr_residuals);
-                curr_inliers.resize(num_points);
-                size_t k = 0;
-                for (Index i = 0; i < num_points; i++) {
-                    if (curr_residuals[i] <= inlier_dist_thresh_) curr_inliers[k++] = i;
-                }
-                curr_inliers.resize(k);
-
-                iteration_count_++;
-                if (curr_inliers.size() < sample_size_) continue;
 
-                // Update best found
-                if (curr_inliers.size() > model_inliers_.size()) {
-                    model_params_ = curr_params;
-                    model_residuals_ = std::move(curr_residuals);
-                    model_inliers_ = std::move(curr_inliers);
+            if (adaptive_) {
+                estimate_adaptive_(estimator, perm, rng);
+            } else {
+                // Random sample results; buffers are swapped with the best ones, so they are only allocated once
+                Model curr_params;
+                ResidualVector curr_residuals;
+                IndexVector curr_inliers;
+                IndexVector sample_ind;
+
+                while (iteration_count_ < max_iter_) {
+                    // Pick a random sample
+                    if (std::distance(sample_start_it, perm.end()) < sample_size_) {
+                        std::shuffle(perm.begin(), perm.end(), rng);
+                        sample_start_it = perm.begin();
+                    }
+                    sample_ind.assign(sample_start_it, sample_start_it + sample_size_);
+                    sample_start_it += sample_size_;
+
+                    // Fit model to sample and get its inliers
+                    estimator.estimateModel(sample_ind, curr_params);
+                    estimator.computeResiduals(curr_params, curr_residuals);
+                    get_inliers_(curr_residuals, curr_inliers);
+
+                    iteration_count_++;
+                    if (curr_inliers.size() < sample_size_) continue;
+
+                    // Update best found
+                    if (curr_inliers.size() > model_inliers_.size()) {
+                        model_params_ = curr_params;
+                        std::swap(model_residuals_, curr_residuals);
+                        std::swap(model_inliers_, curr_inliers);
+                    }
+
+                    // Check if target inlier count was reached
+                    if (model_inliers_.size() >= inlier_count_thresh_) break;
                 }
-
-                // Check if target inlier count was reached
-                if (model_inliers_.size() >= inlier_count_thresh_) break;
             }
 
             // Re-estimate
             if (re_estimate_) {
                 estimator.estimateModel(model_inliers_, model_params_);
                 estimator.computeResiduals(model_params_, model_residuals_);
-                model_inliers_.resize(num_points);
-                size_t k = 0;
-                for (Index i = 0; i < num_points; i++){
-                    if (model_residuals_[i] <= inlier_dist_thresh_) model_inliers_[k++] = i;
-                }
-                model_inliers_.resize(k);
+                get_inliers_(model_residuals_, model_inliers_);
             }
 
             return estimator;
@@ -189,11 +244,130 @@ namespace cilantro {
         size_t max_iter_;
         ResidualScalar inlier_dist_thresh_;
         bool re_estimate_;
+        bool adaptive_;
+        double confidence_;
+        size_t batch_size_;
+        size_t preemptive_test_size_;
 
         // Object state and results
         size_t iteration_count_;
         Model model_params_;
         ResidualVector model_residuals_;
         IndexVector model_inliers_;
+
+        inline void get_inliers_(const ResidualVector &residuals, IndexVector &inliers) const {
+            inliers.resize(residuals.size());
+            size_t k = 0;
+            for (Index i = 0; i < residuals.size(); i++) {
+                if (residuals[i] <= inlier_dist_thresh_) inliers[k++] = i;
+            }
+            inliers.resize(k);
+        }
+
+        // Number of iterations needed to draw an all-inlier sample with probability confidence_
+        inline size_t get_required_iterations_(size_t num_inliers, size_t num_points) const {
+            if (num_inliers == 0 || num_points == 0) return max_iter_;
+            const double sample_inlier_prob = std::pow((double)num_inliers/num_points, (double)sample_size_);
+            if (sample_inlier_prob >= 1.0) return 0;
+            const double num_iter = std::log(1.0 - confidence_)/std::log(1.0 - sample_inlier_prob);
+            return (!(num_iter < (double)max_iter_)) ? max_iter_ : (size_t)std::ceil(num_iter);
+        }
+
+        // Exact inlier count, unless the hypothesis is rejected early (any count not above best_count)
+        template <class EstimatorT = ModelEstimatorT>
+        typename std::enable_if<internal::HasPointResidual<EstimatorT,Model>::value,size_t>::type
+        score_hypothesis_(EstimatorT &estimator,
+                          const Model &model,
+                          const IndexVector &test_ind,
+                          size_t best_count,
+                          size_t num_points,
+                          ResidualVector &) const
+        {
+            if (best_count > 0 && !test_ind.empty()) {
+                size_t test_count = 0;
+                for (size_t i = 0; i < test_ind.size(); i++) {
+                    if (estimator.computeResidual(model, test_ind[i]) <= inlier_dist_thresh_) test_count++;
+                }
+                const double ratio = (double)best_count/num_points;
+                const double expected = ratio*test_ind.size();
+                if (test_count + 3.0*std::sqrt(expected*(1.0 - ratio)) < expected) return 0;
+            }
+
+            size_t count = 0;
+            for (size_t i = 0; i < num_points; i++) {
+                if (estimator.computeResidual(model, i) <= inlier_dist_thresh_) count++;
+                if ((i & 4095) == 4095 && count + (num_points - i - 1) <= best_count) return count;
+            }
+            return count;
+        }
+
+        template <class EstimatorT = ModelEstimatorT>
+        typename std::enable_if<!internal::HasPointResidual<EstimatorT,Model>::value,size_t>::type
+        score_hypothesis_(EstimatorT &estimator,
+                          const Model &model,
+                          const IndexVector &,
+                          size_t,
+                          size_t,
+                          ResidualVector &residuals) const
+        {
+            estimator.computeResiduals(model, residuals);
+            size_t count = 0;
+            for (size_t i = 0; i < residuals.size(); i++) {
+                if (residuals[i] <= inlier_dist_thresh_) count++;
+            }
+            return count;
+        }
+
+        void estimate_adaptive_(ModelEstimatorT &estimator, IndexVector &perm, std::mt19937 &rng) {
+            const size_t num_points = perm.size();
+            const size_t batch_size = std::max<size_t>(batch_size_, 1);
+            const IndexVector test_ind(perm.begin(), perm.begin() + std::min(num_points, preemptive_test_size_));
+            auto sample_start_it = perm.begin();
+
+            std::vector<IndexVector> samples(batch_size);
+            std::vector<Model,Eigen::aligned_allocator<Model>> models(batch_size);
+            std::vector<size_t> counts(batch_size);
+
+            size_t best_count = 0;
+            size_t required_iter = max_iter_;
+            while (iteration_count_ < required_iter) {
+                // Samples are drawn sequentially, so results only depend on the random seed
+                const size_t curr_batch_size = std::min(batch_size, required_iter - iteration_count_);
+                for (size_t b = 0; b < curr_batch_size; b++) {
+                    if (std::distance(sample_start_it, perm.end()) < sample_size_) {
+                        std::shuffle(perm.begin(), perm.end(), rng);
+                        sample_start_it = perm.begin();
+                    }
+                    samples[b].assign(sample_start_it, sample_start_it + sample_size_);
+                    sample_start_it += sample_size_;
+                }
+
+#pragma omp parallel
+                {
+                    ResidualVector residuals;
+#pragma omp for schedule(dynamic)
+                    for (size_t b = 0; b < curr_batch_size; b++) {
+                        estimator.estimateModel(samples[b], models[b]);
+                        counts[b] = score_hypothesis_(estimator, models[b], test_ind, best_count, num_points, residuals);
+                    }
+                }
+
+                iteration_count_ += curr_batch_size;
+                for (size_t b = 0; b < curr_batch_size; b++) {
+                    if (counts[b] >= sample_size_ && counts[b] > best_count) {
+                        best_count = counts[b];
+                        model_params_ = models[b];
+                    }
+                }
+
+                if (best_count >= inlier_count_thresh_) break;
+                required_iter = get_required_iterations_(best_count, num_points);
+            }
+
+            if (best_count > 0) {
+                estimator.computeResiduals(model_params_, model_residuals_);
+                get_inliers_(model_residuals_, model_inliers_);
+            }
+        }
     };
 }
@@ -47,12 +47,17 @@ namespace cilantro {
                                                            typename Base::ResidualVector &residuals)
         {
             residuals.resize(points_.cols());
+#pragma omp parallel for
             for (size_t i = 0; i < points_.cols(); i++) {
                 residuals[i] = model_params.absDistance(points_.col(i));
             }
             return *this;
         }
 
+        inline ScalarT computeResidual(const Eigen::Hyperplane<ScalarT,EigenDim> &model_params, size_t point_ind) const {
+            return model_params.absDistance(points_.col(point_ind));
+        }
+
         inline typename Base::ResidualVector computeResiduals(const Eigen::Hyperplane<ScalarT,EigenDim> &model_params) {
             typename Base::ResidualVector residuals;
             computeResiduals(model_params, residuals);
@@ -99,6 +99,10 @@ namespace cilantro {
             return *this;
         }
 
+        inline Scalar computeResidual(const TransformT &model_params, size_t point_ind) const {
+            return (model_params*src_points_.col(point_ind) - dst_points_.col(point_ind)).norm();
+        }
+
         inline typename Base::ResidualVector computeResiduals(const TransformT &model_params) {
             typename Base::ResidualVector residuals;
             computeResiduals(model_params, residuals);
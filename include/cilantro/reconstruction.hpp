@@ -0,0 +1,3 @@
+#pragma once
+
+#include <cilantro/reconstruction/tsdf_volume.hpp>
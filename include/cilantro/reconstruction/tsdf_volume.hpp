@@ -0,0 +1,424 @@
+#pragma once
+
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <cilantro/core/grid_accumulator.hpp>
+#include <cilantro/core/image_point_cloud_conversions.hpp>
+
+namespace cilantro {
+    template <typename ScalarT>
+    struct TSDFVoxel {
+        // Truncated signed distance, normalized to [-1,1]
+        ScalarT sdf;
+        ScalarT weight;
+        Eigen::Matrix<float,3,1> color;
+
+        inline TSDFVoxel() : sdf((ScalarT)1.0), weight((ScalarT)0.0), color(Eigen::Matrix<float,3,1>::Zero()) {}
+    };
+
+    // Sparse TSDF volume made of fixed-size voxel blocks that are allocated on demand around observed surfaces
+    // and indexed by a hash map on block coordinates. Integration only touches the blocks visible in each frame.
+    template <typename ScalarT, size_t BlockSideLength = 8>
+    class TSDFVolume {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef ScalarT Scalar;
+        typedef TSDFVoxel<ScalarT> Voxel;
+        typedef Eigen::Vector3i BlockCoordinates;
+
+        enum { BlockSize = BlockSideLength, BlockVolume = BlockSideLength*BlockSideLength*BlockSideLength };
+
+        typedef std::array<Voxel,BlockVolume> VoxelBlock;
+
+        TSDFVolume(ScalarT voxel_size, ScalarT truncation_distance = (ScalarT)0.0)
+                : voxel_size_(voxel_size),
+                  truncation_distance_((truncation_distance > (ScalarT)0.0) ? truncation_distance : 4*voxel_size),
+                  max_weight_((ScalarT)128.0),
+                  max_ray_length_((ScalarT)5.0)
+        {}
+
+        inline ScalarT getVoxelSize() const { return voxel_size_; }
+
+        inline ScalarT getTruncationDistance() const { return truncation_distance_; }
+
+        inline TSDFVolume& setTruncationDistance(ScalarT truncation_distance) {
+            truncation_distance_ = truncation_distance;
+            return *this;
+        }
+
+        inline ScalarT getMaxWeight() const { return max_weight_; }
+
+        inline TSDFVolume& setMaxWeight(ScalarT max_weight) {
+            max_weight_ = max_weight;
+            return *this;
+        }
+
+        inline ScalarT getMaxRayLength() const { return max_ray_length_; }
+
+        inline TSDFVolume& setMaxRayLength(ScalarT max_length) {
+            max_ray_length_ = max_length;
+            return *this;
+        }
+
+        inline size_t getNumberOfBlocks() const { return blocks_.size(); }
+
+        inline const std::vector<BlockCoordinates>& getBlockCoordinates() const { return block_coords_; }
+
+        inline const std::vector<VoxelBlock>& getBlocks() const { return blocks_; }
+
+        // Indices (into getBlocks()) of the blocks updated by the last integration
+        inline const std::vector<size_t>& getVisibleBlockIndices() const { return visible_blocks_; }
+
+        inline TSDFVolume& clear() {
+            blocks_.clear();
+            block_coords_.clear();
+            block_map_.clear();
+            visible_blocks_.clear();
+            return *this;
+        }
+
+        // Extrinsics map camera to volume (world) coordinates
+        template <class DepthConverterT>
+        inline TSDFVolume& integrate(const typename DepthConverterT::RawDepth* depth_data,
+                                     const DepthConverterT &depth_converter,
+                                     size_t image_w, size_t image_h,
+                                     const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                     const RigidTransform<ScalarT,3> &extrinsics)
+        {
+            integrate_(NULL, depth_data, depth_converter, image_w, image_h, intrinsics, extrinsics);
+            return *this;
+        }
+
+        template <class DepthConverterT>
+        inline TSDFVolume& integrate(const unsigned char* rgb_data,
+                                     const typename DepthConverterT::RawDepth* depth_data,
+                                     const DepthConverterT &depth_converter,
+                                     size_t image_w, size_t image_h,
+                                     const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                     const RigidTransform<ScalarT,3> &extrinsics)
+        {
+            integrate_(rgb_data, depth_data, depth_converter, image_w, image_h, intrinsics, extrinsics);
+            return *this;
+        }
+
+        // Renders the surface seen from the given camera; output is in volume (world) coordinates.
+        // If keep_invalid is true, outputs are image_w*image_h in row-major pixel order, with NaNs for pixels without a hit.
+        void raycast(const RigidTransform<ScalarT,3> &extrinsics,
+                     const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                     size_t image_w, size_t image_h,
+                     VectorSet<ScalarT,3> &points,
+                     VectorSet<ScalarT,3> &normals,
+                     bool keep_invalid = false) const
+        {
+            const ScalarT nan = std::numeric_limits<ScalarT>::quiet_NaN();
+            VectorSet<ScalarT,3> points_tmp(3, image_w*image_h);
+            VectorSet<ScalarT,3> normals_tmp(3, image_w*image_h);
+            const Vector<ScalarT,3> origin(extrinsics.translation());
+            const ScalarT block_length = BlockSideLength*voxel_size_;
+            size_t valid_count = 0;
+
+#pragma omp parallel for reduction (+: valid_count) schedule(dynamic)
+            for (size_t y = 0; y < image_h; y++) {
+                BlockLookupCache cache;
+                Vector<ScalarT,3> dir, pt, normal;
+                for (size_t x = 0; x < image_w; x++) {
+                    const size_t k = y*image_w + x;
+                    points_tmp.col(k).setConstant(nan);
+                    normals_tmp.col(k).setConstant(nan);
+
+                    dir = extrinsics.linear()*Vector<ScalarT,3>((x - intrinsics(0,2))/intrinsics(0,0), (y - intrinsics(1,2))/intrinsics(1,1), (ScalarT)1.0).normalized();
+
+                    ScalarT t = voxel_size_, t_prev = (ScalarT)0.0, sdf, sdf_prev = (ScalarT)0.0;
+                    bool prev_valid = false;
+                    while (t < max_ray_length_) {
+                        pt.noalias() = origin + t*dir;
+                        if (!interpolate_sdf_(pt, sdf, NULL, cache)) {
+                            prev_valid = false;
+                            t += (get_voxel_(world_to_voxel_(pt), cache) == NULL) ? block_length : voxel_size_;
+                            continue;
+                        }
+                        if (sdf < (ScalarT)0.0) {
+                            if (prev_valid) {
+                                pt.noalias() = origin + (t_prev + (t - t_prev)*sdf_prev/(sdf_prev - sdf))*dir;
+                                if (compute_normal_(pt, normal, cache)) {
+                                    points_tmp.col(k) = pt;
+                                    normals_tmp.col(k) = normal;
+                                    valid_count++;
+                                }
+                            }
+                            break;
+                        }
+                        t_prev = t;
+                        sdf_prev = sdf;
+                        prev_valid = true;
+                        t += std::max(voxel_size_, sdf*truncation_distance_);
+                    }
+                }
+            }
+
+            if (keep_invalid) {
+                points.swap(points_tmp);
+                normals.swap(normals_tmp);
+            } else {
+                points.resize(3, valid_count);
+                normals.resize(3, valid_count);
+                size_t k = 0;
+                for (size_t i = 0; i < points_tmp.cols(); i++) {
+                    if (!std::isnan(points_tmp(0,i))) {
+                        points.col(k) = points_tmp.col(i);
+                        normals.col(k) = normals_tmp.col(i);
+                        k++;
+                    }
+                }
+            }
+        }
+
+        // Zero crossings along voxel edges, for voxels observed with at least min_weight
+        inline void extractPoints(VectorSet<ScalarT,3> &points, ScalarT min_weight = (ScalarT)1.0) const {
+            extract_surface_(points, NULL, NULL, min_weight);
+        }
+
+        inline void extractPointsNormals(VectorSet<ScalarT,3> &points, VectorSet<ScalarT,3> &normals, ScalarT min_weight = (ScalarT)1.0) const {
+            extract_surface_(points, &normals, NULL, min_weight);
+        }
+
+        inline void extractPointsNormalsColors(VectorSet<ScalarT,3> &points, VectorSet<ScalarT,3> &normals, VectorSet<float,3> &colors, ScalarT min_weight = (ScalarT)1.0) const {
+            extract_surface_(points, &normals, &colors, min_weight);
+        }
+
+    private:
+        typedef std::unordered_map<BlockCoordinates,size_t,EigenVectorHasher<int,3>> BlockMap;
+
+        struct BlockLookupCache {
+            inline BlockLookupCache() : valid(false), block(NULL) {}
+
+            bool valid;
+            BlockCoordinates coords;
+            const VoxelBlock * block;
+        };
+
+        ScalarT voxel_size_;
+        ScalarT truncation_distance_;
+        ScalarT max_weight_;
+        ScalarT max_ray_length_;
+
+        std::vector<VoxelBlock> blocks_;
+        std::vector<BlockCoordinates> block_coords_;
+        BlockMap block_map_;
+        std::vector<size_t> visible_blocks_;
+
+        static inline int floor_div_(int a, int b) { return (a >= 0) ? a/b : -((b - 1 - a)/b); }
+
+        static inline size_t local_index_(int x, int y, int z) { return (z*BlockSideLength + y)*BlockSideLength + x; }
+
+        inline Eigen::Vector3i world_to_voxel_(const Vector<ScalarT,3> &p) const {
+            return Eigen::Vector3i((int)std::floor(p[0]/voxel_size_), (int)std::floor(p[1]/voxel_size_), (int)std::floor(p[2]/voxel_size_));
+        }
+
+        inline const Voxel* get_voxel_(const Eigen::Vector3i &v, BlockLookupCache &cache) const {
+            const BlockCoordinates bc(floor_div_(v[0], BlockSideLength), floor_div_(v[1], BlockSideLength), floor_div_(v[2], BlockSideLength));
+            if (!cache.valid || bc != cache.coords) {
+                auto it = block_map_.find(bc);
+                cache.valid = true;
+                cache.coords = bc;
+                cache.block = (it == block_map_.end()) ? NULL : &blocks_[it->second];
+            }
+            if (cache.block == NULL) return NULL;
+            return &(*cache.block)[local_index_(v[0] - BlockSideLength*bc[0], v[1] - BlockSideLength*bc[1], v[2] - BlockSideLength*bc[2])];
+        }
+
+        // Trilinear interpolation; fails if any of the 8 surrounding voxels is unobserved
+        bool interpolate_sdf_(const Vector<ScalarT,3> &p, ScalarT &sdf, Eigen::Matrix<float,3,1> *color, BlockLookupCache &cache) const {
+            const Vector<ScalarT,3> g(p/voxel_size_);
+            const Eigen::Vector3i v0((int)std::floor(g[0]), (int)std::floor(g[1]), (int)std::floor(g[2]));
+            const Vector<ScalarT,3> f(g - v0.template cast<ScalarT>());
+
+            sdf = (ScalarT)0.0;
+            if (color) color->setZero();
+            for (int c = 0; c < 8; c++) {
+                const int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1;
+                const Voxel * vox = get_voxel_(v0 + Eigen::Vector3i(dx, dy, dz), cache);
+                if (vox == NULL || vox->weight <= (ScalarT)0.0) return false;
+                const ScalarT w = (dx ? f[0] : 1 - f[0])*(dy ? f[1] : 1 - f[1])*(dz ? f[2] : 1 - f[2]);
+                sdf += w*vox->sdf;
+                if (color) *color += (float)w*vox->color;
+            }
+            return true;
+        }
+
+        bool compute_normal_(const Vector<ScalarT,3> &p, Vector<ScalarT,3> &normal, BlockLookupCache &cache) const {
+            ScalarT sdf_plus, sdf_minus;
+            Vector<ScalarT,3> offset(Vector<ScalarT,3>::Zero());
+            for (int i = 0; i < 3; i++) {
+                offset[i] = voxel_size_;
+                if (!interpolate_sdf_(p + offset, sdf_plus, NULL, cache) || !interpolate_sdf_(p - offset, sdf_minus, NULL, cache)) return false;
+                normal[i] = sdf_plus - sdf_minus;
+                offset[i] = (ScalarT)0.0;
+            }
+            const ScalarT norm = normal.norm();
+            if (norm <= std::numeric_limits<ScalarT>::epsilon()) return false;
+            normal /= norm;
+            return true;
+        }
+
+        // Collects the blocks intersected by the truncation band of every valid pixel and allocates missing ones
+        void allocate_visible_blocks_(const std::vector<ScalarT> &depth,
+                                      size_t image_w, size_t image_h,
+                                      const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                                      const RigidTransform<ScalarT,3> &extrinsics)
+        {
+            const ScalarT block_length = BlockSideLength*voxel_size_;
+            std::unordered_set<BlockCoordinates,EigenVectorHasher<int,3>> visible_set;
+
+#pragma omp parallel
+            {
+                std::unordered_set<BlockCoordinates,EigenVectorHasher<int,3>> visible_local;
+                Vector<ScalarT,3> ray, start, end, pt;
+                BlockCoordinates bc, bc_prev;
+#pragma omp for nowait
+                for (size_t y = 0; y < image_h; y++) {
+                    for (size_t x = 0; x < image_w; x++) {
+                        const ScalarT z = depth[y*image_w + x];
+                        if (z <= (ScalarT)0.0) continue;
+                        ray = Vector<ScalarT,3>((x - intrinsics(0,2))/intrinsics(0,0), (y - intrinsics(1,2))/intrinsics(1,1), (ScalarT)1.0);
+                        start.noalias() = extrinsics*(std::max((ScalarT)0.0, z - truncation_distance_)*ray);
+                        end.noalias() = extrinsics*((z + truncation_distance_)*ray);
+                        const size_t num_steps = (size_t)std::ceil(2*(end - start).norm()/block_length);
+                        for (size_t s = 0; s <= num_steps; s++) {
+                            pt.noalias() = start + (end - start)*((ScalarT)s/std::max<size_t>(num_steps, 1));
+                            bc = BlockCoordinates((int)std::floor(pt[0]/block_length), (int)std::floor(pt[1]/block_length), (int)std::floor(pt[2]/block_length));
+                            if (s == 0 || bc != bc_prev) visible_local.insert(bc);
+                            bc_prev = bc;
+                        }
+                    }
+                }
+#pragma omp critical
+                visible_set.insert(visible_local.begin(), visible_local.end());
+            }
+
+            // Sorted for a deterministic block layout
+            std::vector<BlockCoordinates> visible(visible_set.begin(), visible_set.end());
+            std::sort(visible.begin(), visible.end(), EigenVectorComparator<int,3>());
+
+            visible_blocks_.resize(visible.size());
+            for (size_t i = 0; i < visible.size(); i++) {
+                auto it = block_map_.find(visible[i]);
+                if (it == block_map_.end()) {
+                    it = block_map_.emplace(visible[i], blocks_.size()).first;
+                    blocks_.emplace_back();
+                    block_coords_.emplace_back(visible[i]);
+                }
+                visible_blocks_[i] = it->second;
+            }
+        }
+
+        template <class DepthConverterT>
+        void integrate_(const unsigned char* rgb_data,
+                        const typename DepthConverterT::RawDepth* depth_data,
+                        const DepthConverterT &depth_converter,
+                        size_t image_w, size_t image_h,
+                        const Eigen::Ref<const Eigen::Matrix<ScalarT,3,3>> &intrinsics,
+                        const RigidTransform<ScalarT,3> &extrinsics)
+        {
+            std::vector<ScalarT> depth(image_w*image_h);
+#pragma omp parallel for
+            for (size_t i = 0; i < depth.size(); i++) {
+                depth[i] = static_cast<ScalarT>(depth_converter.getMetricValue(depth_data[i]));
+            }
+
+            allocate_visible_blocks_(depth, image_w, image_h, intrinsics, extrinsics);
+
+            const RigidTransform<ScalarT,3> to_cam(extrinsics.inverse());
+            const ScalarT block_length = BlockSideLength*voxel_size_;
+            const float color_mult = 1.0f/255.0f;
+
+#pragma omp parallel for schedule(dynamic)
+            for (size_t b = 0; b < visible_blocks_.size(); b++) {
+                VoxelBlock &block = blocks_[visible_blocks_[b]];
+                const Vector<ScalarT,3> block_origin(block_length*block_coords_[visible_blocks_[b]].template cast<ScalarT>());
+                Vector<ScalarT,3> pt_cam;
+                for (size_t vz = 0; vz < BlockSideLength; vz++) {
+                    for (size_t vy = 0; vy < BlockSideLength; vy++) {
+                        for (size_t vx = 0; vx < BlockSideLength; vx++) {
+                            pt_cam.noalias() = to_cam*(block_origin + voxel_size_*Vector<ScalarT,3>(vx, vy, vz));
+                            if (pt_cam(2) <= (ScalarT)0.0) continue;
+                            const size_t x = (size_t)std::llround(pt_cam(0)*intrinsics(0,0)/pt_cam(2) + intrinsics(0,2));
+                            const size_t y = (size_t)std::llround(pt_cam(1)*intrinsics(1,1)/pt_cam(2) + intrinsics(1,2));
+                            if (x >= image_w || y >= image_h) continue;
+                            const size_t k = y*image_w + x;
+                            if (depth[k] <= (ScalarT)0.0) continue;
+                            const ScalarT dist = depth[k] - pt_cam(2);
+                            if (dist < -truncation_distance_) continue;
+
+                            Voxel &vox = block[local_index_(vx, vy, vz)];
+                            const ScalarT weight = vox.weight + (ScalarT)1.0;
+                            vox.sdf = (vox.weight*vox.sdf + std::min((ScalarT)1.0, dist/truncation_distance_))/weight;
+                            if (rgb_data != NULL && dist < truncation_distance_) {
+                                vox.color = ((float)vox.weight*vox.color + color_mult*Eigen::Matrix<float,3,1>(rgb_data[3*k], rgb_data[3*k + 1], rgb_data[3*k + 2]))/(float)weight;
+                            }
+                            vox.weight = std::min(weight, max_weight_);
+                        }
+                    }
+                }
+            }
+        }
+
+        void extract_surface_(VectorSet<ScalarT,3> &points, VectorSet<ScalarT,3> *normals, VectorSet<float,3> *colors, ScalarT min_weight) const {
+            std::vector<std::vector<ScalarT>> block_points(blocks_.size());
+            std::vector<std::vector<ScalarT>> block_normals(normals ? blocks_.size() : 0);
+            std::vector<std::vector<float>> block_colors(colors ? blocks_.size() : 0);
+
+#pragma omp parallel for schedule(dynamic)
+            for (size_t b = 0; b < blocks_.size(); b++) {
+                BlockLookupCache cache;
+                const Eigen::Vector3i block_origin(BlockSideLength*block_coords_[b]);
+                Vector<ScalarT,3> pt, normal;
+                Eigen::Matrix<float,3,1> color;
+                for (size_t i = 0; i < BlockVolume; i++) {
+                    const Voxel &vox = blocks_[b][i];
+                    if (vox.weight < min_weight || std::abs(vox.sdf) >= (ScalarT)1.0) continue;
+                    const Eigen::Vector3i v(block_origin + Eigen::Vector3i(i % BlockSideLength, (i/BlockSideLength) % BlockSideLength, i/(BlockSideLength*BlockSideLength)));
+                    for (int a = 0; a < 3; a++) {
+                        Eigen::Vector3i n(v);
+                        n[a]++;
+                        const Voxel * nvox = get_voxel_(n, cache);
+                        if (nvox == NULL || nvox->weight < min_weight || std::abs(nvox->sdf) >= (ScalarT)1.0 ||
+                            (vox.sdf > (ScalarT)0.0) == (nvox->sdf > (ScalarT)0.0)) continue;
+
+                        const ScalarT alpha = vox.sdf/(vox.sdf - nvox->sdf);
+                        pt = voxel_size_*v.template cast<ScalarT>();
+                        pt[a] += alpha*voxel_size_;
+                        if (normals && !compute_normal_(pt, normal, cache)) continue;
+
+                        block_points[b].insert(block_points[b].end(), pt.data(), pt.data() + 3);
+                        if (normals) block_normals[b].insert(block_normals[b].end(), normal.data(), normal.data() + 3);
+                        if (colors) {
+                            color = (1.0f - (float)alpha)*vox.color + (float)alpha*nvox->color;
+                            block_colors[b].insert(block_colors[b].end(), color.data(), color.data() + 3);
+                        }
+                    }
+                }
+            }
+
+            std::vector<size_t> offsets(blocks_.size() + 1, 0);
+            for (size_t b = 0; b < blocks_.size(); b++) {
+                offsets[b + 1] = offsets[b] + block_points[b].size()/3;
+            }
+
+            points.resize(3, offsets.back());
+            if (normals) normals->resize(3, offsets.back());
+            if (colors) colors->resize(3, offsets.back());
+#pragma omp parallel for
+            for (size_t b = 0; b < blocks_.size(); b++) {
+                std::copy(block_points[b].begin(), block_points[b].end(), points.data() + 3*offsets[b]);
+                if (normals) std::copy(block_normals[b].begin(), block_normals[b].end(), normals->data() + 3*offsets[b]);
+                if (colors) std::copy(block_colors[b].begin(), block_colors[b].end(), colors->data() + 3*offsets[b]);
+            }
+        }
+    };
+
+    typedef TSDFVolume<float> TSDFVolumef;
+    typedef TSDFVolume<double> TSDFVolumed;
+}
@@ -2,12 +2,15 @@
 
 #include <cilantro/registration/correspondence_search_combined_metric_adaptor.hpp>
 #include <cilantro/registration/correspondence_search_combined_metric_combiner.hpp>
+#include <cilantro/registration/deformation_graph.hpp>
 #include <cilantro/registration/icp_base.hpp>
 #include <cilantro/registration/icp_common_instances.hpp>
+#include <cilantro/registration/icp_multi_resolution.hpp>
 #include <cilantro/registration/icp_single_transform_combined_metric.hpp>
 #include <cilantro/registration/icp_single_transform_point_to_point_metric.hpp>
 #include <cilantro/registration/icp_warp_field_combined_metric_dense.hpp>
 #include <cilantro/registration/icp_warp_field_combined_metric_sparse.hpp>
 #include <cilantro/registration/transform_estimation.hpp>
 #include <cilantro/registration/warp_field_estimation.hpp>
+#include <cilantro/registration/warp_field_linear_solver.hpp>
 #include <cilantro/registration/warp_field_utilities.hpp>
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <limits>
+#include <cilantro/core/kd_tree.hpp>
+#include <cilantro/core/grid_downsampler.hpp>
+#include <cilantro/core/radix_sort.hpp>
+
+namespace cilantro {
+    enum struct DeformationGraphSamplingMethod {VOXEL_GRID, FARTHEST_POINT};
+
+    // Multi-level deformation graph (control nodes) for sparse warp field estimation.
+    // Level 0 is the finest: its nodes are sampled from the input points with the given spacing; the nodes of level l
+    // are sampled from those of level l-1 with a spacing levelSpacingFactor times larger.
+    // Per level, the graph holds the neighborhoods CombinedMetricSparseWarpFieldICP expects (skinning neighborhoods of
+    // the input points and regularization neighborhoods of the nodes, with each node first in its own neighborhood) and,
+    // for coarse-to-fine solves, the neighborhoods of the finer level nodes (resampleTransforms() maps a coarse level
+    // solution onto the next finer level).
+    // All neighborhoods are computed in parallel, with one KD-tree per level; input points are queried in voxel order
+    // for cache locality.
+    template <typename ScalarT, ptrdiff_t EigenDim>
+    class DeformationGraph {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef ScalarT Scalar;
+
+        enum { Dimension = EigenDim };
+
+        DeformationGraph(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                         ScalarT node_spacing,
+                         size_t num_levels = 1,
+                         ScalarT level_spacing_factor = (ScalarT)2.0,
+                         size_t num_skinning_neighbors = 4,
+                         size_t num_regularization_neighbors = 8,
+                         DeformationGraphSamplingMethod sampling_method = DeformationGraphSamplingMethod::VOXEL_GRID)
+                : levels_(std::max<size_t>(num_levels, 1))
+        {
+            std::vector<size_t> query_order;
+            get_spatial_order_(points, node_spacing, query_order);
+
+            ScalarT spacing = node_spacing;
+            for (size_t l = 0; l < levels_.size(); l++) {
+                Level &level = levels_[l];
+                level.spacing = spacing;
+                if (l == 0) {
+                    sample_nodes_(points, spacing, sampling_method, level.nodes);
+                } else {
+                    sample_nodes_(levels_[l-1].nodes, spacing, sampling_method, level.nodes);
+                }
+
+                const KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2> tree(level.nodes);
+                level.skinningNeighborhoods.resize(points.cols());
+#pragma omp parallel for
+                for (size_t i = 0; i < query_order.size(); i++) {
+                    tree.search(points.col(query_order[i]), KNNNeighborhoodSpecification<>(num_skinning_neighbors), level.skinningNeighborhoods[query_order[i]]);
+                }
+                tree.search(level.nodes, KNNNeighborhoodSpecification<>(num_regularization_neighbors), level.regularizationNeighborhoods);
+                if (l > 0) {
+                    tree.search(levels_[l-1].nodes, KNNNeighborhoodSpecification<>(num_skinning_neighbors), level.finerLevelNeighborhoods);
+                }
+
+                spacing *= level_spacing_factor;
+            }
+        }
+
+        inline size_t getNumberOfLevels() const { return levels_.size(); }
+
+        inline ScalarT getNodeSpacing(size_t level = 0) const { return levels_[level].spacing; }
+
+        inline const VectorSet<ScalarT,EigenDim>& getNodes(size_t level = 0) const { return levels_[level].nodes; }
+
+        inline size_t getNumberOfNodes(size_t level = 0) const { return levels_[level].nodes.cols(); }
+
+        // Nodes of the level affecting each input point
+        inline const NeighborhoodSet<ScalarT>& getSkinningNeighborhoods(size_t level = 0) const {
+            return levels_[level].skinningNeighborhoods;
+        }
+
+        // Regularization edges of the level; every neighborhood starts with the node itself
+        inline const NeighborhoodSet<ScalarT>& getRegularizationNeighborhoods(size_t level = 0) const {
+            return levels_[level].regularizationNeighborhoods;
+        }
+
+        // Nodes of the level affecting each node of level - 1 (empty for level 0)
+        inline const NeighborhoodSet<ScalarT>& getFinerLevelNeighborhoods(size_t level) const {
+            return levels_[level].finerLevelNeighborhoods;
+        }
+
+    private:
+        struct Level {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            ScalarT spacing;
+            VectorSet<ScalarT,EigenDim> nodes;
+            NeighborhoodSet<ScalarT> skinningNeighborhoods;
+            NeighborhoodSet<ScalarT> regularizationNeighborhoods;
+            NeighborhoodSet<ScalarT> finerLevelNeighborhoods;
+        };
+
+        std::vector<Level> levels_;
+
+        // Point indices sorted by (lexicographic) voxel coordinates; identity order if the keys do not fit in 64 bits
+        static void get_spatial_order_(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                                       ScalarT voxel_size,
+                                       std::vector<size_t> &order)
+        {
+            order.resize(points.cols());
+            if (points.cols() == 0) return;
+
+            const Vector<ScalarT,EigenDim> min_pt(points.rowwise().minCoeff());
+            const Vector<ScalarT,EigenDim> max_pt(points.rowwise().maxCoeff());
+            const ScalarT scale = (ScalarT)1.0/voxel_size;
+            std::vector<uint64_t> strides(points.rows());
+            uint64_t num_voxels = 1;
+            bool fits = true;
+            for (ptrdiff_t d = points.rows() - 1; d >= 0; d--) {
+                const ScalarT extent = std::floor((max_pt[d] - min_pt[d])*scale) + (ScalarT)1.0;
+                strides[d] = num_voxels;
+                fits = fits && extent < (ScalarT)std::numeric_limits<uint64_t>::max()/num_voxels;
+                if (!fits) break;
+                num_voxels *= (uint64_t)extent;
+            }
+
+            if (!fits) {
+                for (size_t i = 0; i < order.size(); i++) order[i] = i;
+                return;
+            }
+
+            std::vector<std::pair<uint64_t,size_t>> keys(points.cols());
+#pragma omp parallel for
+            for (size_t i = 0; i < keys.size(); i++) {
+                uint64_t key = 0;
+                for (size_t d = 0; d < points.rows(); d++) {
+                    key += (uint64_t)std::floor((points(d,i) - min_pt[d])*scale)*strides[d];
+                }
+                keys[i] = std::pair<uint64_t,size_t>(key, i);
+            }
+            size_t num_key_bits = 0;
+            while (num_key_bits < 64 && (num_voxels - 1) >> num_key_bits) num_key_bits++;
+            radixSortKeyValuePairs(keys, num_key_bits);
+#pragma omp parallel for
+            for (size_t i = 0; i < keys.size(); i++) {
+                order[i] = keys[i].second;
+            }
+        }
+
+        static void sample_nodes_(const ConstVectorSetMatrixMap<ScalarT,EigenDim> &points,
+                                  ScalarT spacing,
+                                  DeformationGraphSamplingMethod method,
+                                  VectorSet<ScalarT,EigenDim> &nodes)
+        {
+            if (method == DeformationGraphSamplingMethod::VOXEL_GRID) {
+                PointsGridDownsampler<ScalarT,EigenDim>(points, spacing).getDownsampledPoints(nodes);
+            } else {
+                const VectorSet<ScalarT,EigenDim> candidates(PointsGridDownsampler<ScalarT,EigenDim>(points, (ScalarT)0.5*spacing).getDownsampledPoints());
+                farthest_point_sample_(candidates, spacing, nodes);
+            }
+        }
+
+        // Greedy farthest point sampling, until every candidate is within spacing of a selected node
+        static void farthest_point_sample_(const VectorSet<ScalarT,EigenDim> &candidates,
+                                           ScalarT spacing,
+                                           VectorSet<ScalarT,EigenDim> &nodes)
+        {
+            std::vector<size_t> selected;
+            if (candidates.cols() == 0) {
+                nodes.resize(candidates.rows(), 0);
+                return;
+            }
+
+            std::vector<ScalarT> min_dist_sq(candidates.cols(), std::numeric_limits<ScalarT>::infinity());
+            const ScalarT spacing_sq = spacing*spacing;
+            size_t next = 0;
+            while (true) {
+                selected.emplace_back(next);
+                const Vector<ScalarT,EigenDim> node(candidates.col(next));
+
+                ScalarT max_dist_sq = (ScalarT)(-1.0);
+                size_t max_ind = 0;
+#pragma omp parallel
+                {
+                    ScalarT max_dist_sq_private = (ScalarT)(-1.0);
+                    size_t max_ind_private = 0;
+#pragma omp for nowait
+                    for (size_t i = 0; i < candidates.cols(); i++) {
+                        const ScalarT dist_sq = (candidates.col(i) - node).squaredNorm();
+                        if (dist_sq < min_dist_sq[i]) min_dist_sq[i] = dist_sq;
+                        if (min_dist_sq[i] > max_dist_sq_private) {
+                            max_dist_sq_private = min_dist_sq[i];
+                            max_ind_private = i;
+                        }
+                    }
+#pragma omp critical
+                    {
+                        // Ties resolved by index, so the result does not depend on the thread count
+                        if (max_dist_sq_private > max_dist_sq || (max_dist_sq_private == max_dist_sq && max_ind_private < max_ind)) {
+                            max_dist_sq = max_dist_sq_private;
+                            max_ind = max_ind_private;
+                        }
+                    }
+                }
+
+                if (max_dist_sq < spacing_sq) break;
+                next = max_ind;
+            }
+
+            nodes.resize(candidates.rows(), selected.size());
+#pragma omp parallel for
+            for (size_t i = 0; i < selected.size(); i++) {
+                nodes.col(i) = candidates.col(selected[i]);
+            }
+        }
+    };
+
+    typedef DeformationGraph<float,2> DeformationGraph2f;
+    typedef DeformationGraph<double,2> DeformationGraph2d;
+    typedef DeformationGraph<float,3> DeformationGraph3f;
+    typedef DeformationGraph<double,3> DeformationGraph3d;
+}
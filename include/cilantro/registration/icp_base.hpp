@@ -1,8 +1,41 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <cilantro/core/kd_tree.hpp>
 
 namespace cilantro {
+    namespace internal {
+        template <typename T, typename = int>
+        struct HasDestinationSearchTree : std::false_type {};
+
+        template <typename T>
+        struct HasDestinationSearchTree<T, decltype((void) std::declval<T&>().getDestinationSearchTree(), 0)> : std::true_type {};
+
+        // Provides a Euclidean nearest neighbor tree over the destination points for residual computation:
+        // the correspondence engine's own destination tree if it indexes exactly these points, NULL otherwise
+        template <class CorrespondenceSearchEngineT, typename ScalarT, ptrdiff_t EigenDim, typename = void>
+        struct DestinationPointsSearchTreeGetter {
+            typedef KDTree<ScalarT,EigenDim,KDTreeDistanceAdaptors::L2> Tree;
+
+            static inline const Tree* get(CorrespondenceSearchEngineT &, const ConstVectorSetMatrixMap<ScalarT,EigenDim> &) { return NULL; }
+        };
+
+        template <class CorrespondenceSearchEngineT, typename ScalarT, ptrdiff_t EigenDim>
+        struct DestinationPointsSearchTreeGetter<CorrespondenceSearchEngineT,ScalarT,EigenDim,typename std::enable_if<HasDestinationSearchTree<CorrespondenceSearchEngineT>::value &&
+                CorrespondenceSearchEngineT::HasEuclideanSearchDistance &&
+                std::is_same<typename CorrespondenceSearchEngineT::SearchTree::Scalar,ScalarT>::value &&
+                int(CorrespondenceSearchEngineT::SearchTree::Dimension) == int(EigenDim)>::type>
+        {
+            typedef typename CorrespondenceSearchEngineT::SearchTree Tree;
+
+            static inline const Tree* get(CorrespondenceSearchEngineT &engine, const ConstVectorSetMatrixMap<ScalarT,EigenDim> &dst_points) {
+                const Tree& tree = engine.getDestinationSearchTree();
+                if (tree.getPointsMatrixMap().data() != dst_points.data() || tree.getPointsMatrixMap().cols() != dst_points.cols()) return NULL;
+                return &tree;
+            }
+        };
+    }
+
     // CRTP base class
     template <class ICPInstanceT, class TransformT, class CorrespondenceSearchEngineT, class ResidualVectorT>
     class IterativeClosestPointBase {
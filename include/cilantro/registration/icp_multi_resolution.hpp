@@ -0,0 +1,237 @@
+#pragma once
+
+#include <memory>
+#include <cilantro/core/grid_downsampler.hpp>
+#include <cilantro/registration/icp_common_instances.hpp>
+
+namespace cilantro {
+    // Coarse-to-fine combined metric ICP: each pyramid level registers grid-downsampled copies of the inputs,
+    // starting from the estimate of the previous (coarser) level.
+    // Level data and the search structures of the per-level ICP instances are built on first use and reused across
+    // estimate() calls; each level searches its own (downsampled) destination. Full resolution levels and residual
+    // computation share the destination search tree.
+    template <class TransformT, class CorrSearchT = internal::DefaultKDTreeSearch<TransformT>>
+    class MultiResolutionCombinedMetricICP {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef TransformT Transform;
+
+        typedef typename TransformT::Scalar Scalar;
+
+        enum { Dim = TransformT::Dim };
+
+        typedef internal::SimpleCombinedMetricICPWrapper<TransformT,CorrSearchT> LevelICP;
+
+        struct LevelParameters {
+            // Non-positive voxel size means full resolution
+            Scalar voxelSize;
+            size_t maxIterations;
+            // In correspondence search engine units (squared Euclidean distance by default)
+            Scalar maxCorrespondenceDistance;
+        };
+
+        MultiResolutionCombinedMetricICP(const ConstVectorSetMatrixMap<Scalar,Dim> &dst_p,
+                                         const ConstVectorSetMatrixMap<Scalar,Dim> &dst_n,
+                                         const ConstVectorSetMatrixMap<Scalar,Dim> &src_p)
+                : dst_points_(dst_p), dst_normals_(dst_n), src_points_(src_p), src_normals_(NULL, src_p.rows(), 0),
+                  has_source_normals_(false)
+        {
+            init_params_();
+        }
+
+        MultiResolutionCombinedMetricICP(const ConstVectorSetMatrixMap<Scalar,Dim> &dst_p,
+                                         const ConstVectorSetMatrixMap<Scalar,Dim> &dst_n,
+                                         const ConstVectorSetMatrixMap<Scalar,Dim> &src_p,
+                                         const ConstVectorSetMatrixMap<Scalar,Dim> &src_n)
+                : dst_points_(dst_p), dst_normals_(dst_n), src_points_(src_p), src_normals_(src_n),
+                  has_source_normals_(true)
+        {
+            init_params_();
+        }
+
+        inline const std::vector<LevelParameters>& getLevels() const { return levels_; }
+
+        // Levels run in insertion order (coarsest first)
+        inline MultiResolutionCombinedMetricICP& addLevel(Scalar voxel_size, size_t max_iter, Scalar max_corr_dist) {
+            levels_.emplace_back(LevelParameters{voxel_size, max_iter, max_corr_dist});
+            level_data_.resize(levels_.size());
+            return *this;
+        }
+
+        inline MultiResolutionCombinedMetricICP& clearLevels() {
+            levels_.clear();
+            level_data_.clear();
+            return *this;
+        }
+
+        inline size_t getNumberOfLevels() const { return levels_.size(); }
+
+        // Per-level ICP instance, e.g. for setting search direction or weight evaluator parameters
+        inline LevelICP& levelICP(size_t level) { return *get_level_(level).icp; }
+
+        inline Scalar getPointToPointMetricWeight() const { return point_to_point_weight_; }
+
+        inline MultiResolutionCombinedMetricICP& setPointToPointMetricWeight(Scalar weight) {
+            point_to_point_weight_ = weight;
+            return *this;
+        }
+
+        inline Scalar getPointToPlaneMetricWeight() const { return point_to_plane_weight_; }
+
+        inline MultiResolutionCombinedMetricICP& setPointToPlaneMetricWeight(Scalar weight) {
+            point_to_plane_weight_ = weight;
+            return *this;
+        }
+
+        inline size_t getMaxNumberOfOptimizationStepIterations() const { return max_optimization_iterations_; }
+
+        inline MultiResolutionCombinedMetricICP& setMaxNumberOfOptimizationStepIterations(size_t max_iter) {
+            max_optimization_iterations_ = max_iter;
+            return *this;
+        }
+
+        inline Scalar getConvergenceTolerance() const { return convergence_tol_; }
+
+        inline MultiResolutionCombinedMetricICP& setConvergenceTolerance(Scalar conv_tol) {
+            convergence_tol_ = conv_tol;
+            return *this;
+        }
+
+        inline const Transform& getInitialTransform() const { return transform_init_; }
+
+        inline MultiResolutionCombinedMetricICP& setInitialTransform(const Transform &tform_init) {
+            transform_init_ = tform_init;
+            return *this;
+        }
+
+        MultiResolutionCombinedMetricICP& estimate() {
+            transform_ = transform_init_;
+            level_iterations_.assign(levels_.size(), 0);
+            for (size_t l = 0; l < levels_.size(); l++) {
+                LevelICP &icp = levelICP(l);
+                icp.correspondenceSearchEngine().setMaxDistance(levels_[l].maxCorrespondenceDistance);
+                icp.setPointToPointMetricWeight(point_to_point_weight_).setPointToPlaneMetricWeight(point_to_plane_weight_)
+                        .setMaxNumberOfOptimizationStepIterations(max_optimization_iterations_);
+                icp.setInitialTransform(transform_).setConvergenceTolerance(convergence_tol_).setMaxNumberOfIterations(levels_[l].maxIterations);
+                transform_ = icp.estimate().getTransform();
+                level_iterations_[l] = icp.getNumberOfPerformedIterations();
+                last_level_converged_ = icp.hasConverged();
+            }
+            return *this;
+        }
+
+        inline const Transform& getTransform() const { return transform_; }
+
+        inline const std::vector<size_t>& getNumberOfPerformedIterationsPerLevel() const { return level_iterations_; }
+
+        inline size_t getNumberOfPerformedIterations() const {
+            size_t sum = 0;
+            for (size_t l = 0; l < level_iterations_.size(); l++) sum += level_iterations_[l];
+            return sum;
+        }
+
+        // Whether the finest level converged
+        inline bool hasConverged() const { return last_level_converged_; }
+
+        // Residuals of the full resolution source points at the current estimate (as in CombinedMetricSingleTransformICP),
+        // searched in the destination tree of a full resolution level if there is one
+        VectorSet<Scalar,1> getResiduals() {
+            if (dst_points_.cols() == 0) {
+                return VectorSet<Scalar,1>::Constant(1, src_points_.cols(), std::numeric_limits<Scalar>::quiet_NaN());
+            }
+            VectorSet<Scalar,1> res(1, src_points_.cols());
+            typedef internal::DestinationPointsSearchTreeGetter<CorrSearchT,Scalar,Dim> TreeGetter;
+            for (size_t l = 0; l < levels_.size(); l++) {
+                if (levels_[l].voxelSize > (Scalar)0.0) continue;
+                const typename TreeGetter::Tree * dst_tree = TreeGetter::get(levelICP(l).correspondenceSearchEngine(), dst_points_);
+                if (dst_tree) {
+                    compute_residuals_(*dst_tree, res);
+                    return res;
+                }
+            }
+            if (!residual_tree_) residual_tree_.reset(new ResidualSearchTree(dst_points_));
+            compute_residuals_(*residual_tree_, res);
+            return res;
+        }
+
+    private:
+        typedef KDTree<Scalar,Dim,KDTreeDistanceAdaptors::L2> ResidualSearchTree;
+
+        struct LevelData {
+            EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+            VectorSet<Scalar,Dim> dstPoints;
+            VectorSet<Scalar,Dim> dstNormals;
+            VectorSet<Scalar,Dim> srcPoints;
+            VectorSet<Scalar,Dim> srcNormals;
+            std::unique_ptr<LevelICP> icp;
+        };
+
+        ConstVectorSetMatrixMap<Scalar,Dim> dst_points_;
+        ConstVectorSetMatrixMap<Scalar,Dim> dst_normals_;
+        ConstVectorSetMatrixMap<Scalar,Dim> src_points_;
+        ConstVectorSetMatrixMap<Scalar,Dim> src_normals_;
+        bool has_source_normals_;
+
+        std::vector<LevelParameters> levels_;
+        std::vector<std::unique_ptr<LevelData>> level_data_;
+        std::unique_ptr<ResidualSearchTree> residual_tree_;
+
+        Scalar point_to_point_weight_;
+        Scalar point_to_plane_weight_;
+        size_t max_optimization_iterations_;
+        Scalar convergence_tol_;
+
+        Transform transform_init_;
+        Transform transform_;
+        std::vector<size_t> level_iterations_;
+        bool last_level_converged_;
+
+        inline void init_params_() {
+            point_to_point_weight_ = (Scalar)0.0;
+            point_to_plane_weight_ = (Scalar)1.0;
+            max_optimization_iterations_ = 1;
+            convergence_tol_ = (Scalar)1e-5;
+            transform_init_.setIdentity();
+            transform_.setIdentity();
+            last_level_converged_ = false;
+        }
+
+        inline std::unique_ptr<LevelICP> make_full_resolution_icp_() const {
+            if (has_source_normals_) return std::unique_ptr<LevelICP>(new LevelICP(dst_points_, dst_normals_, src_points_, src_normals_));
+            return std::unique_ptr<LevelICP>(new LevelICP(dst_points_, dst_normals_, src_points_));
+        }
+
+        template <class TreeT>
+        inline void compute_residuals_(const TreeT &dst_tree, VectorSet<Scalar,1> &res) const {
+            internal::computeCombinedMetricResiduals(dst_tree, dst_points_, dst_normals_, src_points_, src_normals_, has_source_normals_, transform_, point_to_point_weight_, point_to_plane_weight_, res);
+        }
+
+        LevelData& get_level_(size_t level) {
+            if (level_data_[level]) return *level_data_[level];
+
+            level_data_[level].reset(new LevelData);
+            LevelData &data = *level_data_[level];
+            const Scalar voxel_size = levels_[level].voxelSize;
+
+            if (voxel_size <= (Scalar)0.0) {
+                data.icp = make_full_resolution_icp_();
+                return data;
+            }
+
+            PointsNormalsGridDownsampler<Scalar,Dim,ptrdiff_t,GridBinningMethod::HASH_MAP>(dst_points_, dst_normals_, voxel_size).getDownsampledPointsNormals(data.dstPoints, data.dstNormals);
+            if (has_source_normals_) {
+                PointsNormalsGridDownsampler<Scalar,Dim,ptrdiff_t,GridBinningMethod::HASH_MAP>(src_points_, src_normals_, voxel_size).getDownsampledPointsNormals(data.srcPoints, data.srcNormals);
+                data.icp.reset(new LevelICP(data.dstPoints, data.dstNormals, data.srcPoints, data.srcNormals));
+            } else {
+                PointsGridDownsampler<Scalar,Dim,ptrdiff_t,GridBinningMethod::HASH_MAP>(src_points_, voxel_size).getDownsampledPoints(data.srcPoints);
+                data.icp.reset(new LevelICP(data.dstPoints, data.dstNormals, data.srcPoints));
+            }
+            return data;
+        }
+    };
+
+    template <class TransformT>
+    using SimpleMultiResolutionCombinedMetricICP = MultiResolutionCombinedMetricICP<TransformT,internal::DefaultKDTreeSearch<TransformT>>;
+}
@@ -6,6 +6,36 @@
 #include <cilantro/core/kd_tree.hpp>
 
 namespace cilantro {
+    namespace internal {
+        // Weighted combined metric residuals of the transformed source points w.r.t. their nearest destination points;
+        // source normals, if given, are added to the destination normals
+        template <class TransformT, class TreeT>
+        void computeCombinedMetricResiduals(const TreeT &dst_tree,
+                                            const ConstVectorSetMatrixMap<typename TransformT::Scalar,TransformT::Dim> &dst_points,
+                                            const ConstVectorSetMatrixMap<typename TransformT::Scalar,TransformT::Dim> &dst_normals,
+                                            const ConstVectorSetMatrixMap<typename TransformT::Scalar,TransformT::Dim> &src_points,
+                                            const ConstVectorSetMatrixMap<typename TransformT::Scalar,TransformT::Dim> &src_normals,
+                                            bool has_source_normals,
+                                            const TransformT &tform,
+                                            typename TransformT::Scalar point_to_point_weight,
+                                            typename TransformT::Scalar point_to_plane_weight,
+                                            VectorSet<typename TransformT::Scalar,1> &res)
+        {
+            typename TreeT::NeighborResult nn;
+            Vector<typename TransformT::Scalar,TransformT::Dim> src_p_trans;
+            Vector<typename TransformT::Scalar,TransformT::Dim> normal;
+#pragma omp parallel for shared (res) private (nn, src_p_trans, normal)
+            for (size_t i = 0; i < src_points.cols(); i++) {
+                src_p_trans.noalias() = tform*src_points.col(i);
+                dst_tree.nearestNeighborSearch(src_p_trans, nn);
+                normal = dst_normals.col(nn.index);
+                if (has_source_normals) normal += src_normals.col(i);
+                typename TransformT::Scalar point_to_plane_dist = normal.dot(dst_points.col(nn.index) - src_p_trans);
+                res[i] = point_to_point_weight*(dst_points.col(nn.index) - src_p_trans).squaredNorm() + point_to_plane_weight*point_to_plane_dist*point_to_plane_dist;
+            }
+        }
+    }
+
     template <class TransformT, class CorrespondenceSearchEngineT, class PointToPointCorrWeightEvaluatorT = UnityWeightEvaluator<typename TransformT::Scalar,typename TransformT::Scalar>, class PointToPlaneCorrWeightEvaluatorT = UnityWeightEvaluator<typename TransformT::Scalar,typename TransformT::Scalar>>
     class CombinedMetricSingleTransformICP : public IterativeClosestPointBase<CombinedMetricSingleTransformICP<TransformT,CorrespondenceSearchEngineT,PointToPointCorrWeightEvaluatorT,PointToPlaneCorrWeightEvaluatorT>,TransformT,CorrespondenceSearchEngineT,VectorSet<typename TransformT::Scalar,1>> {
         typedef IterativeClosestPointBase<CombinedMetricSingleTransformICP<TransformT,CorrespondenceSearchEngineT,PointToPointCorrWeightEvaluatorT,PointToPlaneCorrWeightEvaluatorT>,TransformT,CorrespondenceSearchEngineT,VectorSet<typename TransformT::Scalar,1>> Base;
@@ -165,21 +195,21 @@ namespace cilantro {
                 return VectorSet<typename TransformT::Scalar,1>::Constant(1, src_points_.cols(), std::numeric_limits<typename TransformT::Scalar>::quiet_NaN());
             }
             VectorSet<typename TransformT::Scalar,1> res(1, src_points_.cols());
-            KDTree<typename TransformT::Scalar,TransformT::Dim,KDTreeDistanceAdaptors::L2> dst_tree(dst_points_);
-            Neighbor<typename TransformT::Scalar> nn;
-            Vector<typename TransformT::Scalar,TransformT::Dim> src_p_trans;
-            Vector<typename TransformT::Scalar,TransformT::Dim> normal;
-#pragma omp parallel for shared (res) private (nn, src_p_trans)
-            for (size_t i = 0; i < src_points_.cols(); i++) {
-                src_p_trans.noalias() = this->transform_*src_points_.col(i);
-                dst_tree.nearestNeighborSearch(src_p_trans, nn);
-                normal = dst_normals_.col(nn.index);
-                if (has_source_normals_) normal += src_normals_.col(i);
-                typename TransformT::Scalar point_to_plane_dist = normal.dot(dst_points_.col(nn.index) - src_p_trans);
-                res[i] = point_to_point_weight_*(dst_points_.col(nn.index) - src_p_trans).squaredNorm() + point_to_plane_weight_*point_to_plane_dist*point_to_plane_dist;
+            // Reuse the correspondence search engine's destination tree if it indexes the destination points
+            typedef internal::DestinationPointsSearchTreeGetter<CorrespondenceSearchEngineT,typename TransformT::Scalar,TransformT::Dim> TreeGetter;
+            const typename TreeGetter::Tree * dst_tree = TreeGetter::get(this->correspondence_search_engine_, dst_points_);
+            if (dst_tree) {
+                compute_residuals_(*dst_tree, res);
+            } else {
+                compute_residuals_(KDTree<typename TransformT::Scalar,TransformT::Dim,KDTreeDistanceAdaptors::L2>(dst_points_), res);
             }
             return res;
         }
+
+        template <class TreeT>
+        inline void compute_residuals_(const TreeT &dst_tree, VectorSet<typename TransformT::Scalar,1> &res) const {
+            internal::computeCombinedMetricResiduals(dst_tree, dst_points_, dst_normals_, src_points_, src_normals_, has_source_normals_, this->transform_, point_to_point_weight_, point_to_plane_weight_, res);
+        }
     };
 
     template <class CorrespondenceSearchEngineT, class PointToPointCorrWeightEvaluatorT = UnityWeightEvaluator<float,float>, class PointToPlaneCorrWeightEvaluatorT = UnityWeightEvaluator<float,float>>
@@ -57,8 +57,20 @@ namespace cilantro {
                 return VectorSet<typename TransformT::Scalar,1>::Constant(1, src_points_.cols(), std::numeric_limits<typename TransformT::Scalar>::quiet_NaN());
             }
             VectorSet<typename TransformT::Scalar,1> res(1, src_points_.cols());
-            KDTree<typename TransformT::Scalar,TransformT::Dim,KDTreeDistanceAdaptors::L2> dst_tree(dst_points_);
-            Neighbor<typename TransformT::Scalar> nn;
+            // Reuse the correspondence search engine's destination tree if it indexes the destination points
+            typedef internal::DestinationPointsSearchTreeGetter<CorrespondenceSearchEngineT,typename TransformT::Scalar,TransformT::Dim> TreeGetter;
+            const typename TreeGetter::Tree * dst_tree = TreeGetter::get(this->correspondence_search_engine_, dst_points_);
+            if (dst_tree) {
+                compute_residuals_(*dst_tree, res);
+            } else {
+                compute_residuals_(KDTree<typename TransformT::Scalar,TransformT::Dim,KDTreeDistanceAdaptors::L2>(dst_points_), res);
+            }
+            return res;
+        }
+
+        template <class TreeT>
+        void compute_residuals_(const TreeT &dst_tree, VectorSet<typename TransformT::Scalar,1> &res) const {
+            typename TreeT::NeighborResult nn;
             Vector<typename TransformT::Scalar,TransformT::Dim> src_p_trans;
 #pragma omp parallel for shared (res) private (nn, src_p_trans)
             for (size_t i = 0; i < src_points_.cols(); i++) {
@@ -66,7 +78,6 @@ namespace cilantro {
                 dst_tree.nearestNeighborSearch(src_p_trans, nn);
                 res[i] = (dst_points_.col(nn.index) - src_p_trans).squaredNorm();
             }
-            return res;
         }
     };
 
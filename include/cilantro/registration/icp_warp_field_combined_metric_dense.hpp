@@ -101,6 +101,14 @@ namespace cilantro {
             return *this;
         }
 
+        inline WarpFieldLinearSolverType getLinearSolverType() const { return linear_solver_.getSolverType(); }
+
+        // Backend for the Gauss-Newton normal equations; persists across ICP iterations
+        inline CombinedMetricDenseWarpFieldICP& setLinearSolverType(WarpFieldLinearSolverType type) {
+            linear_solver_.setSolverType(type);
+            return *this;
+        }
+
         inline typename TransformT::Scalar getHuberLossBoundary() const { return huber_boundary_; }
 
         inline CombinedMetricDenseWarpFieldICP& setHuberLossBoundary(typename TransformT::Scalar huber_boundary) {
@@ -123,6 +131,7 @@ namespace cilantro {
         typename TransformT::Scalar gauss_newton_convergence_tol_;
         size_t max_conjugate_gradient_iterations_;
         typename TransformT::Scalar conjugate_gradient_convergence_tol_;
+        WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> linear_solver_;
 
         PointToPointCorrespondenceWeightEvaluator& point_corr_eval_;
         PointToPlaneCorrespondenceWeightEvaluator& plane_corr_eval_;
@@ -144,7 +153,7 @@ namespace cilantro {
             transformPoints(this->transform_, src_points_, src_points_trans_);
 
             CorrespondenceSearchCombinedMetricAdaptor<CorrespondenceSearchEngineT> corr_getter_proxy(this->correspondence_search_engine_);
-            estimateDenseWarpFieldCombinedMetric(dst_points_, dst_normals_, src_points_trans_, corr_getter_proxy.getPointToPointCorrespondences(), point_to_point_weight_, corr_getter_proxy.getPointToPlaneCorrespondences(), point_to_plane_weight_, regularization_neighborhoods_, stiffness_weight_, tforms_iter_, huber_boundary_, max_gauss_newton_iterations_, gauss_newton_convergence_tol_, max_conjugate_gradient_iterations_, conjugate_gradient_convergence_tol_, point_corr_eval_, plane_corr_eval_, reg_eval_);
+            estimateDenseWarpFieldCombinedMetric(dst_points_, dst_normals_, src_points_trans_, corr_getter_proxy.getPointToPointCorrespondences(), point_to_point_weight_, corr_getter_proxy.getPointToPlaneCorrespondences(), point_to_plane_weight_, regularization_neighborhoods_, stiffness_weight_, tforms_iter_, huber_boundary_, max_gauss_newton_iterations_, gauss_newton_convergence_tol_, max_conjugate_gradient_iterations_, conjugate_gradient_convergence_tol_, point_corr_eval_, plane_corr_eval_, reg_eval_, &linear_solver_);
             this->transform_.preApply(tforms_iter_);
 
             typename TransformT::Scalar max_delta_norm_sq = (typename TransformT::Scalar)0.0;
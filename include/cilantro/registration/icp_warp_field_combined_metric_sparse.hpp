@@ -111,6 +111,14 @@ namespace cilantro {
             return *this;
         }
 
+        inline WarpFieldLinearSolverType getLinearSolverType() const { return linear_solver_.getSolverType(); }
+
+        // Backend for the Gauss-Newton normal equations; persists across ICP iterations
+        inline CombinedMetricSparseWarpFieldICP& setLinearSolverType(WarpFieldLinearSolverType type) {
+            linear_solver_.setSolverType(type);
+            return *this;
+        }
+
         inline typename TransformT::Scalar getHuberLossBoundary() const { return huber_boundary_; }
 
         inline CombinedMetricSparseWarpFieldICP& setHuberLossBoundary(typename TransformT::Scalar huber_boundary) {
@@ -138,6 +146,7 @@ namespace cilantro {
         typename TransformT::Scalar gauss_newton_convergence_tol_;
         size_t max_conjugate_gradient_iterations_;
         typename TransformT::Scalar conjugate_gradient_convergence_tol_;
+        WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> linear_solver_;
 
         PointToPointCorrespondenceWeightEvaluator& point_corr_eval_;
         PointToPlaneCorrespondenceWeightEvaluator& plane_corr_eval_;
@@ -163,7 +172,7 @@ namespace cilantro {
             transformPoints(transform_dense_, src_points_, src_points_trans_);
 
             CorrespondenceSearchCombinedMetricAdaptor<CorrespondenceSearchEngineT> corr_getter_proxy(this->correspondence_search_engine_);
-            estimateSparseWarpFieldCombinedMetric(dst_points_, dst_normals_, src_points_trans_, corr_getter_proxy.getPointToPointCorrespondences(), point_to_point_weight_, corr_getter_proxy.getPointToPlaneCorrespondences(), point_to_plane_weight_, src_to_ctrl_neighborhoods_, num_ctrl_nodes_, ctrl_regularization_neighborhoods_, stiffness_weight_, transform_iter_, huber_boundary_, max_gauss_newton_iterations_, gauss_newton_convergence_tol_, max_conjugate_gradient_iterations_, conjugate_gradient_convergence_tol_, point_corr_eval_, plane_corr_eval_, control_eval_, reg_eval_);
+            estimateSparseWarpFieldCombinedMetric(dst_points_, dst_normals_, src_points_trans_, corr_getter_proxy.getPointToPointCorrespondences(), point_to_point_weight_, corr_getter_proxy.getPointToPlaneCorrespondences(), point_to_plane_weight_, src_to_ctrl_neighborhoods_, num_ctrl_nodes_, ctrl_regularization_neighborhoods_, stiffness_weight_, transform_iter_, huber_boundary_, max_gauss_newton_iterations_, gauss_newton_convergence_tol_, max_conjugate_gradient_iterations_, conjugate_gradient_convergence_tol_, point_corr_eval_, plane_corr_eval_, control_eval_, reg_eval_, &linear_solver_);
             this->transform_.preApply(transform_iter_);
             resampleTransforms(this->transform_, src_to_ctrl_neighborhoods_, transform_dense_, control_eval_);
 
@@ -5,6 +5,7 @@
 #include <cilantro/core/correspondence.hpp>
 #include <cilantro/core/common_pair_evaluators.hpp>
 #include <cilantro/core/openmp_reductions.hpp>
+#include <cilantro/core/normal_equation_accumulator.hpp>
 
 namespace cilantro {
     // Rigid, point-to-point, general dimension, closed form, SVD
@@ -271,6 +272,8 @@ DECLARE_MATRIX_SUM_REDUCTION(ScalarT,6,1)
 //#pragma omp parallel reduction (internal::MatrixReductions<ScalarT,6,6>::operator+: AtA) reduction (internal::MatrixReductions<ScalarT,6,1>::operator+: Atb)
 #endif
             {
+                NormalEquationAccumulator<ScalarT,6> accumulator;
+
                 if (has_point_to_point_terms) {
                     Eigen::Matrix<ScalarT,6,3,Eigen::RowMajor> eq_vecs;
                     eq_vecs.template bottomRows<3>().setIdentity();
@@ -295,8 +298,7 @@ DECLARE_MATRIX_SUM_REDUCTION(ScalarT,6,1)
                         eq_vecs(2,0) = -eq_vecs(0, 2);
                         eq_vecs(2,1) = -eq_vecs(1, 2);
 
-                        AtA += weight * eq_vecs * eq_vecs.transpose();
-                        Atb += weight * eq_vecs * (d - s);
+                        accumulator.addEquations(eq_vecs, d - s, weight);
                     }
                 }
 
@@ -315,10 +317,11 @@ DECLARE_MATRIX_SUM_REDUCTION(ScalarT,6,1)
                         eq_vec.template head<3>() = (d + s).cross(n);
                         eq_vec.template tail<3>() = n;
 
-                        AtA += weight*eq_vec*eq_vec.transpose();
-                        Atb += weight*(n.dot(d - s))*eq_vec;
+                        accumulator.addEquation(eq_vec, n.dot(d - s), weight);
                     }
                 }
+
+                accumulator.accumulateNormalEquations(AtA, Atb);
             }
 
             d_theta.noalias() = AtA.ldlt().solve(Atb);
@@ -609,6 +612,8 @@ DECLARE_MATRIX_SUM_REDUCTION(ScalarT,6,1)
 //#pragma omp parallel reduction (internal::MatrixReductions<ScalarT,6,6>::operator+: AtA) reduction (internal::MatrixReductions<ScalarT,6,1>::operator+: Atb)
 #endif
             {
+                NormalEquationAccumulator<ScalarT,6> accumulator;
+
                 if (has_point_to_point_terms) {
                     Eigen::Matrix<ScalarT,6,3,Eigen::RowMajor> eq_vecs;
                     eq_vecs.template bottomRows<3>().setIdentity();
@@ -633,8 +638,7 @@ DECLARE_MATRIX_SUM_REDUCTION(ScalarT,6,1)
                         eq_vecs(2,0) = -eq_vecs(0, 2);
                         eq_vecs(2,1) = -eq_vecs(1, 2);
 
-                        AtA += weight * eq_vecs * eq_vecs.transpose();
-                        Atb += weight * eq_vecs * (d - s);
+                        accumulator.addEquations(eq_vecs, d - s, weight);
                     }
                 }
 
@@ -653,10 +657,11 @@ DECLARE_MATRIX_SUM_REDUCTION(ScalarT,6,1)
                         eq_vec.template head<3>() = (d + s).cross(n);
                         eq_vec.template tail<3>() = n;
 
-                        AtA += weight * eq_vec * eq_vec.transpose();
-                        Atb += weight * (n.dot(d - s)) * eq_vec;
+                        accumulator.addEquation(eq_vec, n.dot(d - s), weight);
                     }
                 }
+
+                accumulator.accumulateNormalEquations(AtA, Atb);
             }
 
             d_theta.noalias() = AtA.ldlt().solve(Atb);
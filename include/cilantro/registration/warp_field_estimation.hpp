@@ -3,6 +3,7 @@
 #include <Eigen/Sparse>
 #include <cilantro/core/space_transformations.hpp>
 #include <cilantro/core/common_pair_evaluators.hpp>
+#include <cilantro/registration/warp_field_linear_solver.hpp>
 
 namespace cilantro {
     namespace internal {
@@ -110,7 +111,8 @@ namespace cilantro {
                                          typename TransformT::Scalar cg_conv_tol = (typename TransformT::Scalar)1e-5,
                                          const PointCorrWeightEvaluatorT &point_corr_evaluator = PointCorrWeightEvaluatorT(),
                                          const PlaneCorrWeightEvaluatorT &plane_corr_evaluator = PlaneCorrWeightEvaluatorT(),
-                                         const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT())
+                                         const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT(),
+                                         WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> *linear_solver = NULL)
     {
         typedef typename TransformT::Scalar ScalarT;
 
@@ -173,15 +175,10 @@ namespace cilantro {
         // Vector of unknowns (rotation angle and translation offsets per point)
         Eigen::Matrix<ScalarT,Eigen::Dynamic,1> tforms_vec(Eigen::Matrix<ScalarT,Eigen::Dynamic,1>::Zero(num_unknowns, 1));
 
-        // Conjugate Gradient solver
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IncompleteCholesky<ScalarT,Eigen::Lower|Eigen::Upper>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> solver;
-        solver.setMaxIterations(max_cg_iter);
-        solver.setTolerance(cg_conv_tol);
-
-        Eigen::SparseMatrix<ScalarT> AtA;
-        Eigen::Matrix<ScalarT,Eigen::Dynamic,1> Atb;
+        // Linear solver (Jacobi preconditioned CG unless given otherwise)
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> default_linear_solver;
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> &solver = (linear_solver != NULL) ? *linear_solver : default_linear_solver;
+        solver.setMaxNumberOfIterations(max_cg_iter).setConvergenceTolerance(cg_conv_tol);
 
         // Parameters
         const ScalarT point_to_point_weight_sqrt = std::sqrt(point_to_point_weight);
@@ -305,14 +302,8 @@ namespace cilantro {
                 }
             }
 
-            // Solve linear system using CG
-            AtA = At*At.transpose();
-            Atb.noalias() = At*b;
-
-//            solver.compute(AtA);
-            if (iter == 0) solver.analyzePattern(AtA);
-            solver.factorize(AtA);
-            delta = solver.solve(Atb);
+            // Solve normal equations
+            solver.solve(At, b, delta);
             tforms_vec += delta;
 
             iter++;
@@ -364,7 +355,8 @@ namespace cilantro {
                                          typename TransformT::Scalar cg_conv_tol = (typename TransformT::Scalar)1e-5,
                                          const PointCorrWeightEvaluatorT &point_corr_evaluator = PointCorrWeightEvaluatorT(),
                                          const PlaneCorrWeightEvaluatorT &plane_corr_evaluator = PlaneCorrWeightEvaluatorT(),
-                                         const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT())
+                                         const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT(),
+                                         WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> *linear_solver = NULL)
     {
         typedef typename TransformT::Scalar ScalarT;
 
@@ -427,16 +419,10 @@ namespace cilantro {
         // Vector of unknowns (Euler angles and translation offsets per point)
         Eigen::Matrix<ScalarT,Eigen::Dynamic,1> tforms_vec(Eigen::Matrix<ScalarT,Eigen::Dynamic,1>::Zero(num_unknowns, 1));
 
-        // Conjugate Gradient solver
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IncompleteCholesky<ScalarT,Eigen::Lower|Eigen::Upper>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,BlockDiagonalPreconditioner<ScalarT,6>> solver;
-        solver.setMaxIterations(max_cg_iter);
-        solver.setTolerance(cg_conv_tol);
-
-        Eigen::SparseMatrix<ScalarT> AtA;
-        Eigen::Matrix<ScalarT,Eigen::Dynamic,1> Atb;
+        // Linear solver (Jacobi preconditioned CG unless given otherwise)
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> default_linear_solver;
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> &solver = (linear_solver != NULL) ? *linear_solver : default_linear_solver;
+        solver.setMaxNumberOfIterations(max_cg_iter).setConvergenceTolerance(cg_conv_tol);
 
         // Parameters
         const ScalarT point_to_point_weight_sqrt = std::sqrt(point_to_point_weight);
@@ -623,14 +609,8 @@ namespace cilantro {
                 }
             }
 
-            // Solve linear system using CG
-            AtA = At*At.transpose();
-            Atb.noalias() = At*b;
-
-//            solver.compute(AtA);
-            if (iter == 0) solver.analyzePattern(AtA);
-            solver.factorize(AtA);
-            delta = solver.solve(Atb);
+            // Solve normal equations
+            solver.solve(At, b, delta);
             tforms_vec += delta;
 
             iter++;
@@ -685,7 +665,8 @@ namespace cilantro {
                                          typename TransformT::Scalar cg_conv_tol = (typename TransformT::Scalar)1e-5,
                                          const PointCorrWeightEvaluatorT &point_corr_evaluator = PointCorrWeightEvaluatorT(),
                                          const PlaneCorrWeightEvaluatorT &plane_corr_evaluator = PlaneCorrWeightEvaluatorT(),
-                                         const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT())
+                                         const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT(),
+                                         WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> *linear_solver = NULL)
     {
         typedef typename TransformT::Scalar ScalarT;
         enum {
@@ -764,15 +745,10 @@ namespace cilantro {
             tforms_vec.template segment<Dim>(i*NumUnknownsLocal + Dim*Dim).setZero();
         }
 
-        // Conjugate Gradient solver
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IncompleteCholesky<ScalarT,Eigen::Lower|Eigen::Upper>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> solver;
-        solver.setMaxIterations(max_cg_iter);
-        solver.setTolerance(cg_conv_tol);
-
-        Eigen::SparseMatrix<ScalarT> AtA;
-        Eigen::Matrix<ScalarT,Eigen::Dynamic,1> Atb;
+        // Linear solver (Jacobi preconditioned CG unless given otherwise)
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> default_linear_solver;
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> &solver = (linear_solver != NULL) ? *linear_solver : default_linear_solver;
+        solver.setMaxNumberOfIterations(max_cg_iter).setConvergenceTolerance(cg_conv_tol);
 
         // Parameters
         const ScalarT point_to_point_weight_sqrt = std::sqrt(point_to_point_weight);
@@ -878,14 +854,8 @@ namespace cilantro {
                 }
             }
 
-            // Solve linear system using CG
-            AtA = At*At.transpose();
-            Atb.noalias() = At*b;
-
-//            solver.compute(AtA);
-            if (iter == 0) solver.analyzePattern(AtA);
-            solver.factorize(AtA);
-            delta = solver.solve(Atb);
+            // Solve normal equations
+            solver.solve(At, b, delta);
             tforms_vec += delta;
 
             iter++;
@@ -940,7 +910,8 @@ namespace cilantro {
                                           const PointCorrWeightEvaluatorT &point_corr_evaluator = PointCorrWeightEvaluatorT(),
                                           const PlaneCorrWeightEvaluatorT &plane_corr_evaluator = PlaneCorrWeightEvaluatorT(),
                                           const ControlWeightEvaluatorT &control_evaluator = ControlWeightEvaluatorT(),
-                                          const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT())
+                                          const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT(),
+                                          WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> *linear_solver = NULL)
     {
         typedef typename TransformT::Scalar ScalarT;
 
@@ -1044,15 +1015,10 @@ namespace cilantro {
         // Vector of unknowns (rotation angle and translation offsets per control node)
         Eigen::Matrix<ScalarT,Eigen::Dynamic,1> tforms_vec(Eigen::Matrix<ScalarT,Eigen::Dynamic,1>::Zero(num_unknowns, 1));
 
-        // Conjugate Gradient solver
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IncompleteCholesky<ScalarT,Eigen::Lower|Eigen::Upper>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> solver;
-        solver.setMaxIterations(max_cg_iter);
-        solver.setTolerance(cg_conv_tol);
-
-        Eigen::SparseMatrix<ScalarT> AtA;
-        Eigen::Matrix<ScalarT,Eigen::Dynamic,1> Atb;
+        // Linear solver (Jacobi preconditioned CG unless given otherwise)
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> default_linear_solver;
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> &solver = (linear_solver != NULL) ? *linear_solver : default_linear_solver;
+        solver.setMaxNumberOfIterations(max_cg_iter).setConvergenceTolerance(cg_conv_tol);
 
         // Parameters
         const ScalarT point_to_point_weight_sqrt = std::sqrt(point_to_point_weight);
@@ -1235,14 +1201,8 @@ namespace cilantro {
                 }
             }
 
-            // Solve linear system using CG
-            AtA = At*At.transpose();
-            Atb.noalias() = At*b;
-
-//            solver.compute(AtA);
-            if (iter == 0) solver.analyzePattern(AtA);
-            solver.factorize(AtA);
-            delta = solver.solve(Atb);
+            // Solve normal equations
+            solver.solve(At, b, delta);
             tforms_vec += delta;
 
             iter++;
@@ -1297,7 +1257,8 @@ namespace cilantro {
                                           const PointCorrWeightEvaluatorT &point_corr_evaluator = PointCorrWeightEvaluatorT(),
                                           const PlaneCorrWeightEvaluatorT &plane_corr_evaluator = PlaneCorrWeightEvaluatorT(),
                                           const ControlWeightEvaluatorT &control_evaluator = ControlWeightEvaluatorT(),
-                                          const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT())
+                                          const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT(),
+                                          WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> *linear_solver = NULL)
     {
         typedef typename TransformT::Scalar ScalarT;
 
@@ -1402,16 +1363,10 @@ namespace cilantro {
         // Vector of unknowns (Euler angles and translation offsets per control node)
         Eigen::Matrix<ScalarT,Eigen::Dynamic,1> tforms_vec(Eigen::Matrix<ScalarT,Eigen::Dynamic,1>::Zero(num_unknowns, 1));
 
-        // Conjugate Gradient solver
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IncompleteCholesky<ScalarT,Eigen::Lower|Eigen::Upper>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,BlockDiagonalPreconditioner<ScalarT,6>> solver;
-        solver.setMaxIterations(max_cg_iter);
-        solver.setTolerance(cg_conv_tol);
-
-        Eigen::SparseMatrix<ScalarT> AtA;
-        Eigen::Matrix<ScalarT,Eigen::Dynamic,1> Atb;
+        // Linear solver (Jacobi preconditioned CG unless given otherwise)
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> default_linear_solver;
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> &solver = (linear_solver != NULL) ? *linear_solver : default_linear_solver;
+        solver.setMaxNumberOfIterations(max_cg_iter).setConvergenceTolerance(cg_conv_tol);
 
         // Parameters
         const ScalarT point_to_point_weight_sqrt = std::sqrt(point_to_point_weight);
@@ -1654,14 +1609,8 @@ namespace cilantro {
                 }
             }
 
-            // Solve linear system using CG
-            AtA = At*At.transpose();
-            Atb.noalias() = At*b;
-
-//            solver.compute(AtA);
-            if (iter == 0) solver.analyzePattern(AtA);
-            solver.factorize(AtA);
-            delta = solver.solve(Atb);
+            // Solve normal equations
+            solver.solve(At, b, delta);
             tforms_vec += delta;
 
             iter++;
@@ -1719,7 +1668,8 @@ namespace cilantro {
                                           const PointCorrWeightEvaluatorT &point_corr_evaluator = PointCorrWeightEvaluatorT(),
                                           const PlaneCorrWeightEvaluatorT &plane_corr_evaluator = PlaneCorrWeightEvaluatorT(),
                                           const ControlWeightEvaluatorT &control_evaluator = ControlWeightEvaluatorT(),
-                                          const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT())
+                                          const RegWeightEvaluatorT &reg_evaluator = RegWeightEvaluatorT(),
+                                          WarpFieldLinearSolver<typename TransformT::Scalar,internal::WarpFieldNodeUnknowns<TransformT>::value> *linear_solver = NULL)
     {
         typedef typename TransformT::Scalar ScalarT;
         enum {
@@ -1835,15 +1785,10 @@ namespace cilantro {
             tforms_vec.template segment<Dim>(i*NumUnknownsLocal + Dim*Dim).setZero();
         }
 
-        // Conjugate Gradient solver
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IncompleteCholesky<ScalarT,Eigen::Lower|Eigen::Upper>> solver;
-//        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::IdentityPreconditioner> solver;
-        Eigen::ConjugateGradient<Eigen::SparseMatrix<ScalarT>,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> solver;
-        solver.setMaxIterations(max_cg_iter);
-        solver.setTolerance(cg_conv_tol);
-
-        Eigen::SparseMatrix<ScalarT> AtA;
-        Eigen::Matrix<ScalarT,Eigen::Dynamic,1> Atb;
+        // Linear solver (Jacobi preconditioned CG unless given otherwise)
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> default_linear_solver;
+        WarpFieldLinearSolver<ScalarT,internal::WarpFieldNodeUnknowns<TransformT>::value> &solver = (linear_solver != NULL) ? *linear_solver : default_linear_solver;
+        solver.setMaxNumberOfIterations(max_cg_iter).setConvergenceTolerance(cg_conv_tol);
 
         // Parameters
         const ScalarT point_to_point_weight_sqrt = std::sqrt(point_to_point_weight);
@@ -1999,14 +1944,8 @@ namespace cilantro {
                 }
             }
 
-            // Solve linear system using CG
-            AtA = At*At.transpose();
-            Atb.noalias() = At*b;
-
-//            solver.compute(AtA);
-            if (iter == 0) solver.analyzePattern(AtA);
-            solver.factorize(AtA);
-            delta = solver.solve(Atb);
+            // Solve normal equations
+            solver.solve(At, b, delta);
             tforms_vec += delta;
 
             iter++;
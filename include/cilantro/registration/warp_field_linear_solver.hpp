@@ -0,0 +1,688 @@
+#pragma once
+
+#include <Eigen/Sparse>
+#include <cilantro/core/data_containers.hpp>
+
+namespace cilantro {
+    namespace internal {
+        // Unknowns per warp field node: rotation angles and translation (rigid) or matrix entries (affine)
+        template <class TransformT>
+        struct WarpFieldNodeUnknowns {
+            enum { value = (int(TransformT::Mode) == int(Eigen::Isometry)) ? ((TransformT::Dim == 2) ? 3 : 6) : TransformT::Dim*(TransformT::Dim + 1) };
+        };
+    }
+
+    // Symmetric block compressed sparse row matrix of BlockSize x BlockSize blocks, one block row/column per warp field
+    // node. It is assembled directly as the Gramian At*At^T of a (compressed, column-major) Jacobian transpose At:
+    // every block row is filled by a single thread from the equations (columns of At) involving its node, so neither a
+    // scalar sparse product nor atomics are needed.
+    template <typename ScalarT, ptrdiff_t BlockSize>
+    class BlockSparseMatrix {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::Matrix<ScalarT,BlockSize,BlockSize> Block;
+
+        typedef Eigen::Matrix<ScalarT,BlockSize,1> BlockVector;
+
+        typedef Eigen::SparseMatrix<ScalarT> SparseMatrix;
+
+        typedef typename SparseMatrix::StorageIndex StorageIndex;
+
+        BlockSparseMatrix() : num_block_rows_(0) {}
+
+        inline Eigen::Index rows() const { return num_block_rows_*BlockSize; }
+
+        inline Eigen::Index cols() const { return num_block_rows_*BlockSize; }
+
+        inline size_t getNumberOfBlockRows() const { return num_block_rows_; }
+
+        inline size_t getNumberOfBlocks() const { return blocks_.size(); }
+
+        inline const Block& getDiagonalBlock(size_t i) const { return blocks_[diag_ind_[i]]; }
+
+        // Nodes are coupled when an equation involves both; diagonal blocks are always present.
+        // At.rows() must be a multiple of BlockSize.
+        BlockSparseMatrix& analyzeGramianPattern(const SparseMatrix &At) {
+            const StorageIndex * const outer = At.outerIndexPtr();
+            const StorageIndex * const inner = At.innerIndexPtr();
+            num_block_rows_ = At.rows()/BlockSize;
+
+            // Equations involving each node
+            eq_ptr_.assign(num_block_rows_ + 1, 0);
+            for (StorageIndex j = 0; j < At.outerSize(); j++) {
+                for (StorageIndex p = outer[j]; p < outer[j + 1]; p++) {
+                    if (is_first_node_occurrence_(inner, outer[j], p)) eq_ptr_[inner[p]/BlockSize + 1]++;
+                }
+            }
+            for (size_t i = 1; i < eq_ptr_.size(); i++) {
+                eq_ptr_[i] += eq_ptr_[i - 1];
+            }
+            eq_ind_.resize(eq_ptr_.back());
+            std::vector<size_t> pos(eq_ptr_.begin(), eq_ptr_.end() - 1);
+            for (StorageIndex j = 0; j < At.outerSize(); j++) {
+                for (StorageIndex p = outer[j]; p < outer[j + 1]; p++) {
+                    if (is_first_node_occurrence_(inner, outer[j], p)) eq_ind_[pos[inner[p]/BlockSize]++] = j;
+                }
+            }
+
+            // Coupled nodes per block row
+            std::vector<std::vector<size_t>> neighbors(num_block_rows_);
+#pragma omp parallel for
+            for (size_t i = 0; i < num_block_rows_; i++) {
+                std::vector<size_t> &nb = neighbors[i];
+                nb.emplace_back(i);
+                for (size_t e = eq_ptr_[i]; e < eq_ptr_[i + 1]; e++) {
+                    for (StorageIndex p = outer[eq_ind_[e]]; p < outer[eq_ind_[e] + 1]; p++) {
+                        nb.emplace_back(inner[p]/BlockSize);
+                    }
+                }
+                std::sort(nb.begin(), nb.end());
+                nb.erase(std::unique(nb.begin(), nb.end()), nb.end());
+            }
+
+            row_ptr_.resize(num_block_rows_ + 1);
+            row_ptr_[0] = 0;
+            for (size_t i = 0; i < num_block_rows_; i++) {
+                row_ptr_[i + 1] = row_ptr_[i] + neighbors[i].size();
+            }
+            col_ind_.resize(row_ptr_.back());
+            diag_ind_.resize(num_block_rows_);
+            blocks_.resize(row_ptr_.back());
+#pragma omp parallel for
+            for (size_t i = 0; i < num_block_rows_; i++) {
+                std::copy(neighbors[i].begin(), neighbors[i].end(), col_ind_.begin() + row_ptr_[i]);
+                diag_ind_[i] = find_block_(i, i);
+            }
+
+            return *this;
+        }
+
+        // Fills the blocks of At*At^T and Atb = At*b, for the pattern of the last analyzeGramianPattern() call
+        template <class RhsT, class DestT>
+        BlockSparseMatrix& computeGramian(const SparseMatrix &At, const RhsT &b, DestT &Atb) {
+            const StorageIndex * const outer = At.outerIndexPtr();
+            const StorageIndex * const inner = At.innerIndexPtr();
+            const ScalarT * const values = At.valuePtr();
+            Atb.resize(rows());
+#pragma omp parallel for
+            for (size_t i = 0; i < num_block_rows_; i++) {
+                for (size_t k = row_ptr_[i]; k < row_ptr_[i + 1]; k++) {
+                    blocks_[k].setZero();
+                }
+                BlockVector rhs(BlockVector::Zero());
+                BlockVector own, other;
+                for (size_t e = eq_ptr_[i]; e < eq_ptr_[i + 1]; e++) {
+                    const StorageIndex j = eq_ind_[e];
+                    // Equation coefficients for this node, then rank-1 updates per run of same-node coefficients
+                    own.setZero();
+                    for (StorageIndex p = outer[j]; p < outer[j + 1]; p++) {
+                        if ((size_t)(inner[p]/BlockSize) == i) own[inner[p] - i*BlockSize] += values[p];
+                    }
+                    rhs += b[j]*own;
+                    StorageIndex p = outer[j];
+                    while (p < outer[j + 1]) {
+                        const size_t node = inner[p]/BlockSize;
+                        other.setZero();
+                        for (; p < outer[j + 1] && (size_t)(inner[p]/BlockSize) == node; p++) {
+                            other[inner[p] - node*BlockSize] += values[p];
+                        }
+                        blocks_[find_block_(i, node)].noalias() += own*other.transpose();
+                    }
+                }
+                Atb.template segment<BlockSize>(i*BlockSize) = rhs;
+            }
+            return *this;
+        }
+
+        template <class RhsT, class DestT>
+        void multiply(const RhsT &x, DestT &y) const {
+            y.resize(rows());
+#pragma omp parallel for
+            for (size_t i = 0; i < num_block_rows_; i++) {
+                BlockVector sum(BlockVector::Zero());
+                for (size_t k = row_ptr_[i]; k < row_ptr_[i + 1]; k++) {
+                    sum.noalias() += blocks_[k]*x.template segment<BlockSize>(col_ind_[k]*BlockSize);
+                }
+                y.template segment<BlockSize>(i*BlockSize) = sum;
+            }
+        }
+
+    private:
+        size_t num_block_rows_;
+        std::vector<size_t> row_ptr_;
+        std::vector<size_t> col_ind_;
+        std::vector<size_t> diag_ind_;
+        std::vector<Block,Eigen::aligned_allocator<Block>> blocks_;
+        // Equations (columns of At) involving each node
+        std::vector<size_t> eq_ptr_;
+        std::vector<StorageIndex> eq_ind_;
+
+        inline size_t find_block_(size_t row, size_t col) const {
+            return std::lower_bound(col_ind_.begin() + row_ptr_[row], col_ind_.begin() + row_ptr_[row + 1], col) - col_ind_.begin();
+        }
+
+        static inline bool is_first_node_occurrence_(const StorageIndex * inner, StorageIndex start, StorageIndex p) {
+            for (StorageIndex q = start; q < p; q++) {
+                if (inner[q]/BlockSize == inner[p]/BlockSize) return false;
+            }
+            return true;
+        }
+    };
+
+    // Block-Jacobi preconditioner for Eigen's iterative solvers: inverts the BlockSize x BlockSize diagonal blocks
+    // (one per warp field node) of a symmetric matrix
+    template <typename ScalarT, ptrdiff_t BlockSize>
+    class BlockDiagonalPreconditioner {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::Matrix<ScalarT,BlockSize,BlockSize> Block;
+
+        typedef Eigen::Matrix<ScalarT,Eigen::Dynamic,1> DenseVector;
+
+        typedef typename DenseVector::StorageIndex StorageIndex;
+
+        enum {
+            ColsAtCompileTime = Eigen::Dynamic,
+            MaxColsAtCompileTime = Eigen::Dynamic
+        };
+
+        BlockDiagonalPreconditioner() : size_(0) {}
+
+        template <class MatT>
+        explicit BlockDiagonalPreconditioner(const MatT &mat) { compute(mat); }
+
+        inline Eigen::Index rows() const { return size_; }
+
+        inline Eigen::Index cols() const { return size_; }
+
+        template <class MatT>
+        inline BlockDiagonalPreconditioner& analyzePattern(const MatT&) { return *this; }
+
+        // Extracts the diagonal blocks of a (column-major) sparse matrix
+        template <class MatT>
+        BlockDiagonalPreconditioner& factorize(const MatT &mat) {
+            init_blocks_(mat.cols());
+#pragma omp parallel for
+            for (size_t k = 0; k < blocks_.size(); k++) {
+                const Eigen::Index start = k*BlockSize;
+                const Eigen::Index end = std::min<Eigen::Index>(start + BlockSize, size_);
+                for (Eigen::Index j = start; j < end; j++) {
+                    for (typename MatT::InnerIterator it(mat, j); it; ++it) {
+                        if (it.index() >= start && it.index() < end) blocks_[k](it.index() - start, j - start) = it.value();
+                    }
+                }
+                invert_block_(blocks_[k]);
+            }
+            return *this;
+        }
+
+        BlockDiagonalPreconditioner& factorize(const BlockSparseMatrix<ScalarT,BlockSize> &mat) {
+            size_ = mat.rows();
+            blocks_.resize(mat.getNumberOfBlockRows());
+#pragma omp parallel for
+            for (size_t k = 0; k < blocks_.size(); k++) {
+                blocks_[k] = mat.getDiagonalBlock(k);
+                invert_block_(blocks_[k]);
+            }
+            return *this;
+        }
+
+        template <class MatT>
+        inline BlockDiagonalPreconditioner& compute(const MatT &mat) { return factorize(mat); }
+
+        // Diagonal blocks of At*At^T, without forming the product; At_row is a row-major copy of At
+        BlockDiagonalPreconditioner& factorizeGramian(const Eigen::SparseMatrix<ScalarT> &At,
+                                                      const Eigen::SparseMatrix<ScalarT,Eigen::RowMajor> &At_row)
+        {
+            init_blocks_(At.rows());
+#pragma omp parallel for
+            for (size_t k = 0; k < blocks_.size(); k++) {
+                const Eigen::Index start = k*BlockSize;
+                const Eigen::Index end = std::min<Eigen::Index>(start + BlockSize, size_);
+                for (Eigen::Index r = start; r < end; r++) {
+                    for (typename Eigen::SparseMatrix<ScalarT,Eigen::RowMajor>::InnerIterator eq(At_row, r); eq; ++eq) {
+                        for (typename Eigen::SparseMatrix<ScalarT>::InnerIterator it(At, eq.index()); it; ++it) {
+                            if (it.index() >= start && it.index() < end) blocks_[k](r - start, it.index() - start) += eq.value()*it.value();
+                        }
+                    }
+                }
+                invert_block_(blocks_[k]);
+            }
+            return *this;
+        }
+
+        template <class RhsT, class DestT>
+        void applyInverse(const RhsT &b, DestT &x) const {
+            x.resize(size_);
+#pragma omp parallel for
+            for (size_t k = 0; k < blocks_.size(); k++) {
+                const Eigen::Index start = k*BlockSize;
+                const Eigen::Index len = std::min<Eigen::Index>(BlockSize, size_ - start);
+                if (len == BlockSize) {
+                    x.template segment<BlockSize>(start).noalias() = blocks_[k]*b.template segment<BlockSize>(start);
+                } else {
+                    x.segment(start, len).noalias() = blocks_[k].topLeftCorner(len, len)*b.segment(start, len);
+                }
+            }
+        }
+
+        template <class RhsT>
+        inline DenseVector solve(const Eigen::MatrixBase<RhsT> &b) const {
+            DenseVector x;
+            applyInverse(b, x);
+            return x;
+        }
+
+        inline Eigen::ComputationInfo info() const { return Eigen::Success; }
+
+    private:
+        std::vector<Block,Eigen::aligned_allocator<Block>> blocks_;
+        Eigen::Index size_;
+
+        inline void init_blocks_(Eigen::Index size) {
+            size_ = size;
+            blocks_.resize((size + BlockSize - 1)/BlockSize);
+#pragma omp parallel for
+            for (size_t k = 0; k < blocks_.size(); k++) {
+                blocks_[k].setZero();
+            }
+        }
+
+        // Damped slightly, as blocks of nodes with few equations are often singular
+        static inline void invert_block_(Block &block) {
+            const ScalarT trace = block.trace();
+            const ScalarT damping = (trace > (ScalarT)0.0) ? std::sqrt(std::numeric_limits<ScalarT>::epsilon())*trace/BlockSize : (ScalarT)1.0;
+            for (size_t i = 0; i < BlockSize; i++) {
+                if (block(i,i) == (ScalarT)0.0) block(i,i) = (ScalarT)1.0;
+                block(i,i) += damping;
+            }
+            block = block.ldlt().solve(Block::Identity());
+        }
+    };
+
+    enum struct WarpFieldLinearSolverType {DIAGONAL_PRECONDITIONED_CG, BLOCK_JACOBI_PRECONDITIONED_CG, MATRIX_FREE_CG, SIMPLICIAL_LDLT, BLOCK_SPARSE_CG};
+
+    // Solves the Gauss-Newton normal equations (At*At^T)*x = At*b of warp field estimation.
+    // Backends:
+    //   DIAGONAL_PRECONDITIONED_CG: forms AtA, Jacobi preconditioned CG (default)
+    //   BLOCK_JACOBI_PRECONDITIONED_CG: forms AtA, preconditioned with its inverted per node diagonal blocks
+    //   MATRIX_FREE_CG: block-Jacobi preconditioned CG that applies At and At^T without forming AtA
+    //   SIMPLICIAL_LDLT: sparse direct solver; the symbolic analysis is reused while the sparsity pattern of AtA
+    //   does not change
+    //   BLOCK_SPARSE_CG: assembles AtA and Atb directly into a BlockSparseMatrix (in parallel, one owner per node),
+    //   block-Jacobi preconditioned CG with block matrix-vector products
+    // When At has the same sparsity pattern in two consecutive solves (e.g. across Gauss-Newton iterations, or ICP
+    // iterations with unchanged correspondences), a map from pairs of At nonzeros to AtA entries is built (in parallel,
+    // up to getMaxGatherMapSize() pairs) and AtA values are refilled from it without a sparse product for as long as
+    // the pattern stays the same. A pattern seen for the first time is always handled by the plain sparse product.
+    // Keeping one instance alive across calls (e.g. across ICP iterations) reuses all internal storage.
+    template <typename ScalarT, ptrdiff_t BlockSize>
+    class WarpFieldLinearSolver {
+    public:
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        typedef Eigen::SparseMatrix<ScalarT> SparseMatrix;
+
+        typedef Eigen::Matrix<ScalarT,Eigen::Dynamic,1> DenseVector;
+
+        typedef typename SparseMatrix::StorageIndex StorageIndex;
+
+        enum { NodeBlockSize = BlockSize };
+
+        WarpFieldLinearSolver(WarpFieldLinearSolverType type = WarpFieldLinearSolverType::DIAGONAL_PRECONDITIONED_CG)
+                : type_(type), max_iter_(1000), conv_tol_((ScalarT)1e-5),
+                  num_performed_iter_(0), max_gather_size_((size_t)1 << 22), At_rows_(-1), pattern_repeated_(false),
+                  AtA_pattern_valid_(false), gather_valid_(false), ldlt_pattern_valid_(false), block_pattern_valid_(false)
+        {}
+
+        inline WarpFieldLinearSolverType getSolverType() const { return type_; }
+
+        inline WarpFieldLinearSolver& setSolverType(WarpFieldLinearSolverType type) {
+            type_ = type;
+            return *this;
+        }
+
+        // Iterative backends only
+        inline size_t getMaxNumberOfIterations() const { return max_iter_; }
+
+        inline WarpFieldLinearSolver& setMaxNumberOfIterations(size_t max_iter) {
+            max_iter_ = max_iter;
+            return *this;
+        }
+
+        // Relative residual tolerance, iterative backends only
+        inline ScalarT getConvergenceTolerance() const { return conv_tol_; }
+
+        inline WarpFieldLinearSolver& setConvergenceTolerance(ScalarT conv_tol) {
+            conv_tol_ = conv_tol;
+            return *this;
+        }
+
+        inline size_t getNumberOfPerformedIterations() const { return num_performed_iter_; }
+
+        // Maximum number of At nonzero pairs in the AtA refill map (two indices each); AtA is recomputed by sparse
+        // product when more are needed, 0 disables the map
+        inline size_t getMaxGatherMapSize() const { return max_gather_size_; }
+
+        inline WarpFieldLinearSolver& setMaxGatherMapSize(size_t max_size) {
+            max_gather_size_ = max_size;
+            if (gather_.size() > max_gather_size_) gather_valid_ = false;
+            return *this;
+        }
+
+        // Forces symbolic re-analysis on the next solve
+        inline WarpFieldLinearSolver& resetSparsityPattern() {
+            At_rows_ = -1;
+            pattern_repeated_ = false;
+            AtA_pattern_valid_ = false;
+            gather_valid_ = false;
+            ldlt_pattern_valid_ = false;
+            block_pattern_valid_ = false;
+            return *this;
+        }
+
+        bool solve(const SparseMatrix &At, const DenseVector &b, DenseVector &x) {
+            if (!At.isCompressed()) {
+                At_compressed_ = At;
+                At_compressed_.makeCompressed();
+                return solve(At_compressed_, b, x);
+            }
+
+            num_performed_iter_ = 0;
+            update_pattern_(At);
+            switch (type_) {
+                case WarpFieldLinearSolverType::DIAGONAL_PRECONDITIONED_CG:
+                    compute_normal_equations_(At, b);
+                    return solve_iterative_(diagonal_cg_, x);
+                case WarpFieldLinearSolverType::BLOCK_JACOBI_PRECONDITIONED_CG:
+                    compute_normal_equations_(At, b);
+                    return solve_iterative_(block_jacobi_cg_, x);
+                case WarpFieldLinearSolverType::MATRIX_FREE_CG:
+                    return solve_matrix_free_(At, b, x);
+                case WarpFieldLinearSolverType::SIMPLICIAL_LDLT:
+                    compute_normal_equations_(At, b);
+                    return solve_ldlt_(x);
+                case WarpFieldLinearSolverType::BLOCK_SPARSE_CG:
+                    if (At.rows()%BlockSize == 0) return solve_block_sparse_(At, b, x);
+                    compute_normal_equations_(At, b);
+                    return solve_iterative_(block_jacobi_cg_, x);
+            }
+            return false;
+        }
+
+    private:
+        WarpFieldLinearSolverType type_;
+        size_t max_iter_;
+        ScalarT conv_tol_;
+        size_t num_performed_iter_;
+        size_t max_gather_size_;
+
+        SparseMatrix AtA_;
+        DenseVector Atb_;
+
+        SparseMatrix At_compressed_;
+
+        // Cached sparsity pattern of At; all symbolic data below is invalidated when it changes
+        std::vector<StorageIndex> At_outer_;
+        std::vector<StorageIndex> At_inner_;
+        Eigen::Index At_rows_;
+        // At had the cached pattern in the previous solve too
+        bool pattern_repeated_;
+        // AtA_ has the structure of At*At^T for the cached pattern
+        bool AtA_pattern_valid_;
+        bool gather_valid_;
+        // Upper triangle entry k of AtA is the sum of products of At value pairs gather_[gather_ptr_[k]...gather_ptr_[k+1])
+        std::vector<StorageIndex> gather_ptr_;
+        std::vector<std::pair<StorageIndex,StorageIndex>> gather_;
+        // Strictly lower triangle entries (first) copied from their upper triangle counterparts (second)
+        std::vector<std::pair<StorageIndex,StorageIndex>> mirror_;
+
+        Eigen::ConjugateGradient<SparseMatrix,Eigen::Lower|Eigen::Upper,Eigen::DiagonalPreconditioner<ScalarT>> diagonal_cg_;
+        Eigen::ConjugateGradient<SparseMatrix,Eigen::Lower|Eigen::Upper,BlockDiagonalPreconditioner<ScalarT,BlockSize>> block_jacobi_cg_;
+
+        Eigen::SimplicialLDLT<SparseMatrix> ldlt_;
+        bool ldlt_pattern_valid_;
+
+        BlockSparseMatrix<ScalarT,BlockSize> block_AtA_;
+        bool block_pattern_valid_;
+
+        // Block-Jacobi PCG workspace (matrix-free and block sparse backends)
+        Eigen::SparseMatrix<ScalarT,Eigen::RowMajor> At_row_;
+        BlockDiagonalPreconditioner<ScalarT,BlockSize> preconditioner_;
+        DenseVector residual_, direction_, z_, A_direction_, tmp_;
+
+        inline void update_pattern_(const SparseMatrix &At) {
+            if (At_rows_ == At.rows() && At_outer_.size() == (size_t)At.outerSize() + 1 && At_inner_.size() == (size_t)At.nonZeros() &&
+                std::equal(At_outer_.begin(), At_outer_.end(), At.outerIndexPtr()) &&
+                std::equal(At_inner_.begin(), At_inner_.end(), At.innerIndexPtr()))
+            {
+                pattern_repeated_ = true;
+                return;
+            }
+            resetSparsityPattern();
+            At_rows_ = At.rows();
+            At_outer_.assign(At.outerIndexPtr(), At.outerIndexPtr() + At.outerSize() + 1);
+            At_inner_.assign(At.innerIndexPtr(), At.innerIndexPtr() + At.nonZeros());
+        }
+
+        inline void compute_normal_equations_(const SparseMatrix &At, const DenseVector &b) {
+            if (!gather_valid_ && pattern_repeated_ && AtA_pattern_valid_) build_gather_map_(At);
+            if (gather_valid_) {
+                refill_normal_matrix_(At);
+            } else {
+                AtA_ = At*At.transpose();
+                AtA_pattern_valid_ = true;
+            }
+            Atb_.noalias() = At*b;
+        }
+
+        // Offset of entry (row, col) in the value array of AtA_
+        inline StorageIndex find_entry_(StorageIndex row, StorageIndex col) const {
+            const StorageIndex * const inner = AtA_.innerIndexPtr();
+            return std::lower_bound(inner + AtA_.outerIndexPtr()[col], inner + AtA_.outerIndexPtr()[col + 1], row) - inner;
+        }
+
+        // Calls f(entry, p, q) for every At nonzero pair contributing to the upper triangle of AtA column c, given the
+        // (column, position) lists of the nonzeros of the rows of At; entry_of_row is scratch space of size At.rows()
+        template <class FunctorT>
+        inline void for_each_gather_pair_(const SparseMatrix &At,
+                                          const std::vector<StorageIndex> &row_ptr,
+                                          const std::vector<std::pair<StorageIndex,StorageIndex>> &row_nz,
+                                          StorageIndex c,
+                                          std::vector<StorageIndex> &entry_of_row,
+                                          const FunctorT &f) const
+        {
+            const StorageIndex * const outer = At.outerIndexPtr();
+            const StorageIndex * const inner = At.innerIndexPtr();
+            for (StorageIndex k = AtA_.outerIndexPtr()[c]; k < AtA_.outerIndexPtr()[c + 1]; k++) {
+                entry_of_row[AtA_.innerIndexPtr()[k]] = k;
+            }
+            for (StorageIndex m = row_ptr[c]; m < row_ptr[c + 1]; m++) {
+                const StorageIndex j = row_nz[m].first;
+                for (StorageIndex p = outer[j]; p < outer[j + 1] && inner[p] <= c; p++) {
+                    f(entry_of_row[inner[p]], p, row_nz[m].second);
+                }
+            }
+        }
+
+        // Builds the gather map for the structure of AtA_ (left by the sparse product), unless it would exceed
+        // max_gather_size_ pairs. Upper triangle columns of AtA are processed in parallel: column c gathers the At
+        // nonzero pairs (p, q) with q in row c of At and inner(p) <= c in the same At column.
+        void build_gather_map_(const SparseMatrix &At) {
+            const StorageIndex * const outer = At.outerIndexPtr();
+            const StorageIndex * const inner = At.innerIndexPtr();
+
+            size_t num_pairs = 0;
+            for (StorageIndex j = 0; j < At.outerSize(); j++) {
+                const size_t count = outer[j + 1] - outer[j];
+                num_pairs += count*(count + 1)/2;
+            }
+            if (num_pairs > max_gather_size_) return;
+
+            // Columns and value positions of the nonzeros of every row of At
+            std::vector<StorageIndex> row_ptr(At.rows() + 1, 0);
+            for (StorageIndex p = 0; p < At.nonZeros(); p++) {
+                row_ptr[inner[p] + 1]++;
+            }
+            for (size_t r = 1; r < row_ptr.size(); r++) {
+                row_ptr[r] += row_ptr[r - 1];
+            }
+            std::vector<std::pair<StorageIndex,StorageIndex>> row_nz(At.nonZeros());
+            std::vector<StorageIndex> row_fill(row_ptr.begin(), row_ptr.end() - 1);
+            for (StorageIndex j = 0; j < At.outerSize(); j++) {
+                for (StorageIndex p = outer[j]; p < outer[j + 1]; p++) {
+                    row_nz[row_fill[inner[p]]++] = std::pair<StorageIndex,StorageIndex>(j, p);
+                }
+            }
+
+            const StorageIndex * const AtA_outer = AtA_.outerIndexPtr();
+            const StorageIndex * const AtA_inner = AtA_.innerIndexPtr();
+            const StorageIndex num_cols = AtA_.outerSize();
+
+            // Count contributions per entry, then fill
+            gather_ptr_.assign(AtA_.nonZeros() + 1, 0);
+#pragma omp parallel
+            {
+                std::vector<StorageIndex> entry_of_row(At.rows());
+#pragma omp for schedule (dynamic, 64)
+                for (StorageIndex c = 0; c < num_cols; c++) {
+                    for_each_gather_pair_(At, row_ptr, row_nz, c, entry_of_row, [this](StorageIndex k, StorageIndex, StorageIndex) {
+                        gather_ptr_[k + 1]++;
+                    });
+                }
+            }
+            for (size_t k = 1; k < gather_ptr_.size(); k++) {
+                gather_ptr_[k] += gather_ptr_[k - 1];
+            }
+            gather_.resize(gather_ptr_.back());
+#pragma omp parallel
+            {
+                std::vector<StorageIndex> entry_of_row(At.rows());
+                std::vector<StorageIndex> pos;
+#pragma omp for schedule (dynamic, 64)
+                for (StorageIndex c = 0; c < num_cols; c++) {
+                    const StorageIndex offset = AtA_outer[c];
+                    pos.assign(gather_ptr_.begin() + offset, gather_ptr_.begin() + AtA_outer[c + 1]);
+                    for_each_gather_pair_(At, row_ptr, row_nz, c, entry_of_row, [this,&pos,offset](StorageIndex k, StorageIndex p, StorageIndex q) {
+                        gather_[pos[k - offset]++] = std::pair<StorageIndex,StorageIndex>(p, q);
+                    });
+                }
+            }
+
+            // Strictly lower entries of column c follow its upper ones (rows are sorted)
+            std::vector<StorageIndex> mirror_ptr(num_cols + 1, 0);
+#pragma omp parallel for
+            for (StorageIndex c = 0; c < num_cols; c++) {
+                mirror_ptr[c + 1] = AtA_outer[c + 1] - find_entry_(c + 1, c);
+            }
+            for (size_t c = 1; c < mirror_ptr.size(); c++) {
+                mirror_ptr[c] += mirror_ptr[c - 1];
+            }
+            mirror_.resize(mirror_ptr.back());
+#pragma omp parallel for
+            for (StorageIndex c = 0; c < num_cols; c++) {
+                StorageIndex m = mirror_ptr[c];
+                for (StorageIndex k = find_entry_(c + 1, c); k < AtA_outer[c + 1]; k++) {
+                    mirror_[m++] = std::pair<StorageIndex,StorageIndex>(k, find_entry_(c, AtA_inner[k]));
+                }
+            }
+
+            gather_valid_ = true;
+        }
+
+        void refill_normal_matrix_(const SparseMatrix &At) {
+            const ScalarT * const at_values = At.valuePtr();
+            ScalarT * const values = AtA_.valuePtr();
+#pragma omp parallel for
+            for (size_t k = 0; k < gather_ptr_.size() - 1; k++) {
+                ScalarT sum = (ScalarT)0.0;
+                for (StorageIndex m = gather_ptr_[k]; m < gather_ptr_[k + 1]; m++) {
+                    sum += at_values[gather_[m].first]*at_values[gather_[m].second];
+                }
+                values[k] = sum;
+            }
+#pragma omp parallel for
+            for (size_t m = 0; m < mirror_.size(); m++) {
+                values[mirror_[m].first] = values[mirror_[m].second];
+            }
+        }
+
+        template <class SolverT>
+        inline bool solve_iterative_(SolverT &solver, DenseVector &x) {
+            solver.setMaxIterations(max_iter_);
+            solver.setTolerance(conv_tol_);
+            solver.compute(AtA_);
+            x = solver.solve(Atb_);
+            num_performed_iter_ = solver.iterations();
+            return solver.info() == Eigen::Success;
+        }
+
+        inline bool solve_ldlt_(DenseVector &x) {
+            if (!ldlt_pattern_valid_) {
+                ldlt_.analyzePattern(AtA_);
+                ldlt_pattern_valid_ = true;
+            }
+            ldlt_.factorize(AtA_);
+            if (ldlt_.info() != Eigen::Success) {
+                x.setZero(AtA_.cols());
+                return false;
+            }
+            x = ldlt_.solve(Atb_);
+            return true;
+        }
+
+        // Block-Jacobi preconditioned CG on At*At^T; both products run in parallel on row-major operands
+        inline bool solve_matrix_free_(const SparseMatrix &At, const DenseVector &b, DenseVector &x) {
+            At_row_ = At;
+            Atb_.noalias() = At_row_*b;
+            preconditioner_.factorizeGramian(At, At_row_);
+            return solve_preconditioned_cg_([&](const DenseVector &p, DenseVector &Ap) {
+                tmp_.noalias() = At.transpose()*p;
+                Ap.noalias() = At_row_*tmp_;
+            }, x);
+        }
+
+        inline bool solve_block_sparse_(const SparseMatrix &At, const DenseVector &b, DenseVector &x) {
+            if (!block_pattern_valid_) {
+                block_AtA_.analyzeGramianPattern(At);
+                block_pattern_valid_ = true;
+            }
+            block_AtA_.computeGramian(At, b, Atb_);
+            preconditioner_.factorize(block_AtA_);
+            return solve_preconditioned_cg_([&](const DenseVector &p, DenseVector &Ap) {
+                block_AtA_.multiply(p, Ap);
+            }, x);
+        }
+
+        // Solves AtA*x = Atb_ given a functor that applies AtA, preconditioned by preconditioner_
+        template <class MatVecT>
+        bool solve_preconditioned_cg_(const MatVecT &apply_AtA, DenseVector &x) {
+            x.setZero(Atb_.size());
+            const ScalarT rhs_norm_sq = Atb_.squaredNorm();
+            if (rhs_norm_sq == (ScalarT)0.0) return true;
+            const ScalarT threshold = conv_tol_*conv_tol_*rhs_norm_sq;
+
+            residual_ = Atb_;
+            preconditioner_.applyInverse(residual_, direction_);
+            ScalarT abs_new = residual_.dot(direction_);
+            while (num_performed_iter_ < max_iter_) {
+                apply_AtA(direction_, A_direction_);
+
+                const ScalarT alpha = abs_new/direction_.dot(A_direction_);
+                x += alpha*direction_;
+                residual_ -= alpha*A_direction_;
+                num_performed_iter_++;
+
+                if (residual_.squaredNorm() < threshold) return true;
+
+                preconditioner_.applyInverse(residual_, z_);
+                const ScalarT abs_old = abs_new;
+                abs_new = residual_.dot(z_);
+                direction_ = z_ + (abs_new/abs_old)*direction_;
+            }
+            return false;
+        }
+    };
+}
@@ -2,6 +2,7 @@
 
 #include <Eigen/Sparse>
 #include <cilantro/core/common_pair_evaluators.hpp>
+#include <cilantro/core/nearest_neighbors.hpp>
 
 namespace cilantro {
     template <typename T, typename DegT = size_t>
@@ -47,6 +48,39 @@ namespace cilantro {
         return (remove_self) ? sum - adj_list.size() : sum;
     }
 
+    template <typename ScalarT, typename IndexT, typename DegT = size_t>
+    std::vector<DegT> getNNGraphNodeDegrees(const FlatNeighborhoodSet<ScalarT,IndexT> &adj_list,
+                                            bool remove_self = true)
+    {
+        std::vector<DegT> deg(adj_list.size());
+        const size_t offset = (remove_self) ? 1 : 0;
+#pragma omp parallel for
+        for (size_t i = 0; i < deg.size(); i++) {
+            deg[i] = adj_list.getNumberOfNeighbors(i) - offset;
+        }
+        return deg;
+    }
+
+    template <typename ScalarT, typename IndexT>
+    size_t getNNGraphMaxNodeDegree(const FlatNeighborhoodSet<ScalarT,IndexT> &adj_list,
+                                   bool remove_self = true)
+    {
+        size_t max = 0;
+#pragma omp parallel for reduction (max: max)
+        for (size_t i = 0; i < adj_list.size(); i++) {
+            if (max < adj_list.getNumberOfNeighbors(i)) max = adj_list.getNumberOfNeighbors(i);
+        }
+        return (remove_self) ? max - 1 : max;
+    }
+
+    template <typename ScalarT, typename IndexT>
+    inline size_t getNNGraphSumOfNodeDegrees(const FlatNeighborhoodSet<ScalarT,IndexT> &adj_list,
+                                             bool remove_self = true)
+    {
+        const size_t sum = adj_list.neighbors.size();
+        return (remove_self) ? sum - adj_list.size() : sum;
+    }
+
     template <typename NeighborhoodSetT, class PairEvaluatorT, typename ValueT = typename PairEvaluatorT::OutputScalar>
     std::vector<std::vector<ValueT>> getNNGraphFunctionValueList(const NeighborhoodSetT &adj_list,
                                                                  const PairEvaluatorT &evaluator = PairEvaluatorT())
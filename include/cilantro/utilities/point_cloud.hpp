@@ -5,6 +5,7 @@
 #include <cilantro/core/image_point_cloud_conversions.hpp>
 #include <cilantro/core/grid_downsampler.hpp>
 #include <cilantro/core/normal_estimation.hpp>
+#include <cilantro/core/space_filling_curve.hpp>
 #include <cilantro/utilities/ply_io.hpp>
 
 namespace cilantro {
@@ -240,35 +241,59 @@ namespace cilantro {
             return remove(ind_to_remove);
         }
 
-        template <typename GridPointScalarT = ptrdiff_t>
+        template <typename GridPointScalarT = ptrdiff_t, GridBinningMethod BinningMethod = GridBinningMethod::ORDERED_MAP>
         PointCloud& gridDownsample(ScalarT bin_size, size_t min_points_in_bin = 1, bool parallel = true) {
             if (hasNormals() && hasColors()) {
-                PointsNormalsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, normals, colors, bin_size, parallel).getDownsampledPointsNormalsColors(points, normals, colors, min_points_in_bin);
+                PointsNormalsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, normals, colors, bin_size, parallel).getDownsampledPointsNormalsColors(points, normals, colors, min_points_in_bin);
             } else if (hasNormals()) {
-                PointsNormalsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, normals, bin_size, parallel).getDownsampledPointsNormals(points, normals, min_points_in_bin);
+                PointsNormalsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, normals, bin_size, parallel).getDownsampledPointsNormals(points, normals, min_points_in_bin);
             } else if (hasColors()) {
-                PointsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, colors, bin_size, parallel).getDownsampledPointsColors(points, colors, min_points_in_bin);
+                PointsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, colors, bin_size, parallel).getDownsampledPointsColors(points, colors, min_points_in_bin);
             } else {
-                PointsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, bin_size, parallel).getDownsampledPoints(points, min_points_in_bin);
+                PointsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, bin_size, parallel).getDownsampledPoints(points, min_points_in_bin);
             }
             return *this;
         }
 
-        template <typename GridPointScalarT = ptrdiff_t>
+        template <typename GridPointScalarT = ptrdiff_t, GridBinningMethod BinningMethod = GridBinningMethod::ORDERED_MAP>
         PointCloud gridDownsampled(ScalarT bin_size, size_t min_points_in_bin = 1, bool parallel = true) const {
             PointCloud res;
             if (hasNormals() && hasColors()) {
-                PointsNormalsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, normals, colors, bin_size, parallel).getDownsampledPointsNormalsColors(res.points, res.normals, res.colors, min_points_in_bin);
+                PointsNormalsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, normals, colors, bin_size, parallel).getDownsampledPointsNormalsColors(res.points, res.normals, res.colors, min_points_in_bin);
             } else if (hasNormals()) {
-                PointsNormalsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, normals, bin_size, parallel).getDownsampledPointsNormals(res.points, res.normals, min_points_in_bin);
+                PointsNormalsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, normals, bin_size, parallel).getDownsampledPointsNormals(res.points, res.normals, min_points_in_bin);
             } else if (hasColors()) {
-                PointsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, colors, bin_size, parallel).getDownsampledPointsColors(res.points, res.colors, min_points_in_bin);
+                PointsColorsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, colors, bin_size, parallel).getDownsampledPointsColors(res.points, res.colors, min_points_in_bin);
             } else {
-                PointsGridDownsampler<ScalarT,EigenDim,GridPointScalarT>(points, bin_size, parallel).getDownsampledPoints(res.points, min_points_in_bin);
+                PointsGridDownsampler<ScalarT,EigenDim,GridPointScalarT,BinningMethod>(points, bin_size, parallel).getDownsampledPoints(res.points, min_points_in_bin);
             }
             return res;
         }
 
+        // Sorts points (and normals/colors) along a space filling curve, for cache locality in subsequent KD-tree
+        // construction and neighborhood queries; order receives the applied permutation
+        PointCloud& reorderAlongSpaceFillingCurve(std::vector<size_t> &order, SpaceFillingCurve curve = SpaceFillingCurve::HILBERT) {
+            const bool has_normals = hasNormals();
+            const bool has_colors = hasColors();
+            cilantro::reorderAlongSpaceFillingCurve<ScalarT,EigenDim>(points, order, curve);
+            if (has_normals) {
+                VectorSet<ScalarT,EigenDim> tmp;
+                reorderVectorSet<ScalarT,EigenDim>(normals, order, tmp);
+                normals.swap(tmp);
+            }
+            if (has_colors) {
+                VectorSet<float,3> tmp;
+                reorderVectorSet<float,3>(colors, order, tmp);
+                colors.swap(tmp);
+            }
+            return *this;
+        }
+
+        inline PointCloud& reorderAlongSpaceFillingCurve(SpaceFillingCurve curve = SpaceFillingCurve::HILBERT) {
+            std::vector<size_t> order;
+            return reorderAlongSpaceFillingCurve(order, curve);
+        }
+
         template <typename IndexT = size_t, typename CountT = size_t, typename CovarianceT = Covariance<ScalarT, EigenDim>>
         inline PointCloud& estimateNormalsKNN(CountT k, bool use_current_as_ref = false) {
             use_current_as_ref = use_current_as_ref && hasNormals();